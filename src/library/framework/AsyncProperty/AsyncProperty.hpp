@@ -1,4 +1,5 @@
 #include "AsyncPropertyNode.hpp"
 #include "AsyncPropertyImpl.hpp"
 #include "AsyncPropertyArray.hpp"
+#include "AsyncPropertyVector.hpp"
 #include "AsyncPropertyContainer.hpp"
\ No newline at end of file
@@ -6,10 +6,17 @@
 #include "../StaticVector/StaticVector.hpp"
 #include "../ScopedTask/ScopedTask.hpp"
 #include "AsyncPropertyNode.hpp"
+#include "AsyncPropertyArrayView.hpp"
+#include "AsyncPropertyKernel.hpp"
+#include "AsyncPropertyRangeSet.hpp"
 
 #include <functional>
 #include <initializer_list>
 #include <type_traits>
+#include <atomic>
+#include <algorithm>
+#include <mutex>
+#include <bitset>
 
 namespace Bn3Monkey
 {
@@ -20,8 +27,10 @@ namespace Bn3Monkey
     public:
         OnPropertyArrayNotified(const ScopedTaskScope& scope, std::function<bool(const Type*, size_t, size_t)> function) : scope(scope), function(function) {
         }
-        ScopedTaskResult<bool> operator()(const Bn3Tag& name, const Type* values, size_t start, size_t end) {
-            return scope.call(name, function, values, start, end);
+        ScopedTaskResult<bool> operator()(const Bn3Tag& name, const AsyncPropertyArrayView<Type>& view, size_t start, size_t end) {
+            return scope.call(name, [function = function, view, start, end]() {
+                return function(view.data(), start, end);
+                });
         }
     private:
         ScopedTaskScope scope;
@@ -34,14 +43,49 @@ namespace Bn3Monkey
     public:
         OnPropertyArrayUpdated(const ScopedTaskScope& scope, std::function<void(const Type*, size_t, size_t, bool)> function) : scope(scope), function(function) {
         }
-        void operator()(const Bn3Tag& name, const Type* values, size_t start, size_t end, bool success) {
-            scope.run(name, function, values, start, end, success);
+        void operator()(const Bn3Tag& name, const AsyncPropertyArrayView<Type>& view, size_t start, size_t end, bool success) {
+            scope.run(name, [function = function, view, start, end, success]() {
+                function(view.data(), start, end, success);
+                });
         }
     private:
         ScopedTaskScope scope;
         std::function<void(const Type*, size_t, size_t, bool)> function;
     };
 
+    // Listeners receive the whole array and the ranges changed by a commit.
+    template<typename Type>
+    class OnPropertyArrayRangesNotified
+    {
+    public:
+        OnPropertyArrayRangesNotified(const ScopedTaskScope& scope, std::function<bool(const Type*, const AsyncPropertyRange*, size_t)> function) : scope(scope), function(function) {
+        }
+        ScopedTaskResult<bool> operator()(const Bn3Tag& name, const AsyncPropertyArrayView<Type>& view, const AsyncPropertyRangeSet& ranges) {
+            return scope.call(name, [function = function, view, ranges]() {
+                return function(view.data(), ranges.begin(), ranges.size());
+                });
+        }
+    private:
+        ScopedTaskScope scope;
+        std::function<bool(const Type*, const AsyncPropertyRange*, size_t)> function;
+    };
+
+    template<typename Type>
+    class OnPropertyArrayRangesUpdated
+    {
+    public:
+        OnPropertyArrayRangesUpdated(const ScopedTaskScope& scope, std::function<void(const Type*, const AsyncPropertyRange*, size_t, bool)> function) : scope(scope), function(function) {
+        }
+        void operator()(const Bn3Tag& name, const AsyncPropertyArrayView<Type>& view, const AsyncPropertyRangeSet& ranges, bool success) {
+            scope.run(name, [function = function, view, ranges, success]() {
+                function(view.data(), ranges.begin(), ranges.size(), success);
+                });
+        }
+    private:
+        ScopedTaskScope scope;
+        std::function<void(const Type*, const AsyncPropertyRange*, size_t, bool)> function;
+    };
+
     
     template <typename Type, size_t MAX_ARRAY_SIZE>
     class AsyncPropertyArray : public AsyncPropertyNode
@@ -53,9 +97,8 @@ namespace Bn3Monkey
         {
             assert(length <= MAX_ARRAY_SIZE);
 
-            _prev_values = Bn3StaticVector<Type, MAX_ARRAY_SIZE>(values, length);
-            _values = _prev_values;
-
+            _values = Bn3StaticVector<Type, MAX_ARRAY_SIZE>(values, length);
+            _pending_values = _values;
         }
 
         template<size_t array_size>
@@ -64,9 +107,13 @@ namespace Bn3Monkey
             static_assert(array_size >= MAX_ARRAY_SIZE);
             assert(_length <= MAX_ARRAY_SIZE);
 
-            _prev_values = Bn3StaticVector<Type, MAX_ARRAY_SIZE>(values);
-            _values = _prev_values;
+            _values = Bn3StaticVector<Type, MAX_ARRAY_SIZE>(values);
+            _pending_values = _values;
+        }
 
+        virtual ~AsyncPropertyArray()
+        {
+            releaseUndo(this);
         }
 
 
@@ -81,15 +128,30 @@ namespace Bn3Monkey
 
         const size_t length() noexcept { return _length; }
 
+        // Reads go ahead of queued updates, so they are not delayed by a storm of setAsync.
         bool get(Type* values, size_t start, size_t end)
         {
-            auto result = _scope.call(_name, AsyncPropertyArray::onPropertyObtained, this, values, start, end);
+            auto result = _scope.call(ScopedTaskPriority::HIGH, _name, AsyncPropertyArray::onPropertyObtained, this, values, start, end);
             auto ret = result.wait();
             if (!ret)
                 return false;
             return ret;
         }
 
+        // Shares a snapshot of the values instead of copying them. Returns an empty view if the range is not valid.
+        // A commit made while a view is held goes to a second snapshot, and only the range changed since it was last used is copied.
+        AsyncPropertyArrayView<Type> view(size_t start, size_t end)
+        {
+            if (end <= start || end > _length)
+                return AsyncPropertyArrayView<Type>();
+
+            auto result = _scope.call(ScopedTaskPriority::HIGH, _name, AsyncPropertyArray::onPropertyViewed, this, start, end);
+            auto ret = result.wait();
+            if (!ret)
+                return AsyncPropertyArrayView<Type>();
+            return *ret;
+        }
+
         inline bool set(const Type* values, size_t start, size_t end)
         {
             if (!isValid(values, start, end))
@@ -122,12 +184,75 @@ namespace Bn3Monkey
         }
 
 
+        // values are copied, so they don't have to outlive the call.
+        // Writes made before the queued update runs are merged into it, and it is notified once with the ranges they changed.
         void setAsync(const Type* values, size_t start, size_t end)
         {
             if (!isValid(values, start, end))
                 return;
 
-            _scope.run(_name, AsyncPropertyArray::onPropertyProcessed, this, values, start, end);
+            {
+                std::lock_guard<std::mutex> lock(_pending_mtx);
+                _pending_values.copyFrom(values, start, end);
+                for (size_t i = start; i < end; i++)
+                    _pending_written.set(i);
+                _pending_ranges.add(start, end);
+                if (_is_pending)
+                    return;
+                _is_pending = true;
+            }
+            if (!isAccepted(_scope.run(_name, AsyncPropertyArray::onPendingProcessed, this)))
+                clearPending();
+        }
+
+        // Bulk operations run as one task on the scope and notify listeners of [start, end) as set and notify do.
+        // They return false if the range is not valid or a listener rejects the change, which is then rolled back.
+
+        // op is AsyncPropertyScaleOffset, AsyncPropertyClamp or any callable taking and returning an element.
+        template<typename Op>
+        bool transform(size_t start, size_t end, const Op& op)
+        {
+            static_assert(std::is_arithmetic_v<Type>, "transform is for numeric arrays");
+            if (!isValid(nullptr, start, end))
+                return false;
+
+            auto result = _scope.call(_name, AsyncPropertyArray::onPropertyTransformed<Op>, this, &op, start, end);
+            auto ret = result.wait();
+            return ret && *ret;
+        }
+
+        bool fill(size_t start, size_t end, const Type& value)
+        {
+            if (!isValid(nullptr, start, end))
+                return false;
+
+            auto result = _scope.call(_name, AsyncPropertyArray::onPropertyFilled, this, &value, start, end);
+            auto ret = result.wait();
+            return ret && *ret;
+        }
+
+        // Min, max and sum of [start, end) in one pass. Reads go ahead of queued updates as get does.
+        bool reduce(size_t start, size_t end, AsyncPropertyReduction<Type>& reduction)
+        {
+            static_assert(std::is_arithmetic_v<Type>, "reduce is for numeric arrays");
+            if (end <= start || end > _length)
+                return false;
+
+            auto result = _scope.call(ScopedTaskPriority::HIGH, _name, AsyncPropertyArray::onPropertyReduced, this, &reduction, start, end);
+            auto ret = result.wait();
+            return ret && *ret;
+        }
+
+        // Sets values only if [start, end) still equals expected. Nothing is notified if it doesn't.
+        bool compareAndSet(const Type* expected, const Type* values, size_t start, size_t end)
+        {
+            static_assert(std::is_arithmetic_v<Type>, "compareAndSet is for numeric arrays");
+            if (!isValid(values, start, end))
+                return false;
+
+            auto result = _scope.call(_name, AsyncPropertyArray::onPropertyCompared, this, expected, values, start, end);
+            auto ret = result.wait();
+            return ret && *ret;
         }
 
         void registerOnPropertyNotified(const ScopedTaskScope& scope, std::function<bool(const Type*, size_t, size_t)> onPropertyNotified)
@@ -150,29 +275,173 @@ namespace Bn3Monkey
             _on_property_updateds.clear();
         }
 
-    private:
+        // Called once per commit with every range it changed, which is more than one when setAsync calls are merged.
+        // values points to the whole array.
+        void registerOnPropertyRangesNotified(const ScopedTaskScope& scope, std::function<bool(const Type*, const AsyncPropertyRange*, size_t)> onPropertyRangesNotified)
+        {
+            _on_property_ranges_notifieds.emplace_back(scope, onPropertyRangesNotified);
+        }
+
+        void clearOnPropertyRangesNotified()
+        {
+            _on_property_ranges_notifieds.clear();
+        }
+
+        void registerOnPropertyRangesUpdated(const ScopedTaskScope& scope, std::function<void(const Type*, const AsyncPropertyRange*, size_t, bool)> onPropertyRangesUpdated)
+        {
+            _on_property_ranges_updateds.emplace_back(scope, onPropertyRangesUpdated);
+        }
 
-        
+        void clearOnPropertyRangesUpdated()
+        {
+            _on_property_ranges_updateds.clear();
+        }
+
+    private:
+        using Snapshot = Bn3StaticVector<Type, MAX_ARRAY_SIZE>;
 
         static bool onPropertyObtained(AsyncPropertyArray* self, Type* values, size_t start, size_t end)
         {
             self->_values.copyTo(values, start, end);
             return true;
         }
+        // Only the overwritten slice is saved, so the cost follows the size of the change.
         static bool onPropertyCommitted(AsyncPropertyArray* self, const Type* values, size_t start, size_t end)
         {
-            self->_prev_values = self->_values;
+            if (!saveUndo(self, start, end))
+                return false;
+
             self->_values.copyFrom(values, start, end);
+            markDirty(self, start, end);
+            return true;
+        }
+        static bool saveUndo(AsyncPropertyArray* self, size_t start, size_t end)
+        {
+            static const Bn3Tag tag("property_array_undo");
+
+            releaseUndo(self);
+            auto* undo = Bn3MemoryPool::allocate<Type>(tag, end - start);
+            if (!undo)
+                return false;
+            self->_values.copyTo(undo, start, end);
+            self->_undo = { undo, start, end };
             return true;
         }
+        static void onPropertyRolledBack(AsyncPropertyArray* self)
+        {
+            auto& undo = self->_undo;
+            if (undo.values)
+            {
+                self->_values.copyFrom(undo.values, undo.start, undo.end);
+                markDirty(self, undo.start, undo.end);
+            }
+            releaseUndo(self);
+        }
+        static void releaseUndo(AsyncPropertyArray* self)
+        {
+            auto& undo = self->_undo;
+            if (!undo.values)
+                return;
+            Bn3MemoryPool::deallocate<Type>(undo.values, undo.end - undo.start);
+            undo = Undo();
+        }
+        static void markDirty(AsyncPropertyArray* self, size_t start, size_t end)
+        {
+            for (auto& snapshot : self->_snapshots)
+            {
+                if (snapshot.dirty_start == snapshot.dirty_end)
+                {
+                    snapshot.dirty_start = start;
+                    snapshot.dirty_end = end;
+                    continue;
+                }
+                snapshot.dirty_start = std::min(snapshot.dirty_start, start);
+                snapshot.dirty_end = std::max(snapshot.dirty_end, end);
+            }
+        }
+        // Brings a snapshot up to date with the values and makes it the current one. Returns nullptr if it cannot be allocated.
+        // A snapshot no view holds is updated in place, with only its dirty range. One is copied as a whole only if both are held.
+        static std::shared_ptr<Snapshot> takeSnapshot(AsyncPropertyArray* self)
+        {
+            static const Bn3Tag tag("property_array_snapshot");
+
+            auto& current = self->_snapshots[self->_current_snapshot];
+            if (current.values && current.dirty_start == current.dirty_end)
+                return current.values;
+
+            for (size_t i = 0; i < 2; i++)
+            {
+                size_t idx = (self->_current_snapshot + i) % 2;
+                auto& snapshot = self->_snapshots[idx];
+                if (!snapshot.values || snapshot.values.use_count() != 1)
+                    continue;
+                // The last view is released on another thread, and its reads must finish before the words are written.
+                std::atomic_thread_fence(std::memory_order_acquire);
+                if (snapshot.dirty_start != snapshot.dirty_end)
+                    snapshot.values->copyFrom(self->_values.begin() + snapshot.dirty_start, snapshot.dirty_start, snapshot.dirty_end);
+                snapshot.dirty_start = snapshot.dirty_end = 0;
+                self->_current_snapshot = idx;
+                return snapshot.values;
+            }
+
+            // The views of the replaced snapshot keep it alive.
+            size_t idx = current.values ? (self->_current_snapshot + 1) % 2 : self->_current_snapshot;
+            auto& snapshot = self->_snapshots[idx];
+            snapshot.values = MAKE_SHARED(Snapshot, tag, self->_values.begin(), self->_length);
+            if (!snapshot.values)
+                return nullptr;
+            snapshot.dirty_start = snapshot.dirty_end = 0;
+            self->_current_snapshot = idx;
+            return snapshot.values;
+        }
+        static AsyncPropertyArrayView<Type> viewOf(const std::shared_ptr<Snapshot>& snapshot, size_t start, size_t end)
+        {
+            return AsyncPropertyArrayView<Type>(std::shared_ptr<const Type>(snapshot, snapshot->begin() + start), end - start);
+        }
+        static AsyncPropertyArrayView<Type> onPropertyViewed(AsyncPropertyArray* self, size_t start, size_t end)
+        {
+            auto snapshot = takeSnapshot(self);
+            if (!snapshot)
+                return AsyncPropertyArrayView<Type>();
+            return viewOf(snapshot, start, end);
+        }
         static bool onPropertyNotified(AsyncPropertyArray* self, size_t start, size_t end)
         {
+            return onPropertyRangesNotified(self, AsyncPropertyRangeSet(start, end));
+        }
+        // Range listeners get every range, and the others get one call with the range which covers them.
+        static bool onPropertyRangesNotified(AsyncPropertyArray* self, const AsyncPropertyRangeSet& ranges)
+        {
+            if (self->_on_property_notifieds.size() == 0 && self->_on_property_ranges_notifieds.size() == 0)
+            {
+                releaseUndo(self);
+                return true;
+            }
+
             ScopedTaskResult<bool> results[8];
             size_t callback_length = 0;
 
+            auto bounds = ranges.bounds();
+            // Listeners read a snapshot, which later commits don't change.
+            auto snapshot = takeSnapshot(self);
+            if (!snapshot)
+            {
+                onPropertyRolledBack(self);
+                return false;
+            }
+            auto view = viewOf(snapshot, bounds.start, bounds.end);
+            auto whole_view = viewOf(snapshot, 0, self->_length);
+
+            static const Bn3Tag prefix("Notified_");
+            Bn3Tag name(prefix, self->_name);
             for (auto& on_property_notified : self->_on_property_notifieds)
             {
-                auto result = on_property_notified(Bn3Tag("Notified_", self->_name), self->_values.begin() + start, start, end);
+                auto result = on_property_notified(name, view, bounds.start, bounds.end);
+                results[callback_length++] = std::move(result);
+            }
+            for (auto& on_property_ranges_notified : self->_on_property_ranges_notifieds)
+            {
+                auto result = on_property_ranges_notified(name, whole_view, ranges);
                 results[callback_length++] = std::move(result);
             }
 
@@ -195,38 +464,173 @@ namespace Bn3Monkey
             if (success)
             {
                 // confirmed
+                releaseUndo(self);
             }
             else
             {
-                self->_prev_values = self->_values;
+                onPropertyRolledBack(self);
             }
             return success;
         }
         static void onPropertyUpdated(AsyncPropertyArray* self, size_t start, size_t end, bool success)
         {
+            onPropertyRangesUpdated(self, AsyncPropertyRangeSet(start, end), success);
+        }
+        static void onPropertyRangesUpdated(AsyncPropertyArray* self, const AsyncPropertyRangeSet& ranges, bool success)
+        {
+            if (self->_on_property_updateds.size() == 0 && self->_on_property_ranges_updateds.size() == 0)
+                return;
+
+            auto bounds = ranges.bounds();
+            auto snapshot = takeSnapshot(self);
+            if (!snapshot)
+            {
+                LOG_E("Cannot take a snapshot of %s", self->_name.str());
+                return;
+            }
+            auto view = viewOf(snapshot, bounds.start, bounds.end);
+            auto whole_view = viewOf(snapshot, 0, self->_length);
+
+            static const Bn3Tag prefix("Updated_");
+            Bn3Tag name(prefix, self->_name);
             for (auto& on_property_updated : self->_on_property_updateds)
             {
-                on_property_updated(Bn3Tag("Updated_", self->_name), self->_values.begin() + start, start, end, success);
+                on_property_updated(name, view, bounds.start, bounds.end, success);
             }
+            for (auto& on_property_ranges_updated : self->_on_property_ranges_updateds)
+            {
+                on_property_ranges_updated(name, whole_view, ranges, success);
+            }
+        }
+        // The values are changed in place, after the overwritten range is saved for the rollback.
+        template<typename Op>
+        static bool onPropertyTransformed(AsyncPropertyArray* self, const Op* op, size_t start, size_t end)
+        {
+            if (!saveUndo(self, start, end))
+                return false;
+            asyncPropertyTransform(self->_values.begin() + start, end - start, *op);
+            markDirty(self, start, end);
+            return onPropertyPublished(self, start, end);
+        }
+        static bool onPropertyFilled(AsyncPropertyArray* self, const Type* value, size_t start, size_t end)
+        {
+            if (!saveUndo(self, start, end))
+                return false;
+            asyncPropertyFill(self->_values.begin() + start, end - start, *value);
+            markDirty(self, start, end);
+            return onPropertyPublished(self, start, end);
+        }
+        static bool onPropertyReduced(AsyncPropertyArray* self, AsyncPropertyReduction<Type>* reduction, size_t start, size_t end)
+        {
+            // Unqualified, so that the SIMD overloads are picked for their types
+            const Type* values = self->_values.begin() + start;
+            *reduction = asyncPropertyReduce(values, end - start);
+            return true;
+        }
+        static bool onPropertyCompared(AsyncPropertyArray* self, const Type* expected, const Type* values, size_t start, size_t end)
+        {
+            const Type* current = self->_values.begin();
+            if (!std::equal(current + start, current + end, expected))
+                return false;
+            return onPropertyCommitted(self, values, start, end) && onPropertyPublished(self, start, end);
         }
-        static bool onPropertyProcessed(AsyncPropertyArray* self, const Type* values, size_t start, size_t end)
+        static bool onPropertyPublished(AsyncPropertyArray* self, size_t start, size_t end)
         {
-            onPropertyCommitted(self, values, start, end);
             bool ret = onPropertyNotified(self, start, end);
             onPropertyUpdated(self, start, end, ret);
             return ret;
         }
+        // The queued update is lost, so the next call queues another.
+        void clearPending()
+        {
+            std::lock_guard<std::mutex> lock(_pending_mtx);
+            _is_pending = false;
+        }
+        // Commits the values staged by setAsync as one change.
+        // Only the written indices are copied. The ranges may cover a few more once the set is full, and the staged values there are stale.
+        // The rollback saves the range which covers them, which is at most MAX_ARRAY_SIZE elements.
+        static bool onPendingProcessed(AsyncPropertyArray* self)
+        {
+            AsyncPropertyRangeSet ranges;
+            bool ret = true;
+            {
+                std::lock_guard<std::mutex> lock(self->_pending_mtx);
+                ranges = self->_pending_ranges;
+                self->_pending_ranges.clear();
+                // Calls from now on queue the next update.
+                self->_is_pending = false;
+
+                auto bounds = ranges.bounds();
+                ret = saveUndo(self, bounds.start, bounds.end);
+                if (ret)
+                {
+                    auto& written = self->_pending_written;
+                    for (auto& range : ranges)
+                    {
+                        size_t idx = range.start;
+                        while (idx < range.end)
+                        {
+                            if (!written[idx])
+                            {
+                                idx++;
+                                continue;
+                            }
+                            size_t run_end = idx + 1;
+                            while (run_end < range.end && written[run_end])
+                                run_end++;
+                            self->_values.copyFrom(self->_pending_values.begin() + idx, idx, run_end);
+                            idx = run_end;
+                        }
+                    }
+                    markDirty(self, bounds.start, bounds.end);
+                }
+                self->_pending_written.reset();
+            }
+
+            ret = ret && onPropertyRangesNotified(self, ranges);
+            onPropertyRangesUpdated(self, ranges, ret);
+            return ret;
+        }
 
         Bn3Tag _name;
         ScopedTaskScope _scope;
 
         Bn3StaticVector<OnPropertyArrayNotified<Type>, 4> _on_property_notifieds;
         Bn3StaticVector<OnPropertyArrayUpdated<Type>, 4> _on_property_updateds;
+        Bn3StaticVector<OnPropertyArrayRangesNotified<Type>, 4> _on_property_ranges_notifieds;
+        Bn3StaticVector<OnPropertyArrayRangesUpdated<Type>, 4> _on_property_ranges_updateds;
 
         size_t _length;
 
-        Bn3StaticVector<Type, MAX_ARRAY_SIZE> _prev_values;
+        // The slice overwritten by the last commit, in the memory pool, until it is confirmed or rolled back
+        struct Undo
+        {
+            Type* values{ nullptr };
+            size_t start{ 0 };
+            size_t end{ 0 };
+        };
+        Undo _undo;
         Bn3StaticVector<Type, MAX_ARRAY_SIZE> _values;
+
+        // Shared by views. Written only on the scope, and only while no view holds it.
+        struct SnapshotBuffer
+        {
+            std::shared_ptr<Snapshot> values;
+            // The range of _values changed since this snapshot was brought up to date
+            size_t dirty_start{ 0 };
+            size_t dirty_end{ 0 };
+        };
+        // Views of the current one are handed out, and the other is reused once its views are released.
+        SnapshotBuffer _snapshots[2];
+        size_t _current_snapshot{ 0 };
+
+        // Values written by setAsync and the ranges they cover, until the queued update commits them
+        std::mutex _pending_mtx;
+        bool _is_pending{ false };
+        Bn3StaticVector<Type, MAX_ARRAY_SIZE> _pending_values;
+        // The indices written by setAsync. _pending_values is stale everywhere else.
+        std::bitset<MAX_ARRAY_SIZE> _pending_written;
+        AsyncPropertyRangeSet _pending_ranges;
     };
 }
 
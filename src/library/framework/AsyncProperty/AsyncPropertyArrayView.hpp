@@ -0,0 +1,38 @@
+#ifndef __BN3MONKEY_ASYNC_PROPERTY_ARRAY_VIEW__
+#define __BN3MONKEY_ASYNC_PROPERTY_ARRAY_VIEW__
+
+#include <memory>
+#include <cstddef>
+
+namespace Bn3Monkey
+{
+    // Read-only range of a snapshot of AsyncPropertyArray.
+    // The snapshot is never changed while a view holds it, so the view can be read on any thread and kept after commits.
+    template<typename Type>
+    class AsyncPropertyArrayView
+    {
+    public:
+        using value_type = Type;
+        using const_iterator = const Type*;
+
+        AsyncPropertyArrayView() {}
+        // data shares the ownership of the snapshot it points into.
+        AsyncPropertyArrayView(std::shared_ptr<const Type> data, size_t length) : _data(std::move(data)), _length(length) {}
+
+        // False if the view could not be taken
+        explicit operator bool() const { return static_cast<bool>(_data); }
+
+        const Type* data() const { return _data.get(); }
+        size_t size() const { return _length; }
+
+        const Type& operator[](size_t idx) const { return _data.get()[idx]; }
+        const_iterator begin() const { return _data.get(); }
+        const_iterator end() const { return _data.get() + _length; }
+
+    private:
+        std::shared_ptr<const Type> _data;
+        size_t _length{ 0 };
+    };
+}
+
+#endif // __BN3MONKEY_ASYNC_PROPERTY_ARRAY_VIEW__
@@ -52,33 +52,63 @@ size_t getAsyncPropertyArraySize(size_t length, const std::string& type)
 	return getAsyncPropertyArraySizeImplRecursive<2>(length, type);
 }
 
+size_t getAsyncPropertyVectorSize(const std::string& type)
+{
+	size_t type_size{ 0 };
+	if (type == "bool")
+		type_size = sizeof(Bn3Monkey::AsyncPropertyVector<bool>);
+	else if (type == "int8_t")
+		type_size = sizeof(Bn3Monkey::AsyncPropertyVector<int8_t>);
+	else if (type == "int16_t")
+		type_size = sizeof(Bn3Monkey::AsyncPropertyVector<int16_t>);
+	else if (type == "int32_t")
+		type_size = sizeof(Bn3Monkey::AsyncPropertyVector<int32_t>);
+	else if (type == "int64_t")
+		type_size = sizeof(Bn3Monkey::AsyncPropertyVector<int64_t>);
+	else if (type == "uint8_t")
+		type_size = sizeof(Bn3Monkey::AsyncPropertyVector<uint8_t>);
+	else if (type == "uint16_t")
+		type_size = sizeof(Bn3Monkey::AsyncPropertyVector<uint16_t>);
+	else if (type == "uint32_t")
+		type_size = sizeof(Bn3Monkey::AsyncPropertyVector<uint32_t>);
+	else if (type == "uint64_t")
+		type_size = sizeof(Bn3Monkey::AsyncPropertyVector<uint64_t>);
+	else if (type == "float")
+		type_size = sizeof(Bn3Monkey::AsyncPropertyVector<float>);
+	else if (type == "double")
+		type_size = sizeof(Bn3Monkey::AsyncPropertyVector<double>);
+	else if (type == "std::string")
+		type_size = sizeof(Bn3Monkey::AsyncPropertyVector<Bn3Monkey::Bn3StaticString>);
+	return type_size;
+}
+
 size_t getAsyncPropertySize(const std::string& type)
 {
 	size_t type_size{ 0 };
 	if (type == "bool")
-		type_size = sizeof(Bn3Monkey::AsyncProperty<bool>);
+		type_size = sizeof(Bn3Monkey::AsyncPropertyContainer::Property<bool>);
 	else if (type == "int8_t")
-		type_size = sizeof(Bn3Monkey::AsyncProperty<int8_t>);
+		type_size = sizeof(Bn3Monkey::AsyncPropertyContainer::Property<int8_t>);
 	else if (type == "int16_t")
-		type_size = sizeof(Bn3Monkey::AsyncProperty<int16_t>);
+		type_size = sizeof(Bn3Monkey::AsyncPropertyContainer::Property<int16_t>);
 	else if (type == "int32_t")
-		type_size = sizeof(Bn3Monkey::AsyncProperty<int32_t>);
+		type_size = sizeof(Bn3Monkey::AsyncPropertyContainer::Property<int32_t>);
 	else if (type == "int64_t")
-		type_size = sizeof(Bn3Monkey::AsyncProperty<int64_t>);
+		type_size = sizeof(Bn3Monkey::AsyncPropertyContainer::Property<int64_t>);
 	else if (type == "uint8_t")
-		type_size = sizeof(Bn3Monkey::AsyncProperty<uint8_t>);
+		type_size = sizeof(Bn3Monkey::AsyncPropertyContainer::Property<uint8_t>);
 	else if (type == "uint16_t")
-		type_size = sizeof(Bn3Monkey::AsyncProperty<uint16_t>);
+		type_size = sizeof(Bn3Monkey::AsyncPropertyContainer::Property<uint16_t>);
 	else if (type == "uint32_t")
-		type_size = sizeof(Bn3Monkey::AsyncProperty<uint32_t>);
+		type_size = sizeof(Bn3Monkey::AsyncPropertyContainer::Property<uint32_t>);
 	else if (type == "uint64_t")
-		type_size = sizeof(Bn3Monkey::AsyncProperty<uint64_t>);
+		type_size = sizeof(Bn3Monkey::AsyncPropertyContainer::Property<uint64_t>);
 	else if (type == "float")
-		type_size = sizeof(Bn3Monkey::AsyncProperty<float>);
+		type_size = sizeof(Bn3Monkey::AsyncPropertyContainer::Property<float>);
 	else if (type == "double")
-		type_size = sizeof(Bn3Monkey::AsyncProperty<double>);
+		type_size = sizeof(Bn3Monkey::AsyncPropertyContainer::Property<double>);
 	else if (type == "std::string")
-		type_size = sizeof(Bn3Monkey::AsyncProperty<Bn3Monkey::Bn3StaticString>);
+		type_size = sizeof(Bn3Monkey::AsyncPropertyContainer::Property<Bn3Monkey::Bn3StaticString>);
 	return type_size;
 }
 
@@ -115,6 +145,10 @@ static size_t getPropertiesSize(const nlohmann::json& content)
 			{
 				node_size = getAsyncPropertySize(type);
 			}
+			else if (length > Bn3Monkey::ASYNC_PROPERTY_ARRAY_MAX_LENGTH)
+			{
+				node_size = getAsyncPropertyVectorSize(type);
+			}
 			else {
 				node_size = getAsyncPropertyArraySize(length, type);
 			}
@@ -139,9 +173,9 @@ static Bn3Monkey::AsyncPropertyExtendedNode allocateProperty(char* ptr, const st
 {
 	Bn3Monkey::AsyncPropertyExtendedNode ret;
 	T default_value{ value[0].get<T>()};
-	auto* node_t =  new(ptr) Bn3Monkey::AsyncProperty<T>(Bn3Monkey::Bn3Tag(name.c_str()), scope, default_value);
+	auto* node_t =  new(ptr) Bn3Monkey::AsyncPropertyContainer::Property<T>(Bn3Monkey::Bn3Tag(name.c_str()), scope, default_value);
 	ret.node = reinterpret_cast<Bn3Monkey::AsyncPropertyNode*>(node_t);
-	ret.size =  sizeof(Bn3Monkey::AsyncProperty<T>);
+	ret.size =  sizeof(Bn3Monkey::AsyncPropertyContainer::Property<T>);
 	return ret;
 }
 
@@ -150,9 +184,9 @@ static Bn3Monkey::AsyncPropertyExtendedNode allocateProperty<Bn3Monkey::Bn3Stati
 {
 	Bn3Monkey::AsyncPropertyExtendedNode ret;
 	Bn3Monkey::Bn3StaticString default_value{ value[0].get_ref<const std::string&>().c_str()};
-	auto* node_t = new(ptr) Bn3Monkey::AsyncProperty<Bn3Monkey::Bn3StaticString>(Bn3Monkey::Bn3Tag(name.c_str()), scope, default_value);
+	auto* node_t = new(ptr) Bn3Monkey::AsyncPropertyContainer::Property<Bn3Monkey::Bn3StaticString>(Bn3Monkey::Bn3Tag(name.c_str()), scope, default_value);
 	ret.node = reinterpret_cast<Bn3Monkey::AsyncPropertyNode*>(node_t);
-	ret.size = sizeof(Bn3Monkey::AsyncProperty<Bn3Monkey::Bn3StaticString>);
+	ret.size = sizeof(Bn3Monkey::AsyncPropertyContainer::Property<Bn3Monkey::Bn3StaticString>);
 	return ret;
 }
 
@@ -307,10 +341,112 @@ static Bn3Monkey::AsyncPropertyExtendedNode allocatePropertyArray(char* ptr, con
 	return ret;
 }
 
+template<typename T>
+static T getPropertyValue(const nlohmann::json& value)
+{
+	return value.get<T>();
+}
+
+template<>
+Bn3Monkey::Bn3StaticString getPropertyValue<Bn3Monkey::Bn3StaticString>(const nlohmann::json& value)
+{
+	return Bn3Monkey::Bn3StaticString(value.get_ref<const std::string&>());
+}
+
+template<typename T>
+static Bn3Monkey::AsyncPropertyExtendedNode allocatePropertyVector(char* ptr, const std::string& name, Bn3Monkey::ScopedTaskScope& scope, size_t length, const nlohmann::json& values)
+{
+	Bn3Monkey::AsyncPropertyExtendedNode ret;
+
+	// The initial values are staged in the memory pool, not on the stack.
+	static const Bn3Monkey::Bn3Tag tag("property_vector_values");
+	T* temp_values = Bn3Monkey::Bn3MemoryPool::allocate<T>(tag, length);
+	if (!temp_values)
+		return ret;
+	size_t i = 0;
+	for (auto& value : values)
+	{
+		if (i == length)
+			break;
+		new (temp_values + i++) T(getPropertyValue<T>(value));
+	}
+	for (; i < length; i++)
+		new (temp_values + i) T();
+
+	auto* node_t = new(ptr) Bn3Monkey::AsyncPropertyVector<T>(Bn3Monkey::Bn3Tag(name.c_str()), scope, temp_values, length);
+	Bn3Monkey::Bn3MemoryPool::deallocate<T>(temp_values, length);
+
+	ret.node = node_t;
+	ret.size = sizeof(Bn3Monkey::AsyncPropertyVector<T>);
+	return ret;
+}
+
+Bn3Monkey::AsyncPropertyExtendedNode Bn3Monkey::AsyncPropertyContainer::getAsyncPropertyVector(char* ptr, const std::string& type, const std::string& name, size_t length, const nlohmann::json& values)
+{
+	Bn3Monkey::AsyncPropertyExtendedNode node;
+
+	if (type == "bool")
+	{
+		node = allocatePropertyVector<bool>(ptr, name, _scope, length, values);
+	}
+	else if (type == "int8_t")
+	{
+		node = allocatePropertyVector<int8_t>(ptr, name, _scope, length, values);
+	}
+	else if (type == "int16_t")
+	{
+		node = allocatePropertyVector<int16_t>(ptr, name, _scope, length, values);
+	}
+	else if (type == "int32_t")
+	{
+		node = allocatePropertyVector<int32_t>(ptr, name, _scope, length, values);
+	}
+	else if (type == "int64_t")
+	{
+		node = allocatePropertyVector<int64_t>(ptr, name, _scope, length, values);
+	}
+	else if (type == "uint8_t")
+	{
+		node = allocatePropertyVector<uint8_t>(ptr, name, _scope, length, values);
+	}
+	else if (type == "uint16_t")
+	{
+		node = allocatePropertyVector<uint16_t>(ptr, name, _scope, length, values);
+	}
+	else if (type == "uint32_t")
+	{
+		node = allocatePropertyVector<uint32_t>(ptr, name, _scope, length, values);
+	}
+	else if (type == "uint64_t")
+	{
+		node = allocatePropertyVector<uint64_t>(ptr, name, _scope, length, values);
+	}
+	else if (type == "float")
+	{
+		node = allocatePropertyVector<float>(ptr, name, _scope, length, values);
+	}
+	else if (type == "double")
+	{
+		node = allocatePropertyVector<double>(ptr, name, _scope, length, values);
+	}
+	else if (type == "std::string")
+	{
+		node = allocatePropertyVector<Bn3Monkey::Bn3StaticString>(ptr, name, _scope, length, values);
+	}
+
+	return node;
+}
+
 Bn3Monkey::AsyncPropertyExtendedNode Bn3Monkey::AsyncPropertyContainer::getAsyncPropertyArray(char* ptr, const std::string& type, const std::string& name, size_t length, const nlohmann::json& values)
 {
 	Bn3Monkey::AsyncPropertyExtendedNode node;
 
+	// The fixed arrays stop at ASYNC_PROPERTY_ARRAY_MAX_LENGTH, so longer ones are stored in chunks.
+	if (length > ASYNC_PROPERTY_ARRAY_MAX_LENGTH)
+	{
+		return getAsyncPropertyVector(ptr, type, name, length, values);
+	}
+
 	if (type == "bool")
 	{
 		node = allocatePropertyArray<bool>(ptr, name, _scope, length, values);
@@ -431,6 +567,7 @@ bool Bn3Monkey::AsyncPropertyContainer::create(const char* content)
 	size_t content_length = getPropertiesSize(json_content);
 
 	_container = Bn3Monkey::Bn3MemoryPool::allocate<char>(_name, content_length);
+	_container_length = content_length;
 
 	char* ptr = _container;
 	auto childs_iter = json_content.find("childs");
@@ -3,10 +3,15 @@
 
 #include "AsyncPropertyImpl.hpp"
 #include "AsyncPropertyArray.hpp"
+#include "AsyncPropertyVector.hpp"
+#include "AsyncPropertyTransaction.hpp"
 #include "json.hpp"
 
 namespace Bn3Monkey
 {
+	// Arrays longer than this are created as AsyncPropertyVector.
+	constexpr size_t ASYNC_PROPERTY_ARRAY_MAX_LENGTH = 512;
+
 	struct PropertyPath
 	{
 		PropertyPath(const char* value)
@@ -72,21 +77,25 @@ namespace Bn3Monkey
 	class AsyncPropertyContainer
 	{
 	public:
+		// Every property the container creates holds this many listeners of each kind, and refuses more.
+		static constexpr size_t LISTENER_COUNT = ASYNC_PROPERTY_LISTENER_COUNT;
+		template<class Type>
+		using Property = AsyncProperty<Type, LISTENER_COUNT>;
+
 		AsyncPropertyContainer(const Bn3Tag& container_name, const ScopedTaskScope& scope) : _name(container_name), _scope(scope) {
 			_nodes = Bn3Map(PropertyPath, AsyncPropertyNode*) { Bn3MapAllocator(PropertyPath, AsyncPropertyNode*, container_name) };
 		}
 		virtual ~AsyncPropertyContainer() {
-			if (_container)
-				delete _container;
+			clear();
 		}
 
 		bool create(const char* content);
 
 		template<class Type>
-		AsyncProperty<Type>* find(const char* path) { 
+		Property<Type>* find(const char* path) { 
 			auto key = PropertyPath(path);
 			auto* value = _nodes.at(key);
-			auto* ret = reinterpret_cast<AsyncProperty<Type>*>(value);
+			auto* ret = reinterpret_cast<Property<Type>*>(value);
 			return ret;
 		}
 
@@ -98,11 +107,27 @@ namespace Bn3Monkey
 			auto* ret = reinterpret_cast<AsyncPropertyArray<Type, MAX_ARRAY_SIZE>*>(value);
 			return ret;
 		}
+
+		// Arrays longer than ASYNC_PROPERTY_ARRAY_MAX_LENGTH
+		template<class Type>
+		AsyncPropertyVector<Type>* findVector(const char* path)
+		{
+			auto key = PropertyPath(path);
+			auto* value = _nodes.at(key);
+			auto* ret = reinterpret_cast<AsyncPropertyVector<Type>*>(value);
+			return ret;
+		}
+		// Stages values of several properties, so that they are applied together by AsyncPropertyTransaction::commit.
+		AsyncPropertyTransaction beginTransaction() { return AsyncPropertyTransaction(*this); }
+
 		void clear() { 
+			destroyNodes();
 			if (_container)
 			{
-				delete[] _container;
+				// Nodes are placed in a buffer from the memory pool.
+				Bn3MemoryPool::deallocate<char>(_container, _container_length);
 				_container = nullptr;
+				_container_length = 0;
 			}
 			_nodes.clear();
 
@@ -116,16 +141,57 @@ namespace Bn3Monkey
 		virtual void subscribe(AsyncPropertyContainer* other) {}
 
 	private:
+		friend class AsyncPropertyTransaction;
+
+		// Returns nullptr if path doesn't exist.
+		AsyncPropertyNode* findNode(const char* path)
+		{
+			auto iter = _nodes.find(PropertyPath(path));
+			if (iter == _nodes.end())
+				return nullptr;
+			return iter->second;
+		}
+
 		Bn3Monkey::AsyncPropertyExtendedNode getAsyncProperty(char* ptr, const std::string& type, const std::string& name, const nlohmann::json& value);
 		Bn3Monkey::AsyncPropertyExtendedNode getAsyncPropertyArray(char* ptr, const std::string& type, const std::string& name, size_t length, const nlohmann::json& values);
+		Bn3Monkey::AsyncPropertyExtendedNode getAsyncPropertyVector(char* ptr, const std::string& type, const std::string& name, size_t length, const nlohmann::json& values);
+		// Vectors hold storage outside of the container.
+		void destroyNodes()
+		{
+			for (auto& node : _nodes)
+			{
+				if (node.second)
+					node.second->~AsyncPropertyNode();
+			}
+		}
 		char* assignProperties(char* ptr, const Bn3Monkey::PropertyPath& path, const nlohmann::json& content);
 
 		Bn3Tag _name;
 
 		Bn3Map(PropertyPath, AsyncPropertyNode*) _nodes;
 		ScopedTaskScope _scope;
-		char* _container;
+		char* _container{ nullptr };
+		size_t _container_length{ 0 };
 	};
+
+	template<class Type>
+	bool AsyncPropertyTransaction::set(const char* path, const std::common_type_t<Type>& value)
+	{
+		auto* node = _container.findNode(path);
+		if (!node)
+		{
+			LOG_E("Property (%s) is not found", path);
+			return false;
+		}
+		// Arrays, vectors and properties of another type are refused.
+		auto* property = dynamic_cast<AsyncPropertyContainer::Property<Type>*>(node);
+		if (!property)
+		{
+			LOG_E("Property (%s) is not of the staged type", path);
+			return false;
+		}
+		return stage(property, value);
+	}
 }
 
 #endif
\ No newline at end of file
@@ -6,11 +6,15 @@
 #include "../StaticString/StaticString.hpp"
 #include "../ScopedTask/ScopedTask.hpp"
 #include "AsyncPropertyNode.hpp"
+#include "AsyncPropertySeqlock.hpp"
 
 
 #include <functional>
 #include <initializer_list>
 #include <type_traits>
+#include <mutex>
+#include <atomic>
+#include <chrono>
 
 namespace Bn3Monkey
 {
@@ -19,8 +23,11 @@ namespace Bn3Monkey
     public:        
         OnPropertyNotified(const ScopedTaskScope& scope, std::function<bool(const Type&)> function) : scope(scope), function(function) {
         }
-        ScopedTaskResult<bool> operator()(const Bn3Tag& name, const Type& value) {
-            return scope.call(name, function, value);
+        bool operator()(const Type& value) {
+            return function(value);
+        }
+        ScopedTaskScope& getScope() {
+            return scope;
         }
 
     private:
@@ -43,17 +50,79 @@ namespace Bn3Monkey
         std::function<void(const Type&, bool)> function;
     };
 
-    
-        
+    // Listeners of each kind a property holds by default, and every property created by AsyncPropertyContainer.
+    // Set BN3MONKEY_ASYNC_PROPERTY_LISTENER_COUNT to change it.
+#ifdef BN3MONKEY_ASYNC_PROPERTY_LISTENER_COUNT
+    constexpr size_t ASYNC_PROPERTY_LISTENER_COUNT = BN3MONKEY_ASYNC_PROPERTY_LISTENER_COUNT;
+#else
+    constexpr size_t ASYNC_PROPERTY_LISTENER_COUNT = 4;
+#endif
+
+    // Shared by the listener tasks of one notification.
+    // Once it is set, tasks skip the listeners they have not run yet.
+    using AsyncPropertyRejection = std::shared_ptr<std::atomic<bool>>;
+
+    inline AsyncPropertyRejection makePropertyRejection()
+    {
+        static const Bn3Tag tag("property_rejection");
+        return MAKE_SHARED(std::atomic<bool>, tag, false);
+    }
+
+    // Waits for the results of notified listeners. Returns false if any of them rejects or is cancelled.
+    // Returns at the first failure without waiting for the rest, which are skipped by the rejection.
+    inline bool waitPropertyNotified(ScopedTaskResult<bool>* results, size_t length, const AsyncPropertyRejection& rejection)
+    {
+        for (size_t i = 0; i < length; i++)
+        {
+            bool* ret = results[i].wait();
+            if (!ret || !(*ret))
+            {
+                rejection->store(true, std::memory_order_release);
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // How AsyncProperty::setAsync handles a burst of updates
+    enum class AsyncPropertyCoalescePolicy
+    {
+        // Every call runs its own commit, notify and update.
+        NONE,
+        // Calls made before the queued update runs collapse into it, and it applies the latest value.
+        LATEST_WINS,
+        // As LATEST_WINS, and updates start at most once per interval. The latest value is always applied.
+        RATE_LIMITED,
+        // Only every nth call is applied, as LATEST_WINS. The others are dropped.
+        EVERY_NTH,
+    };
+
+    struct AsyncPropertyCoalesceOption
+    {
+        AsyncPropertyCoalescePolicy policy{ AsyncPropertyCoalescePolicy::NONE };
+        std::chrono::microseconds interval{ 0 };
+        size_t nth{ 1 };
+    };
 
-    template <typename Type>
+    // Where AsyncProperty::get reads the value
+    enum class AsyncPropertyReadMode
+    {
+        // On the scope of the property, in order with the updates queued there.
+        SCOPED,
+        // From the last committed value, which is published to every thread. Doesn't wait for the scope.
+        SNAPSHOT,
+    };
+
+    // LISTENER_COUNT bounds the listeners of each kind. Properties created by AsyncPropertyContainer use the default, see AsyncPropertyContainer::Property.
+    template <typename Type, size_t LISTENER_COUNT = ASYNC_PROPERTY_LISTENER_COUNT>
     class AsyncProperty : public AsyncPropertyNode
     {
     public:
         static_assert(std::is_arithmetic_v<Type> || std::is_enum_v<Type> || std::is_same_v<Type, Bn3StaticString>);
+        static_assert(LISTENER_COUNT > 0);
         using value_type = Type;
 
-        AsyncProperty(const Bn3Tag& name, const ScopedTaskScope& scope, const value_type& default_value) : _name(name), _scope(scope), _value(default_value), _prev_value(default_value)
+        AsyncProperty(const Bn3Tag& name, const ScopedTaskScope& scope, const value_type& default_value) : _name(name), _scope(scope), _value(default_value), _prev_value(default_value), _snapshot(default_value)
         {
         }
 
@@ -62,9 +131,13 @@ namespace Bn3Monkey
             return true;
         }
 
+        // Reads go ahead of queued updates, so they are not delayed by a storm of setAsync.
         value_type get()
         {
-            auto result = _scope.call(_name, AsyncProperty<value_type>::onPropertyObtained, this);
+            if (AsyncPropertyReadMode::SNAPSHOT == _read_mode)
+                return _snapshot.load();
+
+            auto result = _scope.call(ScopedTaskPriority::HIGH, _name, AsyncProperty::onPropertyObtained, this);
             auto ret = result.wait();
             if (!ret)
                 return _value;
@@ -76,7 +149,7 @@ namespace Bn3Monkey
             if (!isValid(value))
                 return false;
 
-            auto result = _scope.call(_name, AsyncProperty<value_type>::onPropertyCommitted, this, value);
+            auto result = _scope.call(_name, AsyncProperty::onPropertyCommitted, this, value);
             auto ret = result.wait();
             if (!ret)
                 return false;
@@ -87,7 +160,7 @@ namespace Bn3Monkey
 
         bool notify()
         {
-            auto result = _scope.call(_name, AsyncProperty<value_type>::onPropertyNotified, this);
+            auto result = _scope.call(_name, AsyncProperty::onPropertyNotified, this);
             auto ret = result.wait();
             if (!ret)
                 return false;
@@ -98,7 +171,7 @@ namespace Bn3Monkey
 
         void update(bool success)
         {
-            _scope.run(_name, AsyncProperty<value_type>::onPropertyUpdated, this, success);
+            _scope.run(_name, AsyncProperty::onPropertyUpdated, this, success);
         }
 
         void setAsync(const Type& value)
@@ -106,13 +179,76 @@ namespace Bn3Monkey
             if (!isValid(value))
                 return;
 
-            _scope.run(_name, AsyncProperty<value_type>::onPropertyProcessed, this, value);
+            switch (_coalesce_option.policy)
+            {
+            case AsyncPropertyCoalescePolicy::NONE:
+                _scope.run(_name, AsyncProperty::onPropertyProcessed, this, value);
+                return;
+            case AsyncPropertyCoalescePolicy::EVERY_NTH:
+                if (++_coalesce_count % _coalesce_option.nth != 0)
+                    return;
+                break;
+            default:
+                break;
+            }
+
+            {
+                std::lock_guard<std::mutex> lock(_pending_mtx);
+                _pending_value = value;
+                // A rate-limited update whose timer has been cancelled never runs, so it is queued again.
+                if (_is_pending && !_pending_timer.isCancelled())
+                    return;
+                _is_pending = true;
+                _pending_timer = ScopedTaskTimer();
+            }
+
+            if (AsyncPropertyCoalescePolicy::RATE_LIMITED == _coalesce_option.policy)
+            {
+                auto launch_time = _last_processed_time.load(std::memory_order_relaxed) + _coalesce_option.interval;
+                if (launch_time > std::chrono::steady_clock::now())
+                {
+                    auto timer = _scope.runAt(launch_time, _name, AsyncProperty::onPendingProcessed, this);
+                    if (!timer)
+                    {
+                        clearPending();
+                        return;
+                    }
+                    std::lock_guard<std::mutex> lock(_pending_mtx);
+                    _pending_timer = std::move(timer);
+                    return;
+                }
+            }
+            if (!isAccepted(_scope.run(_name, AsyncProperty::onPendingProcessed, this)))
+                clearPending();
+        }
+
+        // Not thread-safe. Set it before get is called from other threads.
+        void setReadMode(AsyncPropertyReadMode mode)
+        {
+            _read_mode = mode;
+        }
+
+        // Not thread-safe. Set it before setAsync is called from other threads.
+        void setCoalescing(const AsyncPropertyCoalesceOption& option)
+        {
+            _coalesce_option = option;
+            if (_coalesce_option.nth == 0)
+                _coalesce_option.nth = 1;
+            _coalesce_count = 0;
         }
                         
 
-        void registerOnPropertyNotified(const ScopedTaskScope& scope, std::function<bool(const value_type&)> onPropertyNotified)
+        // Returns false if LISTENER_COUNT listeners are registered already.
+        // Listeners on the same scope are notified in one task, in the order they are registered.
+        bool registerOnPropertyNotified(const ScopedTaskScope& scope, std::function<bool(const value_type&)> onPropertyNotified)
         {
+            if (_on_property_notifieds.size() == LISTENER_COUNT)
+            {
+                LOG_E("Property cannot have more than %zu notified listeners", LISTENER_COUNT);
+                return false;
+            }
             _on_property_notifieds.emplace_back(scope, onPropertyNotified);
+            return true;
         }
 
         void clearOnPropertyNotified()
@@ -120,9 +256,16 @@ namespace Bn3Monkey
             _on_property_notifieds.clear();
         }
 
-        void registerOnPropertyUpdated(const ScopedTaskScope& scope, std::function<void(const value_type&, bool)> onPropertyUpdated)
+        // Returns false if LISTENER_COUNT listeners are registered already.
+        bool registerOnPropertyUpdated(const ScopedTaskScope& scope, std::function<void(const value_type&, bool)> onPropertyUpdated)
         {
+            if (_on_property_updateds.size() == LISTENER_COUNT)
+            {
+                LOG_E("Property cannot have more than %zu updated listeners", LISTENER_COUNT);
+                return false;
+            }
             _on_property_updateds.emplace_back(scope, onPropertyUpdated);
+            return true;
         }
 
         void clearOnPropertyUpdated()
@@ -131,78 +274,142 @@ namespace Bn3Monkey
         }
 
     private:
-        static value_type onPropertyObtained(AsyncProperty<value_type>* self)
+        friend class AsyncPropertyTransaction;
+
+        static value_type onPropertyObtained(AsyncProperty* self)
         {
             return self->_value;
         }
-        static bool onPropertyCommitted(AsyncProperty<value_type>* self, const value_type& value)
+        static bool onPropertyCommitted(AsyncProperty* self, const value_type& value)
         {
             self->_prev_value = self->_value;
             self->_value = value;
+            self->_snapshot.store(self->_value);
             return true;
         }
-        static bool onPropertyNotified(AsyncProperty<value_type>* self)
+        // Sends the value to every listener without waiting, one task for each scope.
+        // Returns the number of results written, at most LISTENER_COUNT.
+        static size_t onPropertyNotifying(AsyncProperty* self, ScopedTaskResult<bool>* results, const AsyncPropertyRejection& rejection)
         {
-            ScopedTaskResult<bool> results[8];
-            
-            size_t length = 0;
+            static const Bn3Tag prefix("Notified_");
+            Bn3Tag name(prefix, self->_name);
 
-            for (auto& on_property_notified : self->_on_property_notifieds)
+            auto& listeners = self->_on_property_notifieds;
+            bool is_batched[LISTENER_COUNT]{};
+            size_t length = 0;
+            for (size_t first = 0; first < listeners.size(); first++)
             {
-                auto result = on_property_notified(Bn3Tag("Notified_", self->_name), self->_value);
-                results[length++] = std::move(result);
+                if (is_batched[first])
+                    continue;
+                auto& scope = listeners[first].getScope();
+                for (size_t i = first; i < listeners.size(); i++)
+                    is_batched[i] = is_batched[i] || listeners[i].getScope() == scope;
+
+                results[length++] = scope.call(name, AsyncProperty::onListenersNotified, self, first, self->_value, rejection);
             }
-            
-            bool success = true;
-            for (size_t i = 0; i < length; i++)
+            return length;
+        }
+        // Runs the listeners on the scope of the first one. A skipped listener counts as a rejection.
+        static bool onListenersNotified(AsyncProperty* self, size_t first, const value_type& value, const AsyncPropertyRejection& rejection)
+        {
+            // The notifier may have returned already, so the property is not touched.
+            if (rejection->load(std::memory_order_acquire))
+                return false;
+
+            auto& listeners = self->_on_property_notifieds;
+            for (size_t i = first; i < listeners.size(); i++)
             {
-                bool* ret = results[i].wait();
-                if (!ret)
+                if (i != first && rejection->load(std::memory_order_acquire))
+                    return false;
+                if (listeners[i].getScope() != listeners[first].getScope())
+                    continue;
+                if (!listeners[i](value))
                 {
-                    success = false;
-                    break;
-                }
-                if (!(*ret))
-                {
-                    success = false;
-                    break;
+                    rejection->store(true, std::memory_order_release);
+                    return false;
                 }
             }
+            return true;
+        }
+        static void onPropertyRolledBack(AsyncProperty* self)
+        {
+            self->_value = self->_prev_value;
+            self->_snapshot.store(self->_value);
+        }
+        static bool onPropertyNotified(AsyncProperty* self)
+        {
+            ScopedTaskResult<bool> results[LISTENER_COUNT];
+            auto rejection = makePropertyRejection();
+            size_t length = onPropertyNotifying(self, results, rejection);
 
+            bool success = waitPropertyNotified(results, length, rejection);
             if (success)
             {
                 // confirmed
             }
             else
             {
-                self->_value = self->_prev_value;
+                onPropertyRolledBack(self);
             }
             return success;
         }
-        static void onPropertyUpdated(AsyncProperty<value_type>* self, bool success)
+        static void onPropertyUpdated(AsyncProperty* self, bool success)
         {
+            static const Bn3Tag prefix("Updated_");
+            Bn3Tag name(prefix, self->_name);
             for (auto& on_property_updated : self->_on_property_updateds)
             {
-                on_property_updated(Bn3Tag("Updated_", self->_name), self->_value, success);
+                on_property_updated(name, self->_value, success);
             }
         }
-        static bool onPropertyProcessed(AsyncProperty<value_type>* self, const value_type& value)
+        static bool onPropertyProcessed(AsyncProperty* self, const value_type& value)
         {
             onPropertyCommitted(self, value);
             bool ret = onPropertyNotified(self);
             onPropertyUpdated(self, ret);
             return ret;
         }
+        // The queued update is lost, so the next call queues another.
+        void clearPending()
+        {
+            std::lock_guard<std::mutex> lock(_pending_mtx);
+            _is_pending = false;
+        }
+        static bool onPendingProcessed(AsyncProperty* self)
+        {
+            value_type value;
+            {
+                std::lock_guard<std::mutex> lock(self->_pending_mtx);
+                value = self->_pending_value;
+                // Calls from now on queue the next update.
+                self->_is_pending = false;
+            }
+            self->_last_processed_time.store(std::chrono::steady_clock::now(), std::memory_order_relaxed);
+            return onPropertyProcessed(self, value);
+        }
 
 
         Bn3Tag _name;
         ScopedTaskScope _scope;
        
-        Bn3StaticVector<OnPropertyNotified<value_type>, 4> _on_property_notifieds;
-        Bn3StaticVector<OnPropertyUpdated<value_type>, 4> _on_property_updateds;
+        Bn3StaticVector<OnPropertyNotified<value_type>, LISTENER_COUNT> _on_property_notifieds;
+        Bn3StaticVector<OnPropertyUpdated<value_type>, LISTENER_COUNT> _on_property_updateds;
 
         value_type _prev_value;
         value_type _value;
+
+        AsyncPropertyReadMode _read_mode{ AsyncPropertyReadMode::SCOPED };
+        // Written only on the scope
+        AsyncPropertySeqlock<value_type> _snapshot;
+
+        AsyncPropertyCoalesceOption _coalesce_option;
+        std::atomic<size_t> _coalesce_count{ 0 };
+        std::mutex _pending_mtx;
+        bool _is_pending{ false };
+        value_type _pending_value;
+        // The timer of the queued rate-limited update
+        ScopedTaskTimer _pending_timer;
+        std::atomic<std::chrono::steady_clock::time_point> _last_processed_time{ std::chrono::steady_clock::time_point() };
     };
 
 }
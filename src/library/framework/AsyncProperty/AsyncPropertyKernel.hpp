@@ -0,0 +1,400 @@
+#ifndef __BN3MONKEY_ASYNC_PROPERTY_KERNEL__
+#define __BN3MONKEY_ASYNC_PROPERTY_KERNEL__
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+#if defined(__AVX2__)
+#define BN3MONKEY_ASYNC_PROPERTY_AVX2
+#endif
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define BN3MONKEY_ASYNC_PROPERTY_SSE2
+#endif
+
+#if defined(BN3MONKEY_ASYNC_PROPERTY_AVX2) || defined(BN3MONKEY_ASYNC_PROPERTY_SSE2)
+#include <immintrin.h>
+#endif
+
+// Bulk operations on ranges of AsyncPropertyArray and AsyncPropertyVector.
+// float, double and int16_t use SSE2 or AVX2 when the compiler targets them, and the other types use the scalar loops.
+// The instruction set is chosen at compile time, so build with /arch:AVX2 or -mavx2 to get the wider kernels.
+namespace Bn3Monkey
+{
+    // value * scale + offset, computed in the type of the element
+    template<typename Type>
+    struct AsyncPropertyScaleOffset
+    {
+        Type scale;
+        Type offset;
+    };
+
+    // min(max(value, low), high)
+    template<typename Type>
+    struct AsyncPropertyClamp
+    {
+        Type low;
+        Type high;
+    };
+
+    // Sums are accumulated in a wider type, so that they don't overflow.
+    template<typename Type>
+    using AsyncPropertyAccumulator = std::conditional_t<std::is_floating_point_v<Type>, double,
+        std::conditional_t<std::is_signed_v<Type>, int64_t, uint64_t>>;
+
+    template<typename Type>
+    struct AsyncPropertyReduction
+    {
+        Type min{};
+        Type max{};
+        AsyncPropertyAccumulator<Type> sum{};
+
+        void merge(const AsyncPropertyReduction& other)
+        {
+            min = std::min(min, other.min);
+            max = std::max(max, other.max);
+            sum += other.sum;
+        }
+    };
+
+    // Scalar kernels
+
+    template<typename Type>
+    inline void asyncPropertyTransform(Type* values, size_t length, const AsyncPropertyScaleOffset<Type>& op)
+    {
+        for (size_t i = 0; i < length; i++)
+            values[i] = static_cast<Type>(values[i] * op.scale + op.offset);
+    }
+
+    template<typename Type>
+    inline void asyncPropertyTransform(Type* values, size_t length, const AsyncPropertyClamp<Type>& op)
+    {
+        for (size_t i = 0; i < length; i++)
+            values[i] = std::min(std::max(values[i], op.low), op.high);
+    }
+
+    // Any callable taking and returning an element
+    template<typename Type, typename Op>
+    inline void asyncPropertyTransform(Type* values, size_t length, const Op& op)
+    {
+        for (size_t i = 0; i < length; i++)
+            values[i] = static_cast<Type>(op(values[i]));
+    }
+
+    // Compilers already turn this into wide stores.
+    template<typename Type>
+    inline void asyncPropertyFill(Type* values, size_t length, const Type& value)
+    {
+        std::fill_n(values, length, value);
+    }
+
+    // length must not be 0.
+    template<typename Type>
+    inline AsyncPropertyReduction<Type> asyncPropertyReduce(const Type* values, size_t length)
+    {
+        AsyncPropertyReduction<Type> ret{ values[0], values[0], 0 };
+        for (size_t i = 0; i < length; i++)
+        {
+            ret.min = std::min(ret.min, values[i]);
+            ret.max = std::max(ret.max, values[i]);
+            ret.sum += values[i];
+        }
+        return ret;
+    }
+
+    // SIMD kernels
+    // They leave the tail shorter than a register to the scalar loops above.
+
+    inline void asyncPropertyTransform(float* values, size_t length, const AsyncPropertyScaleOffset<float>& op)
+    {
+        size_t i = 0;
+#if defined(BN3MONKEY_ASYNC_PROPERTY_AVX2)
+        __m256 scale8 = _mm256_set1_ps(op.scale);
+        __m256 offset8 = _mm256_set1_ps(op.offset);
+        for (; i + 8 <= length; i += 8)
+        {
+            __m256 value = _mm256_loadu_ps(values + i);
+            _mm256_storeu_ps(values + i, _mm256_add_ps(_mm256_mul_ps(value, scale8), offset8));
+        }
+#endif
+#if defined(BN3MONKEY_ASYNC_PROPERTY_SSE2)
+        __m128 scale4 = _mm_set1_ps(op.scale);
+        __m128 offset4 = _mm_set1_ps(op.offset);
+        for (; i + 4 <= length; i += 4)
+        {
+            __m128 value = _mm_loadu_ps(values + i);
+            _mm_storeu_ps(values + i, _mm_add_ps(_mm_mul_ps(value, scale4), offset4));
+        }
+#endif
+        asyncPropertyTransform<float>(values + i, length - i, op);
+    }
+
+    // The operands of min and max are ordered so that NaN passes through as in std::min and std::max.
+    inline void asyncPropertyTransform(float* values, size_t length, const AsyncPropertyClamp<float>& op)
+    {
+        size_t i = 0;
+#if defined(BN3MONKEY_ASYNC_PROPERTY_AVX2)
+        __m256 low8 = _mm256_set1_ps(op.low);
+        __m256 high8 = _mm256_set1_ps(op.high);
+        for (; i + 8 <= length; i += 8)
+        {
+            __m256 value = _mm256_loadu_ps(values + i);
+            _mm256_storeu_ps(values + i, _mm256_min_ps(high8, _mm256_max_ps(low8, value)));
+        }
+#endif
+#if defined(BN3MONKEY_ASYNC_PROPERTY_SSE2)
+        __m128 low4 = _mm_set1_ps(op.low);
+        __m128 high4 = _mm_set1_ps(op.high);
+        for (; i + 4 <= length; i += 4)
+        {
+            __m128 value = _mm_loadu_ps(values + i);
+            _mm_storeu_ps(values + i, _mm_min_ps(high4, _mm_max_ps(low4, value)));
+        }
+#endif
+        asyncPropertyTransform<float>(values + i, length - i, op);
+    }
+
+    // The sum is accumulated in double lanes, as in the scalar loop.
+    inline AsyncPropertyReduction<float> asyncPropertyReduce(const float* values, size_t length)
+    {
+        AsyncPropertyReduction<float> ret{ values[0], values[0], 0 };
+        size_t i = 0;
+#if defined(BN3MONKEY_ASYNC_PROPERTY_AVX2)
+        if (length >= 8)
+        {
+            __m256 min8 = _mm256_set1_ps(values[0]);
+            __m256 max8 = min8;
+            __m256d sum4 = _mm256_setzero_pd();
+            for (; i + 8 <= length; i += 8)
+            {
+                __m256 value = _mm256_loadu_ps(values + i);
+                min8 = _mm256_min_ps(min8, value);
+                max8 = _mm256_max_ps(max8, value);
+                sum4 = _mm256_add_pd(sum4, _mm256_cvtps_pd(_mm256_castps256_ps128(value)));
+                sum4 = _mm256_add_pd(sum4, _mm256_cvtps_pd(_mm256_extractf128_ps(value, 1)));
+            }
+            alignas(32) float mins[8];
+            alignas(32) float maxs[8];
+            alignas(32) double sums[4];
+            _mm256_store_ps(mins, min8);
+            _mm256_store_ps(maxs, max8);
+            _mm256_store_pd(sums, sum4);
+            for (size_t lane = 0; lane < 8; lane++)
+            {
+                ret.min = std::min(ret.min, mins[lane]);
+                ret.max = std::max(ret.max, maxs[lane]);
+            }
+            ret.sum += (sums[0] + sums[1]) + (sums[2] + sums[3]);
+        }
+#elif defined(BN3MONKEY_ASYNC_PROPERTY_SSE2)
+        if (length >= 4)
+        {
+            __m128 min4 = _mm_set1_ps(values[0]);
+            __m128 max4 = min4;
+            __m128d sum2 = _mm_setzero_pd();
+            for (; i + 4 <= length; i += 4)
+            {
+                __m128 value = _mm_loadu_ps(values + i);
+                min4 = _mm_min_ps(min4, value);
+                max4 = _mm_max_ps(max4, value);
+                sum2 = _mm_add_pd(sum2, _mm_cvtps_pd(value));
+                sum2 = _mm_add_pd(sum2, _mm_cvtps_pd(_mm_movehl_ps(value, value)));
+            }
+            alignas(16) float mins[4];
+            alignas(16) float maxs[4];
+            alignas(16) double sums[2];
+            _mm_store_ps(mins, min4);
+            _mm_store_ps(maxs, max4);
+            _mm_store_pd(sums, sum2);
+            for (size_t lane = 0; lane < 4; lane++)
+            {
+                ret.min = std::min(ret.min, mins[lane]);
+                ret.max = std::max(ret.max, maxs[lane]);
+            }
+            ret.sum += sums[0] + sums[1];
+        }
+#endif
+        if (i < length)
+            ret.merge(asyncPropertyReduce<float>(values + i, length - i));
+        return ret;
+    }
+
+    inline void asyncPropertyTransform(double* values, size_t length, const AsyncPropertyScaleOffset<double>& op)
+    {
+        size_t i = 0;
+#if defined(BN3MONKEY_ASYNC_PROPERTY_AVX2)
+        __m256d scale4 = _mm256_set1_pd(op.scale);
+        __m256d offset4 = _mm256_set1_pd(op.offset);
+        for (; i + 4 <= length; i += 4)
+        {
+            __m256d value = _mm256_loadu_pd(values + i);
+            _mm256_storeu_pd(values + i, _mm256_add_pd(_mm256_mul_pd(value, scale4), offset4));
+        }
+#endif
+#if defined(BN3MONKEY_ASYNC_PROPERTY_SSE2)
+        __m128d scale2 = _mm_set1_pd(op.scale);
+        __m128d offset2 = _mm_set1_pd(op.offset);
+        for (; i + 2 <= length; i += 2)
+        {
+            __m128d value = _mm_loadu_pd(values + i);
+            _mm_storeu_pd(values + i, _mm_add_pd(_mm_mul_pd(value, scale2), offset2));
+        }
+#endif
+        asyncPropertyTransform<double>(values + i, length - i, op);
+    }
+
+    inline void asyncPropertyTransform(double* values, size_t length, const AsyncPropertyClamp<double>& op)
+    {
+        size_t i = 0;
+#if defined(BN3MONKEY_ASYNC_PROPERTY_AVX2)
+        __m256d low4 = _mm256_set1_pd(op.low);
+        __m256d high4 = _mm256_set1_pd(op.high);
+        for (; i + 4 <= length; i += 4)
+        {
+            __m256d value = _mm256_loadu_pd(values + i);
+            _mm256_storeu_pd(values + i, _mm256_min_pd(high4, _mm256_max_pd(low4, value)));
+        }
+#endif
+#if defined(BN3MONKEY_ASYNC_PROPERTY_SSE2)
+        __m128d low2 = _mm_set1_pd(op.low);
+        __m128d high2 = _mm_set1_pd(op.high);
+        for (; i + 2 <= length; i += 2)
+        {
+            __m128d value = _mm_loadu_pd(values + i);
+            _mm_storeu_pd(values + i, _mm_min_pd(high2, _mm_max_pd(low2, value)));
+        }
+#endif
+        asyncPropertyTransform<double>(values + i, length - i, op);
+    }
+
+    // Products wrap around as in the scalar loop, which truncates the promoted int to int16_t.
+    inline void asyncPropertyTransform(int16_t* values, size_t length, const AsyncPropertyScaleOffset<int16_t>& op)
+    {
+        size_t i = 0;
+#if defined(BN3MONKEY_ASYNC_PROPERTY_AVX2)
+        __m256i scale16 = _mm256_set1_epi16(op.scale);
+        __m256i offset16 = _mm256_set1_epi16(op.offset);
+        for (; i + 16 <= length; i += 16)
+        {
+            __m256i value = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(values + i));
+            value = _mm256_add_epi16(_mm256_mullo_epi16(value, scale16), offset16);
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(values + i), value);
+        }
+#endif
+#if defined(BN3MONKEY_ASYNC_PROPERTY_SSE2)
+        __m128i scale8 = _mm_set1_epi16(op.scale);
+        __m128i offset8 = _mm_set1_epi16(op.offset);
+        for (; i + 8 <= length; i += 8)
+        {
+            __m128i value = _mm_loadu_si128(reinterpret_cast<const __m128i*>(values + i));
+            value = _mm_add_epi16(_mm_mullo_epi16(value, scale8), offset8);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(values + i), value);
+        }
+#endif
+        asyncPropertyTransform<int16_t>(values + i, length - i, op);
+    }
+
+    inline void asyncPropertyTransform(int16_t* values, size_t length, const AsyncPropertyClamp<int16_t>& op)
+    {
+        size_t i = 0;
+#if defined(BN3MONKEY_ASYNC_PROPERTY_AVX2)
+        __m256i low16 = _mm256_set1_epi16(op.low);
+        __m256i high16 = _mm256_set1_epi16(op.high);
+        for (; i + 16 <= length; i += 16)
+        {
+            __m256i value = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(values + i));
+            value = _mm256_min_epi16(_mm256_max_epi16(value, low16), high16);
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(values + i), value);
+        }
+#endif
+#if defined(BN3MONKEY_ASYNC_PROPERTY_SSE2)
+        __m128i low8 = _mm_set1_epi16(op.low);
+        __m128i high8 = _mm_set1_epi16(op.high);
+        for (; i + 8 <= length; i += 8)
+        {
+            __m128i value = _mm_loadu_si128(reinterpret_cast<const __m128i*>(values + i));
+            value = _mm_min_epi16(_mm_max_epi16(value, low8), high8);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(values + i), value);
+        }
+#endif
+        asyncPropertyTransform<int16_t>(values + i, length - i, op);
+    }
+
+    // madd sums pairs into int32 lanes, which are flushed into the int64 sum before they can overflow.
+    inline AsyncPropertyReduction<int16_t> asyncPropertyReduce(const int16_t* values, size_t length)
+    {
+        constexpr size_t FLUSH_INTERVAL = 8192;
+
+        AsyncPropertyReduction<int16_t> ret{ values[0], values[0], 0 };
+        size_t i = 0;
+#if defined(BN3MONKEY_ASYNC_PROPERTY_AVX2)
+        if (length >= 16)
+        {
+            __m256i min16 = _mm256_set1_epi16(values[0]);
+            __m256i max16 = min16;
+            __m256i ones = _mm256_set1_epi16(1);
+            alignas(32) int32_t sums[8];
+            while (i + 16 <= length)
+            {
+                __m256i sum8 = _mm256_setzero_si256();
+                for (size_t count = 0; count < FLUSH_INTERVAL && i + 16 <= length; count++, i += 16)
+                {
+                    __m256i value = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(values + i));
+                    min16 = _mm256_min_epi16(min16, value);
+                    max16 = _mm256_max_epi16(max16, value);
+                    sum8 = _mm256_add_epi32(sum8, _mm256_madd_epi16(value, ones));
+                }
+                _mm256_store_si256(reinterpret_cast<__m256i*>(sums), sum8);
+                for (size_t lane = 0; lane < 8; lane++)
+                    ret.sum += sums[lane];
+            }
+            alignas(32) int16_t mins[16];
+            alignas(32) int16_t maxs[16];
+            _mm256_store_si256(reinterpret_cast<__m256i*>(mins), min16);
+            _mm256_store_si256(reinterpret_cast<__m256i*>(maxs), max16);
+            for (size_t lane = 0; lane < 16; lane++)
+            {
+                ret.min = std::min(ret.min, mins[lane]);
+                ret.max = std::max(ret.max, maxs[lane]);
+            }
+        }
+#elif defined(BN3MONKEY_ASYNC_PROPERTY_SSE2)
+        if (length >= 8)
+        {
+            __m128i min8 = _mm_set1_epi16(values[0]);
+            __m128i max8 = min8;
+            __m128i ones = _mm_set1_epi16(1);
+            alignas(16) int32_t sums[4];
+            while (i + 8 <= length)
+            {
+                __m128i sum4 = _mm_setzero_si128();
+                for (size_t count = 0; count < FLUSH_INTERVAL && i + 8 <= length; count++, i += 8)
+                {
+                    __m128i value = _mm_loadu_si128(reinterpret_cast<const __m128i*>(values + i));
+                    min8 = _mm_min_epi16(min8, value);
+                    max8 = _mm_max_epi16(max8, value);
+                    sum4 = _mm_add_epi32(sum4, _mm_madd_epi16(value, ones));
+                }
+                _mm_store_si128(reinterpret_cast<__m128i*>(sums), sum4);
+                for (size_t lane = 0; lane < 4; lane++)
+                    ret.sum += sums[lane];
+            }
+            alignas(16) int16_t mins[8];
+            alignas(16) int16_t maxs[8];
+            _mm_store_si128(reinterpret_cast<__m128i*>(mins), min8);
+            _mm_store_si128(reinterpret_cast<__m128i*>(maxs), max8);
+            for (size_t lane = 0; lane < 8; lane++)
+            {
+                ret.min = std::min(ret.min, mins[lane]);
+                ret.max = std::max(ret.max, maxs[lane]);
+            }
+        }
+#endif
+        if (i < length)
+            ret.merge(asyncPropertyReduce<int16_t>(values + i, length - i));
+        return ret;
+    }
+}
+
+#endif // __BN3MONKEY_ASYNC_PROPERTY_KERNEL__
@@ -5,7 +5,9 @@ namespace Bn3Monkey
 {
 	class AsyncPropertyNode
 	{
-
+	public:
+		// Nodes are destroyed by AsyncPropertyContainer without knowing their types.
+		virtual ~AsyncPropertyNode() {}
 	};
 
 	struct AsyncPropertyExtendedNode
@@ -0,0 +1,100 @@
+#ifndef __BN3MONKEY_ASYNC_PROPERTY_RANGE_SET__
+#define __BN3MONKEY_ASYNC_PROPERTY_RANGE_SET__
+
+#include <algorithm>
+#include <cstddef>
+
+namespace Bn3Monkey
+{
+    // [start, end) of an array property
+    struct AsyncPropertyRange
+    {
+        size_t start{ 0 };
+        size_t end{ 0 };
+    };
+
+    // Sorted ranges, none of which overlap or touch each other.
+    // A range which overlaps or touches the ones already held is merged with them when it is added.
+    // Beyond MAX_RANGES, the two closest ranges are merged, so the set covers every added index but may cover a few more.
+    class AsyncPropertyRangeSet
+    {
+    public:
+        static constexpr size_t MAX_RANGES = 16;
+
+        AsyncPropertyRangeSet() {}
+        AsyncPropertyRangeSet(size_t start, size_t end)
+        {
+            add(start, end);
+        }
+
+        void add(size_t start, size_t end)
+        {
+            if (end <= start)
+                return;
+
+            // The first range which ends at or after start
+            size_t first = 0;
+            while (first < _count && _ranges[first].end < start)
+                first++;
+            // Ranges from first to last overlap or touch [start, end).
+            size_t last = first;
+            while (last < _count && _ranges[last].start <= end)
+            {
+                start = std::min(start, _ranges[last].start);
+                end = std::max(end, _ranges[last].end);
+                last++;
+            }
+
+            if (first == last)
+            {
+                std::move_backward(_ranges + first, _ranges + _count, _ranges + _count + 1);
+                _count++;
+            }
+            else
+            {
+                std::move(_ranges + last, _ranges + _count, _ranges + first + 1);
+                _count -= last - first - 1;
+            }
+            _ranges[first] = { start, end };
+
+            if (_count > MAX_RANGES)
+                mergeClosest();
+        }
+
+        void clear() { _count = 0; }
+        bool empty() const { return _count == 0; }
+        size_t size() const { return _count; }
+
+        const AsyncPropertyRange& operator[](size_t idx) const { return _ranges[idx]; }
+        const AsyncPropertyRange* begin() const { return _ranges; }
+        const AsyncPropertyRange* end() const { return _ranges + _count; }
+
+        // The smallest range which covers all. Empty if the set is.
+        AsyncPropertyRange bounds() const
+        {
+            if (_count == 0)
+                return AsyncPropertyRange();
+            return { _ranges[0].start, _ranges[_count - 1].end };
+        }
+
+    private:
+        void mergeClosest()
+        {
+            size_t closest = 0;
+            for (size_t i = 1; i + 1 < _count; i++)
+            {
+                if (_ranges[i + 1].start - _ranges[i].end < _ranges[closest + 1].start - _ranges[closest].end)
+                    closest = i;
+            }
+            _ranges[closest].end = _ranges[closest + 1].end;
+            std::move(_ranges + closest + 2, _ranges + _count, _ranges + closest + 1);
+            _count--;
+        }
+
+        // One more than MAX_RANGES, so that a range can be inserted before the closest ones are merged.
+        AsyncPropertyRange _ranges[MAX_RANGES + 1];
+        size_t _count{ 0 };
+    };
+}
+
+#endif // __BN3MONKEY_ASYNC_PROPERTY_RANGE_SET__
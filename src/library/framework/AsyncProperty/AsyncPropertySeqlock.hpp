@@ -0,0 +1,93 @@
+#ifndef __BN3MONKEY_ASYNC_PROPERTY_SEQLOCK__
+#define __BN3MONKEY_ASYNC_PROPERTY_SEQLOCK__
+
+#include "../ScopedTask/ScopedTaskWait.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+namespace Bn3Monkey
+{
+    // Publishes a value written by one thread to readers on any thread, without a lock.
+    // A value which fits in a lock-free atomic is stored as one. A bigger one is copied in words under a sequence counter,
+    // and readers retry while a write is in progress.
+    template<typename Type>
+    class AsyncPropertySeqlock
+    {
+        static constexpr bool IS_ATOMIC = std::is_trivially_copyable_v<Type> && sizeof(Type) <= sizeof(uint64_t);
+
+    public:
+        explicit AsyncPropertySeqlock(const Type& value)
+        {
+            store(value);
+        }
+
+        // Only one thread writes at a time.
+        void store(const Type& value)
+        {
+            if constexpr (IS_ATOMIC)
+            {
+                _storage.store(value, std::memory_order_release);
+            }
+            else
+            {
+                uint64_t buffer[WORD_COUNT]{};
+                memcpy(buffer, static_cast<const void*>(&value), sizeof(Type));
+
+                auto sequence = _storage.sequence.load(std::memory_order_relaxed);
+                // Odd while the words are written
+                _storage.sequence.store(sequence + 1, std::memory_order_relaxed);
+                std::atomic_thread_fence(std::memory_order_release);
+                for (size_t i = 0; i < WORD_COUNT; i++)
+                    _storage.words[i].store(buffer[i], std::memory_order_relaxed);
+                _storage.sequence.store(sequence + 2, std::memory_order_release);
+            }
+        }
+
+        Type load() const
+        {
+            if constexpr (IS_ATOMIC)
+            {
+                return _storage.load(std::memory_order_acquire);
+            }
+            else
+            {
+                uint64_t buffer[WORD_COUNT];
+                for (;;)
+                {
+                    auto sequence = _storage.sequence.load(std::memory_order_acquire);
+                    if (sequence & 1)
+                    {
+                        relaxCpu();
+                        continue;
+                    }
+                    for (size_t i = 0; i < WORD_COUNT; i++)
+                        buffer[i] = _storage.words[i].load(std::memory_order_relaxed);
+                    std::atomic_thread_fence(std::memory_order_acquire);
+                    if (_storage.sequence.load(std::memory_order_relaxed) == sequence)
+                        break;
+                }
+
+                // Types stored here hold their data inline (Bn3StaticString), so a byte copy is a whole value.
+                Type ret;
+                memcpy(static_cast<void*>(&ret), buffer, sizeof(Type));
+                return ret;
+            }
+        }
+
+    private:
+        static constexpr size_t WORD_COUNT = (sizeof(Type) + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+
+        struct Words
+        {
+            std::atomic<uint32_t> sequence{ 0 };
+            std::atomic<uint64_t> words[WORD_COUNT];
+        };
+
+        std::conditional_t<IS_ATOMIC, std::atomic<Type>, Words> _storage;
+    };
+}
+
+#endif // __BN3MONKEY_ASYNC_PROPERTY_SEQLOCK__
@@ -0,0 +1,55 @@
+#include "AsyncPropertyContainer.hpp"
+
+using namespace Bn3Monkey;
+
+bool AsyncPropertyTransaction::commit()
+{
+    if (_length == 0)
+        return true;
+
+    static const Bn3Tag tag("property_transaction");
+    auto result = _container._scope.call(tag, AsyncPropertyTransaction::onTransactionCommitted, this);
+    auto ret = result.wait();
+    clear();
+    if (!ret)
+        return false;
+    return *ret;
+}
+
+void AsyncPropertyTransaction::clear()
+{
+    for (size_t i = 0; i < _length; i++)
+    {
+        _entries[i].operations->destroy(_entries[i].value);
+        _entries[i] = Entry();
+    }
+    _length = 0;
+}
+
+bool AsyncPropertyTransaction::onTransactionCommitted(AsyncPropertyTransaction* self)
+{
+    auto* entries = self->_entries;
+    size_t length = self->_length;
+
+    // Nothing else runs on the scope in between, so the values are seen together.
+    for (size_t i = 0; i < length; i++)
+        entries[i].operations->commit(entries[i].node, entries[i].value);
+
+    // Every listener is notified before any result is waited for. A rejection skips the listeners of every property.
+    ScopedTaskResult<bool> results[MAX_ENTRY_COUNT * ASYNC_PROPERTY_LISTENER_COUNT];
+    size_t result_length = 0;
+    auto rejection = makePropertyRejection();
+    for (size_t i = 0; i < length; i++)
+        result_length += entries[i].operations->notify(entries[i].node, results + result_length, rejection);
+
+    bool success = waitPropertyNotified(results, result_length, rejection);
+    if (!success)
+    {
+        for (size_t i = 0; i < length; i++)
+            entries[i].operations->rollback(entries[i].node);
+    }
+
+    for (size_t i = 0; i < length; i++)
+        entries[i].operations->update(entries[i].node, success);
+    return success;
+}
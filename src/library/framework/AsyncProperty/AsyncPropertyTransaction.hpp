@@ -0,0 +1,137 @@
+#ifndef __BN3MONKEY_ASYNC_PROPERTY_TRANSACTION__
+#define __BN3MONKEY_ASYNC_PROPERTY_TRANSACTION__
+
+#include "../Tag/Tag.hpp"
+#include "../MemoryPool/MemoryPool.hpp"
+#include "../ScopedTask/ScopedTask.hpp"
+#include "AsyncPropertyNode.hpp"
+#include "AsyncPropertyImpl.hpp"
+
+#include <type_traits>
+
+namespace Bn3Monkey
+{
+    class AsyncPropertyContainer;
+
+    // Stages values of several properties of a container, and applies them in one task on the scope of the container.
+    // The values are committed together, the listeners of all of them are notified at once,
+    // and all of them are rolled back if any listener rejects.
+    class AsyncPropertyTransaction
+    {
+    public:
+        static constexpr size_t MAX_ENTRY_COUNT = 16;
+
+        AsyncPropertyTransaction(const AsyncPropertyTransaction& other) = delete;
+        AsyncPropertyTransaction(AsyncPropertyTransaction&& other) = delete;
+        ~AsyncPropertyTransaction()
+        {
+            clear();
+        }
+
+        // Setting a staged path again replaces its value. Type is the type of the property, and is not deduced from value.
+        // Returns false if the path doesn't exist, is not an AsyncProperty<Type>, the value is not valid, or the transaction is full.
+        template<class Type>
+        bool set(const char* path, const std::common_type_t<Type>& value);
+
+        // Costs one round trip to the scope. Returns true if every listener accepts.
+        // The staged values are cleared either way.
+        bool commit();
+
+        void clear();
+        size_t size() const { return _length; }
+
+    private:
+        friend class AsyncPropertyContainer;
+        explicit AsyncPropertyTransaction(AsyncPropertyContainer& container) : _container(container) {}
+
+        struct Operations
+        {
+            void (*commit)(AsyncPropertyNode* node, const void* value);
+            size_t (*notify)(AsyncPropertyNode* node, ScopedTaskResult<bool>* results, const AsyncPropertyRejection& rejection);
+            void (*rollback)(AsyncPropertyNode* node);
+            void (*update)(AsyncPropertyNode* node, bool success);
+            void (*assign)(void* value, const void* other);
+            void (*destroy)(void* value);
+        };
+
+        template<class Type>
+        struct TypedOperations
+        {
+            static inline AsyncProperty<Type>* cast(AsyncPropertyNode* node)
+            {
+                return reinterpret_cast<AsyncProperty<Type>*>(node);
+            }
+            static void commit(AsyncPropertyNode* node, const void* value)
+            {
+                AsyncProperty<Type>::onPropertyCommitted(cast(node), *static_cast<const Type*>(value));
+            }
+            static size_t notify(AsyncPropertyNode* node, ScopedTaskResult<bool>* results, const AsyncPropertyRejection& rejection)
+            {
+                return AsyncProperty<Type>::onPropertyNotifying(cast(node), results, rejection);
+            }
+            static void rollback(AsyncPropertyNode* node)
+            {
+                AsyncProperty<Type>::onPropertyRolledBack(cast(node));
+            }
+            static void update(AsyncPropertyNode* node, bool success)
+            {
+                AsyncProperty<Type>::onPropertyUpdated(cast(node), success);
+            }
+            static void assign(void* value, const void* other)
+            {
+                *static_cast<Type*>(value) = *static_cast<const Type*>(other);
+            }
+            static void destroy(void* value)
+            {
+                Bn3MemoryPool::destroy<Type>(static_cast<Type*>(value));
+            }
+            static constexpr Operations value{ &commit, &notify, &rollback, &update, &assign, &destroy };
+        };
+
+        struct Entry
+        {
+            AsyncPropertyNode* node{ nullptr };
+            // Staged value in the memory pool
+            void* value{ nullptr };
+            const Operations* operations{ nullptr };
+        };
+
+        template<class Type>
+        bool stage(AsyncProperty<Type>* property, const Type& value)
+        {
+            if (!property || !property->isValid(value))
+                return false;
+
+            for (size_t i = 0; i < _length; i++)
+            {
+                if (_entries[i].node == property)
+                {
+                    _entries[i].operations->assign(_entries[i].value, &value);
+                    return true;
+                }
+            }
+
+            if (_length == MAX_ENTRY_COUNT)
+            {
+                LOG_E("Transaction cannot stage more than %zu properties", MAX_ENTRY_COUNT);
+                return false;
+            }
+
+            static const Bn3Tag tag("property_transaction");
+            auto* staged = Bn3MemoryPool::construct<Type>(tag, value);
+            if (!staged)
+                return false;
+
+            _entries[_length++] = { property, staged, &TypedOperations<Type>::value };
+            return true;
+        }
+
+        static bool onTransactionCommitted(AsyncPropertyTransaction* self);
+
+        AsyncPropertyContainer& _container;
+        Entry _entries[MAX_ENTRY_COUNT];
+        size_t _length{ 0 };
+    };
+}
+
+#endif // __BN3MONKEY_ASYNC_PROPERTY_TRANSACTION__
@@ -0,0 +1,459 @@
+#ifndef __BN3MONKEY_ASYNC_PROPERTY_VECTOR__
+#define __BN3MONKEY_ASYNC_PROPERTY_VECTOR__
+
+#include "../Tag/Tag.hpp"
+#include "../MemoryPool/MemoryPool.hpp"
+#include "../StaticVector/StaticVector.hpp"
+#include "../ScopedTask/ScopedTask.hpp"
+#include "AsyncPropertyNode.hpp"
+#include "AsyncPropertyArray.hpp"
+#include "AsyncPropertyKernel.hpp"
+
+#include <functional>
+#include <type_traits>
+#include <memory>
+#include <cstring>
+#include <algorithm>
+
+namespace Bn3Monkey
+{
+    // Array property whose length is given at runtime.
+    // The values are stored in chunks allocated from the memory pool, so exactly length elements are allocated
+    // and the length is not bounded by a capacity.
+    template <typename Type>
+    class AsyncPropertyVector : public AsyncPropertyNode
+    {
+    public:
+        static_assert(std::is_arithmetic_v<Type> || std::is_enum_v<Type> || std::is_same_v<Type, Bn3StaticString>);
+
+        // Elements in a chunk, so that a chunk fits in the largest block of the memory pool
+        static constexpr size_t CHUNK_LENGTH = sizeof(Type) < Bn3MemoryBlock<MAX_BLOCK_SIZE>::content_size ? Bn3MemoryBlock<MAX_BLOCK_SIZE>::content_size / sizeof(Type) : 1;
+
+        // length is 0 if the storage cannot be allocated.
+        AsyncPropertyVector(const Bn3Tag& name, const ScopedTaskScope& scope, const Type* values, size_t length) : _name(name), _scope(scope)
+        {
+            size_t chunk_count = (length + CHUNK_LENGTH - 1) / CHUNK_LENGTH;
+            if (chunk_count == 0)
+                return;
+
+            _chunks = Bn3MemoryPool::allocate<Type*>(_name, chunk_count);
+            if (!_chunks)
+            {
+                LOG_E("Cannot allocate %zu elements of %s", length, _name.str());
+                return;
+            }
+            _length = length;
+            for (size_t i = 0; i < chunk_count; i++)
+            {
+                _chunks[i] = Bn3MemoryPool::allocate<Type>(_name, chunkLength(i));
+                if (!_chunks[i])
+                {
+                    LOG_E("Cannot allocate %zu elements of %s", length, _name.str());
+                    releaseChunks(i);
+                    return;
+                }
+            }
+            copyFrom(values, 0, length);
+        }
+        AsyncPropertyVector(const AsyncPropertyVector& other) = delete;
+        AsyncPropertyVector(AsyncPropertyVector&& other) = delete;
+
+        virtual ~AsyncPropertyVector()
+        {
+            releaseUndo(this);
+            releaseChunks(chunkCount());
+        }
+
+        virtual bool isValid(const Type* values, size_t start, size_t end)
+        {
+            if (end <= start)
+                return false;
+            if (end > _length)
+                return false;
+            return true;
+        }
+
+        size_t length() const noexcept { return _length; }
+
+        // Reads go ahead of queued updates, so they are not delayed by a storm of setAsync.
+        bool get(Type* values, size_t start, size_t end)
+        {
+            if (end <= start || end > _length)
+                return false;
+
+            auto result = _scope.call(ScopedTaskPriority::HIGH, _name, AsyncPropertyVector::onPropertyObtained, this, values, start, end);
+            auto ret = result.wait();
+            if (!ret)
+                return false;
+            return *ret;
+        }
+
+        bool set(const Type* values, size_t start, size_t end)
+        {
+            if (!isValid(values, start, end))
+                return false;
+
+            auto result = _scope.call(_name, AsyncPropertyVector::onPropertyCommitted, this, values, start, end);
+            auto ret = result.wait();
+            if (!ret)
+                return false;
+            if (!(*ret))
+                return false;
+            return true;
+        }
+
+        bool notify(size_t start, size_t end)
+        {
+            auto result = _scope.call(_name, AsyncPropertyVector::onPropertyNotified, this, start, end);
+            auto ret = result.wait();
+            if (!ret)
+                return false;
+            if (!(*ret))
+                return false;
+            return true;
+        }
+
+        void update(size_t start, size_t end, bool success)
+        {
+            _scope.run(_name, AsyncPropertyVector::onPropertyUpdated, this, start, end, success);
+        }
+
+        // values must be valid until the update runs.
+        void setAsync(const Type* values, size_t start, size_t end)
+        {
+            if (!isValid(values, start, end))
+                return;
+
+            _scope.run(_name, AsyncPropertyVector::onPropertyProcessed, this, values, start, end);
+        }
+
+        // Same as the bulk operations of AsyncPropertyArray. The kernels run chunk by chunk.
+        template<typename Op>
+        bool transform(size_t start, size_t end, const Op& op)
+        {
+            static_assert(std::is_arithmetic_v<Type>, "transform is for numeric arrays");
+            if (!isValid(nullptr, start, end))
+                return false;
+
+            auto result = _scope.call(_name, AsyncPropertyVector::onPropertyTransformed<Op>, this, &op, start, end);
+            auto ret = result.wait();
+            return ret && *ret;
+        }
+
+        bool fill(size_t start, size_t end, const Type& value)
+        {
+            if (!isValid(nullptr, start, end))
+                return false;
+
+            auto result = _scope.call(_name, AsyncPropertyVector::onPropertyFilled, this, &value, start, end);
+            auto ret = result.wait();
+            return ret && *ret;
+        }
+
+        bool reduce(size_t start, size_t end, AsyncPropertyReduction<Type>& reduction)
+        {
+            static_assert(std::is_arithmetic_v<Type>, "reduce is for numeric arrays");
+            if (end <= start || end > _length)
+                return false;
+
+            auto result = _scope.call(ScopedTaskPriority::HIGH, _name, AsyncPropertyVector::onPropertyReduced, this, &reduction, start, end);
+            auto ret = result.wait();
+            return ret && *ret;
+        }
+
+        bool compareAndSet(const Type* expected, const Type* values, size_t start, size_t end)
+        {
+            static_assert(std::is_arithmetic_v<Type>, "compareAndSet is for numeric arrays");
+            if (!isValid(values, start, end))
+                return false;
+
+            auto result = _scope.call(_name, AsyncPropertyVector::onPropertyCompared, this, expected, values, start, end);
+            auto ret = result.wait();
+            return ret && *ret;
+        }
+
+        // Listeners receive the changed range [start, end) only.
+        void registerOnPropertyNotified(const ScopedTaskScope& scope, std::function<bool(const Type*, size_t, size_t)> onPropertyNotified)
+        {
+            _on_property_notifieds.emplace_back(scope, onPropertyNotified);
+        }
+
+        void clearOnPropertyNotified()
+        {
+            _on_property_notifieds.clear();
+        }
+
+        void registerOnPropertyUpdated(const ScopedTaskScope& scope, std::function<void(const Type*, size_t, size_t, bool)> onPropertyUpdated)
+        {
+            _on_property_updateds.emplace_back(scope, onPropertyUpdated);
+        }
+
+        void clearOnPropertyUpdated()
+        {
+            _on_property_updateds.clear();
+        }
+
+    private:
+        size_t chunkLength(size_t idx) const
+        {
+            size_t start = idx * CHUNK_LENGTH;
+            return _length - start < CHUNK_LENGTH ? _length - start : CHUNK_LENGTH;
+        }
+        size_t chunkCount() const
+        {
+            return (_length + CHUNK_LENGTH - 1) / CHUNK_LENGTH;
+        }
+        // Releases the first allocated_count chunks and the table of all of them.
+        // The memory pool finds the block by its size, so the sizes must be the ones they were allocated with.
+        void releaseChunks(size_t allocated_count)
+        {
+            if (!_chunks)
+                return;
+            for (size_t i = 0; i < allocated_count; i++)
+                Bn3MemoryPool::deallocate<Type>(_chunks[i], chunkLength(i));
+            Bn3MemoryPool::deallocate<Type*>(_chunks, chunkCount());
+            _chunks = nullptr;
+            _length = 0;
+        }
+
+        // Calls func(values, length) for each part of [start, end) which lies in one chunk.
+        template<typename Func>
+        void forEachChunk(size_t start, size_t end, Func&& func) const
+        {
+            while (start < end)
+            {
+                size_t idx = start / CHUNK_LENGTH;
+                size_t offset = start % CHUNK_LENGTH;
+                size_t length = std::min(CHUNK_LENGTH - offset, end - start);
+                func(_chunks[idx] + offset, length);
+                start += length;
+            }
+        }
+
+        void copyFrom(const Type* values, size_t start, size_t end)
+        {
+            while (start < end)
+            {
+                size_t idx = start / CHUNK_LENGTH;
+                size_t offset = start % CHUNK_LENGTH;
+                size_t length = std::min(CHUNK_LENGTH - offset, end - start);
+                memcpy(static_cast<void*>(_chunks[idx] + offset), values, sizeof(Type) * length);
+                values += length;
+                start += length;
+            }
+        }
+        void copyTo(Type* values, size_t start, size_t end) const
+        {
+            while (start < end)
+            {
+                size_t idx = start / CHUNK_LENGTH;
+                size_t offset = start % CHUNK_LENGTH;
+                size_t length = std::min(CHUNK_LENGTH - offset, end - start);
+                memcpy(static_cast<void*>(values), _chunks[idx] + offset, sizeof(Type) * length);
+                values += length;
+                start += length;
+            }
+        }
+
+        static bool onPropertyObtained(AsyncPropertyVector* self, Type* values, size_t start, size_t end)
+        {
+            self->copyTo(values, start, end);
+            return true;
+        }
+        // Only the overwritten range is saved, so the cost follows the size of the change.
+        static bool onPropertyCommitted(AsyncPropertyVector* self, const Type* values, size_t start, size_t end)
+        {
+            if (!saveUndo(self, start, end))
+                return false;
+
+            self->copyFrom(values, start, end);
+            return true;
+        }
+        static bool saveUndo(AsyncPropertyVector* self, size_t start, size_t end)
+        {
+            static const Bn3Tag tag("property_vector_undo");
+
+            releaseUndo(self);
+            auto* undo = Bn3MemoryPool::allocate<Type>(tag, end - start);
+            if (!undo)
+                return false;
+            self->copyTo(undo, start, end);
+            self->_undo = { undo, start, end };
+            return true;
+        }
+        static void onPropertyRolledBack(AsyncPropertyVector* self)
+        {
+            auto& undo = self->_undo;
+            if (undo.values)
+                self->copyFrom(undo.values, undo.start, undo.end);
+            releaseUndo(self);
+        }
+        static void releaseUndo(AsyncPropertyVector* self)
+        {
+            auto& undo = self->_undo;
+            if (!undo.values)
+                return;
+            Bn3MemoryPool::deallocate<Type>(undo.values, undo.end - undo.start);
+            undo = Undo();
+        }
+        // Copies the range out of the chunks, so listeners read one span which later commits don't change.
+        static AsyncPropertyArrayView<Type> onPropertyViewed(AsyncPropertyVector* self, size_t start, size_t end)
+        {
+            static const Bn3Tag tag("property_vector_view");
+
+            size_t length = end - start;
+            auto* values = Bn3MemoryPool::allocate<Type>(tag, length);
+            if (!values)
+                return AsyncPropertyArrayView<Type>();
+            self->copyTo(values, start, end);
+
+            std::shared_ptr<const Type> data(values, [length](const Type* ptr) {
+                Bn3MemoryPool::deallocate<Type>(const_cast<Type*>(ptr), length);
+                });
+            return AsyncPropertyArrayView<Type>(std::move(data), length);
+        }
+        static bool onPropertyNotified(AsyncPropertyVector* self, size_t start, size_t end)
+        {
+            if (self->_on_property_notifieds.size() == 0)
+            {
+                releaseUndo(self);
+                return true;
+            }
+
+            auto view = onPropertyViewed(self, start, end);
+            if (!view)
+            {
+                onPropertyRolledBack(self);
+                return false;
+            }
+
+            ScopedTaskResult<bool> results[4];
+            size_t callback_length = 0;
+
+            static const Bn3Tag prefix("Notified_");
+            Bn3Tag name(prefix, self->_name);
+            for (auto& on_property_notified : self->_on_property_notifieds)
+            {
+                auto result = on_property_notified(name, view, start, end);
+                results[callback_length++] = std::move(result);
+            }
+
+            bool success = true;
+            for (size_t i = 0; i < callback_length; i++)
+            {
+                bool* ret = results[i].wait();
+                if (!ret || !(*ret))
+                {
+                    success = false;
+                    break;
+                }
+            }
+
+            if (success)
+            {
+                // confirmed
+                releaseUndo(self);
+            }
+            else
+            {
+                onPropertyRolledBack(self);
+            }
+            return success;
+        }
+        static void onPropertyUpdated(AsyncPropertyVector* self, size_t start, size_t end, bool success)
+        {
+            if (self->_on_property_updateds.size() == 0)
+                return;
+
+            auto view = onPropertyViewed(self, start, end);
+            if (!view)
+            {
+                LOG_E("Cannot take a snapshot of %s", self->_name.str());
+                return;
+            }
+
+            static const Bn3Tag prefix("Updated_");
+            Bn3Tag name(prefix, self->_name);
+            for (auto& on_property_updated : self->_on_property_updateds)
+            {
+                on_property_updated(name, view, start, end, success);
+            }
+        }
+        static bool onPropertyProcessed(AsyncPropertyVector* self, const Type* values, size_t start, size_t end)
+        {
+            bool ret = onPropertyCommitted(self, values, start, end) && onPropertyNotified(self, start, end);
+            onPropertyUpdated(self, start, end, ret);
+            return ret;
+        }
+        template<typename Op>
+        static bool onPropertyTransformed(AsyncPropertyVector* self, const Op* op, size_t start, size_t end)
+        {
+            if (!saveUndo(self, start, end))
+                return false;
+            self->forEachChunk(start, end, [op](Type* values, size_t length) {
+                asyncPropertyTransform(values, length, *op);
+                });
+            return onPropertyPublished(self, start, end);
+        }
+        static bool onPropertyFilled(AsyncPropertyVector* self, const Type* value, size_t start, size_t end)
+        {
+            if (!saveUndo(self, start, end))
+                return false;
+            self->forEachChunk(start, end, [value](Type* values, size_t length) {
+                asyncPropertyFill(values, length, *value);
+                });
+            return onPropertyPublished(self, start, end);
+        }
+        static bool onPropertyReduced(AsyncPropertyVector* self, AsyncPropertyReduction<Type>* reduction, size_t start, size_t end)
+        {
+            bool is_first = true;
+            self->forEachChunk(start, end, [&](const Type* values, size_t length) {
+                auto chunk_reduction = asyncPropertyReduce(values, length);
+                if (is_first)
+                    *reduction = chunk_reduction;
+                else
+                    reduction->merge(chunk_reduction);
+                is_first = false;
+                });
+            return true;
+        }
+        static bool onPropertyCompared(AsyncPropertyVector* self, const Type* expected, const Type* values, size_t start, size_t end)
+        {
+            bool is_equal = true;
+            self->forEachChunk(start, end, [&](const Type* current, size_t length) {
+                is_equal = is_equal && std::equal(current, current + length, expected);
+                expected += length;
+                });
+            if (!is_equal)
+                return false;
+            return onPropertyCommitted(self, values, start, end) && onPropertyPublished(self, start, end);
+        }
+        static bool onPropertyPublished(AsyncPropertyVector* self, size_t start, size_t end)
+        {
+            bool ret = onPropertyNotified(self, start, end);
+            onPropertyUpdated(self, start, end, ret);
+            return ret;
+        }
+
+        Bn3Tag _name;
+        ScopedTaskScope _scope;
+
+        Bn3StaticVector<OnPropertyArrayNotified<Type>, 4> _on_property_notifieds;
+        Bn3StaticVector<OnPropertyArrayUpdated<Type>, 4> _on_property_updateds;
+
+        size_t _length{ 0 };
+        // Each chunk holds CHUNK_LENGTH elements, except the last one which holds the rest.
+        Type** _chunks{ nullptr };
+
+        // The range overwritten by the last commit, in the memory pool, until it is confirmed or rolled back
+        struct Undo
+        {
+            Type* values{ nullptr };
+            size_t start{ 0 };
+            size_t end{ 0 };
+        };
+        Undo _undo;
+    };
+}
+
+#endif // __BN3MONKEY_ASYNC_PROPERTY_VECTOR__
@@ -2,6 +2,7 @@
 #define __BN3MONKEY_MEMORY_POOL__
 
 #include <memory>
+#include <new>
 #include <list>
 #include <vector>
 #include <deque>
@@ -24,11 +25,23 @@ namespace Bn3Monkey
 			return _impl.initialize(sizes);
         }
 
+        // Each pool starts with sizes[i] blocks and grows by adding slabs up to max_sizes[i] blocks.
+        static inline bool initialize(std::initializer_list<size_t> sizes, std::initializer_list<size_t> max_sizes, const Bn3MemoryPoolGrowth& growth)
+        {
+			return _impl.initialize(sizes, max_sizes, growth);
+        }
+
 		static inline void release()
 		{
 			_impl.release();
 		}
 
+		// Releases fully-free grown slabs of every pool right away.
+		static inline void trim()
+		{
+			_impl.trim();
+		}
+
 		template<class Type, class... Args>
         static inline Type* construct(const Bn3Tag& tag , Args... args)
 		{
@@ -72,19 +85,6 @@ namespace Bn3Monkey
 		static Bn3MemoryBlockPools<BLOCK_SIZE_POOL_LENGTH> _impl;
 	};
 
-	template<class Type, class... Args>
-	inline std::shared_ptr<Type> makeSharedFromMemoryPool(const Bn3Tag& tag, Args... args) {
-		auto* raw = Bn3MemoryPool::construct<Type>(tag, std::forward<Args>(args)...);
-		if (!raw)
-		{
-			return nullptr;
-		}
-		auto ret = std::shared_ptr<Type>(raw, [&](Type* ptr) {
-			Bn3MemoryPool::destroy(ptr);
-			});
-		return ret;
-	}
-
 	template<class Type>
 	class Bn3Allocator : public std::allocator<Type>
 	{
@@ -116,7 +116,11 @@ namespace Bn3Monkey
 
 		pointer allocate(size_type n, const void* hint = 0)
 		{
-			return Bn3MemoryPool::allocate<value_type>(_tag, n);
+			auto* ret = Bn3MemoryPool::allocate<value_type>(_tag, n);
+			// Standard containers and std::shared_ptr never expect nullptr from an allocator.
+			if (!ret)
+				throw std::bad_alloc();
+			return ret;
 		}
 		void deallocate(pointer ptr, size_type n) noexcept {
 			Bn3MemoryPool::deallocate<value_type>(ptr, n);
@@ -135,6 +139,28 @@ namespace Bn3Monkey
 		Bn3Tag _tag;
 	};
 
+	template<class Type, class... Args>
+	inline std::shared_ptr<Type> makeSharedFromMemoryPool(const Bn3Tag& tag, Args... args) {
+		auto* raw = Bn3MemoryPool::construct<Type>(tag, std::forward<Args>(args)...);
+		if (!raw)
+		{
+			return nullptr;
+		}
+		// The control block is allocated from the memory pool too.
+		// If it cannot be allocated, std::shared_ptr calls the deleter with raw before throwing.
+		try
+		{
+			auto ret = std::shared_ptr<Type>(raw, [](Type* ptr) {
+				Bn3MemoryPool::destroy(ptr);
+				}, Bn3Allocator<Type>(tag));
+			return ret;
+		}
+		catch (const std::bad_alloc&)
+		{
+			return nullptr;
+		}
+	}
+
 	class Bn3Container
 	{
 	public:
@@ -2,12 +2,16 @@
 #define __BN3MONKEY_MEMORY_POOL_IMPL__
 
 #include <mutex>
+#include <atomic>
+#include <memory>
 #include <vector>
 #include <functional>
 
 #include <string>
 #include <sstream>
 #include <cstdint>
+#include <chrono>
+#include <algorithm>
 
 #include "../Tag/Tag.hpp"
 #include "../Log/Log.hpp"
@@ -38,32 +42,40 @@ namespace Bn3Monkey
     constexpr size_t BLOCK_SIZE_POOL[] = { 64, 128, 256, 512, 1024, 2048, 4096, 8192, 16384, 0 };
     constexpr size_t BLOCK_SIZE_POOL_LENGTH = sizeof(BLOCK_SIZE_POOL) / sizeof(size_t) - 1;
     constexpr size_t MAX_BLOCK_SIZE = BLOCK_SIZE_POOL[BLOCK_SIZE_POOL_LENGTH - 1];
-    constexpr size_t HEADER_SIZE = sizeof(unsigned int) + sizeof(int) + sizeof(void*) + sizeof(Bn3Tag);
+    // A block is indexed by (slab id << SLAB_INDEX_BITS | offset in the slab).
+    constexpr size_t MAX_SLAB_COUNT = 64;
+    constexpr size_t SLAB_INDEX_BITS = 24;
+    constexpr size_t MAX_SLAB_LENGTH = size_t(1) << SLAB_INDEX_BITS;
 
-    template<size_t BlockSize>
-    struct Bn3MemoryBlock
+#ifdef BN3MONKEY_DEBUG
+    // Debug builds keep an inline header in front of each block to detect foreign or corrupted references.
+    constexpr unsigned int BLOCK_MAGIC_NUMBER = 0xFEDCBA98;
+    struct alignas(16) Bn3MemoryHeader
     {
-        constexpr static unsigned int MAGIC_NUMBER = 0xFEDCBA98;
-        struct Bn3MemoryHeader
-        {
-            const unsigned int dirty = 0xFEDCBA98;
-            Bn3Tag tag;
-            int is_allocated{ false };
-            Bn3MemoryBlock<BlockSize>* freed_ptr{ nullptr };
-        };
-
-        static_assert(HEADER_SIZE == sizeof(Bn3MemoryHeader));
+        const unsigned int dirty = BLOCK_MAGIC_NUMBER;
+        Bn3Tag tag;
+    };
+    constexpr size_t HEADER_SIZE = sizeof(Bn3MemoryHeader);
+#else
+    // Release builds keep every block information in the side table of its slab, so a payload can use the whole block.
+    constexpr size_t HEADER_SIZE = 0;
+#endif
 
+    template<size_t BlockSize>
+    struct alignas(16) Bn3MemoryBlock
+    {
         constexpr static size_t size = BlockSize;
-        constexpr static size_t header_size = sizeof(Bn3MemoryHeader);
+        constexpr static size_t header_size = HEADER_SIZE;
         constexpr static size_t content_size = BlockSize - header_size;
 
+#ifdef BN3MONKEY_DEBUG
         Bn3MemoryHeader header;
+#endif
         char content[content_size]{ 0 };
 
         static Bn3MemoryBlock<BlockSize>* getBlockReference(void* ptr)
         {
-            if ((void*)nullptr <= ptr && ptr < (void*)header_size)
+            if ((void*)nullptr <= ptr && ptr < (void*)(header_size + 1))
             {
                 LOG_E("reference is nullptr (%p)", ptr);
                 return nullptr;
@@ -71,16 +83,32 @@ namespace Bn3Monkey
 
             auto* content_ptr = reinterpret_cast<char*>(ptr);
             auto* block_ptr = content_ptr - header_size;
-            auto* block_casted_ptr = reinterpret_cast<Bn3MemoryBlock<BlockSize>*>(block_ptr);
-            if (block_casted_ptr->header.dirty != MAGIC_NUMBER)
+            return reinterpret_cast<Bn3MemoryBlock<BlockSize>*>(block_ptr);
+        }
+
+        inline bool isCorrupted()
+        {
+#ifdef BN3MONKEY_DEBUG
+            if (header.dirty != BLOCK_MAGIC_NUMBER)
             {
-                LOG_E("Reference (%p) cannot be transformed as memory block.", block_casted_ptr);
+                LOG_E("Reference (%p) cannot be transformed as memory block.", this);
                 LOG_E("Reference is not allocated by memory pool or memory header is corrupted");
-                return nullptr;
+                return true;
             }
-            return block_casted_ptr;
+#endif
+            return false;
         }
     };
+    static_assert(sizeof(Bn3MemoryBlock<64>) == 64);
+
+    // Side table entry of a block
+    struct Bn3MemoryBlockState
+    {
+        // (index + 1) of the next free block. 0 means null.
+        std::atomic<uint32_t> freed_index{ 0 };
+        std::atomic<uint8_t> is_allocated{ 0 };
+        Bn3Tag tag;
+    };
 
     template<size_t idx>
     constexpr size_t findBlockPoolIndex(size_t object_size)
@@ -117,78 +145,178 @@ namespace Bn3Monkey
     };
 
 
+    // Per-thread cache size of each block pool.
+    // A pool hands out MAGAZINE_CAPACITY blocks to each thread at most, out of a budget of 1 / MAGAZINE_BUDGET_DIVISOR of its blocks.
+    // Threads attached after the budget runs out go to the central free list directly,
+    // so that small pools don't strand their blocks inside the caches of idle threads.
+    constexpr size_t MAGAZINE_CAPACITY = 32;
+    constexpr size_t MAGAZINE_BUDGET_DIVISOR = 4;
+
+    // Growth policy of block pools.
+    // A pool whose max size is not bigger than its initial size never grows.
+    struct Bn3MemoryPoolGrowth
+    {
+        // The capacity of an exhausted pool is multiplied by growth_factor by adding a new slab.
+        double growth_factor{ 2.0 };
+        // Fully-free grown slabs are released when the pool has not grown for trim_period. 0 means no trimming.
+        std::chrono::milliseconds trim_period{ 0 };
+    };
+
     class Bn3MemoryBlockPool
     {
     public:
-        virtual bool initialize(size_t size) = 0;
+        virtual bool initialize(size_t size, size_t max_size, const Bn3MemoryPoolGrowth& growth) = 0;
         virtual void release() = 0;
+        virtual void trim() = 0;
         virtual std::string analyze() = 0;
 
         virtual void* allocate(const Bn3Tag& tag) = 0;
         virtual bool deallocate(void* ptr) = 0;
 
     protected:
+        // max_allocated is refreshed whenever a thread publishes its allocation count (refill, flush and analyze)
         size_t max_allocated{ 0 };
         size_t current_allocated{ 0 };
+        // Guards the magazine registry, the slab table and the counters above. Not used in allocate/deallocate fast path.
         std::mutex mutex;
     };
 
+    template<size_t idx>
+    class Bn3MemoryBlockIndexedPool;
+
+    // Thread local cache of free blocks in front of the central free list of a block pool.
+    // Only the owner thread touches blocks and count. allocated is read by Analyzer.
+    template<size_t idx>
+    struct Bn3MemoryBlockMagazine
+    {
+        ~Bn3MemoryBlockMagazine()
+        {
+            if (pool)
+                pool->detach(*this);
+        }
+
+        // (index + 1) of cached blocks
+        uint32_t blocks[MAGAZINE_CAPACITY]{ 0 };
+        size_t count{ 0 };
+        size_t capacity{ 0 };
+        size_t generation{ 0 };
+
+        // The number of blocks allocated minus deallocated by this thread since it was published to the pool last time.
+        std::atomic<long long> allocated{ 0 };
+
+        Bn3MemoryBlockIndexedPool<idx>* pool{ nullptr };
+        Bn3MemoryBlockMagazine* prev{ nullptr };
+        Bn3MemoryBlockMagazine* next{ nullptr };
+    };
+
+    // Contiguous blocks allocated at once and the side table of them. Blocks never move while their slab is alive.
+    template<size_t BlockSize>
+    struct Bn3MemoryBlockSlab
+    {
+        std::atomic<Bn3MemoryBlock<BlockSize>*> front{ nullptr };
+        std::atomic<Bn3MemoryBlockState*> states{ nullptr };
+        size_t length{ 0 };
+        // A trimmed slab keeps its arrays until they are deleted, but is no longer in the directory. Guarded by the mutex of the pool.
+        bool is_retired{ false };
+    };
+
     template<size_t idx>
     class Bn3MemoryBlockIndexedPool : public Bn3MemoryBlockPool
     {
     public:
-        bool initialize(size_t size) override
+        friend struct Bn3MemoryBlockMagazine<idx>;
+
+        bool initialize(size_t size, size_t max_size, const Bn3MemoryPoolGrowth& growth) override
         {
             LOG_D("Memory block pool (idx : %d / block size : %d) initialize with a size of %d", idx, block_size, size);
-            blocks.resize(size);
-
-            front = &blocks.front();
-            back = &blocks.back();
-
-            freed_ptr = front;
-            for (auto* block_ptr = front; block_ptr < back; block_ptr += 1)
+            if (size == 0 || size > MAX_SLAB_LENGTH)
             {
-                block_ptr->header.freed_ptr = block_ptr + 1;
+                LOG_E("The size of memory block pool (idx : %d / block size : %d) is invalid (%d)", idx, block_size, size);
+                return false;
             }
-            back->header.freed_ptr = nullptr;
 
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                releaseSlabs();
+                auto [first, last] = createSlab(0, size);
+                freed_head.store(makeHead(0, first), std::memory_order_relaxed);
+
+                capacity = size;
+                max_capacity = max_size > size ? max_size : size;
+                this->growth = growth;
+                last_grown_time = std::chrono::steady_clock::now();
+                last_trimmed_time = last_grown_time;
+                grown_slab_count.store(0, std::memory_order_relaxed);
+
+                magazine_budget = size / MAGAZINE_BUDGET_DIVISOR;
+                published_allocated.store(0, std::memory_order_relaxed);
+                max_published.store(0, std::memory_order_relaxed);
+                magazines = nullptr;
+                max_allocated = 0;
+                current_allocated = 0;
+            }
+            generation.fetch_add(1, std::memory_order_release);
             return true;
         }
 
         void release() override {
-            blocks.clear();
-            freed_ptr = nullptr;
-            front = nullptr;
-            back = nullptr;
+            generation.fetch_add(1, std::memory_order_release);
+
+            std::lock_guard<std::mutex> lock(mutex);
+            magazines = nullptr;
+            releaseSlabs();
+            capacity = 0;
+            max_capacity = 0;
+        }
+
+        void trim() override
+        {
+            // The blocks cached by the calling thread don't keep their slabs alive.
+            auto& magazine = getMagazine();
+            std::lock_guard<std::mutex> lock(mutex);
+            returnCached(magazine);
+            trimSlabs(std::chrono::steady_clock::now());
         }
 
         std::string analyze() override
         {
             std::stringstream ss;
+            std::lock_guard<std::mutex> lock(mutex);
+            updateAllocated();
+
             ss << "- Memory Block Pool (" << idx << " / " << block_size << ") - \n";
+            ss << "    Capacity : " << capacity << " / " << max_capacity << "\n";
+            ss << "    Current allocated : " << current_allocated << "\n";
             ss << "    Max allocated : " << max_allocated << "\n\n";
 
-            size_t start_idx = freed_ptr - front;
+            uint32_t start_ref = static_cast<uint32_t>(freed_head.load(std::memory_order_acquire) & 0xFFFFFFFF);
 
-            for (size_t i = 0; i < blocks.size(); i++)
+            for (size_t slab_id = 0; slab_id < MAX_SLAB_COUNT; slab_id++)
             {
-                auto& block = blocks[i];
-                auto& is_allocated = block.header.is_allocated;
-                auto tag = block.header.tag.str();
-
-                if (start_idx == i)
-                    ss << "S";
-                else
-                    ss << " ";
-                ss << "   (" << i << ") : " << (is_allocated ? "O" : "X") << " [" << tag << "] ";
+                auto& slab = slabs[slab_id];
+                auto* states = slab.states.load(std::memory_order_acquire);
+                if (states == nullptr || slab.is_retired)
+                    continue;
 
-                auto freed_ptr = block.header.freed_ptr;
-                if (freed_ptr == nullptr)
-                    ss << " -> null\n";
-                else
+                for (size_t i = 0; i < slab.length; i++)
                 {
-                    auto next_i = freed_ptr - front;
-                    ss << " -> " << next_i << "\n";
+                    auto& state = states[i];
+                    auto is_allocated = state.is_allocated.load(std::memory_order_relaxed);
+                    auto tag = state.tag.str();
+
+                    if (start_ref == makeReference(slab_id, i))
+                        ss << "S";
+                    else
+                        ss << " ";
+                    ss << "   (" << slab_id << ":" << i << ") : " << (is_allocated ? "O" : "X") << " [" << tag << "] ";
+
+                    auto freed_index = state.freed_index.load(std::memory_order_relaxed);
+                    if (freed_index == 0)
+                        ss << " -> null\n";
+                    else
+                    {
+                        ss << " -> " << slabOf(freed_index) << ":" << offsetOf(freed_index) << "\n";
+                    }
                 }
             }
             ss << "\n";
@@ -197,74 +325,524 @@ namespace Bn3Monkey
 
         void* allocate(const Bn3Tag& tag) override
         {
-            Bn3MemoryBlock<block_size>* ret{ nullptr };
-            {
-                std::lock_guard<std::mutex> lock(mutex);
+            auto& magazine = getMagazine();
 
-
-                if (freed_ptr == nullptr)
+            uint32_t ref{ 0 };
+            if (magazine.count > 0)
+            {
+                ref = magazine.blocks[--magazine.count];
+                count(magazine, 1);
+            }
+            else
+            {
+                ref = refill(magazine);
+                if (ref == 0)
                 {
                     LOG_E("The capacity of memory block pool (idx : %d / block size : %d) has been exceeded", idx, block_size);
                     return nullptr;
                 }
+            }
 
-                current_allocated += 1;
-                if (current_allocated > max_allocated)
-                    max_allocated = current_allocated;
-
-
-                ret = freed_ptr;
-                auto* next_freed_ptr = freed_ptr->header.freed_ptr;
-                freed_ptr->header.freed_ptr = nullptr;
-                freed_ptr = next_freed_ptr;
+            auto& state = stateOf(ref);
+            state.freed_index.store(0, std::memory_order_relaxed);
+            state.is_allocated.store(1, std::memory_order_relaxed);
+            state.tag = tag;
 
-                ret->header.is_allocated = true;
-                ret->header.tag = tag;
-            }
+            auto* block = blockOf(ref);
+            FOR_DEBUG(block->header.tag = tag);
 
-            auto* ptr = ret->content;
-            LOG_D("Memory block pool (idx : %d / block size : %d) allocates %d", idx, block_size, ret - front);
-            return ptr;
+            LOG_D("Memory block pool (idx : %d / block size : %d) allocates %d:%d", idx, block_size, slabOf(ref), offsetOf(ref));
+            return block->content;
         }
 
         bool deallocate(void* ptr) override
         {
-            auto* block_ptr = Bn3MemoryBlock<block_size>::getBlockReference(ptr);
-            if (block_ptr < front || back < block_ptr)
+            auto* block_ptr = Block::getBlockReference(ptr);
+            uint32_t ref = findReference(block_ptr);
+            if (ref == 0)
             {
                 LOG_E("This reference (%p) is not from memory block pool (idx : %d / block size : %d)", ptr, idx, block_size);
                 return false;
             }
+            if (block_ptr->isCorrupted())
+                return false;
+
+            auto& state = stateOf(ref);
+#ifdef BN3MONKEY_DEBUG
+            // Only one of concurrent deallocations of the same block clears the flag. The others are rejected.
+            bool is_allocated = state.is_allocated.exchange(0, std::memory_order_acq_rel) != 0;
+#else
+            // Checked without a read-modify-write. Debug builds also catch concurrent deallocations of the same block.
+            bool is_allocated = state.is_allocated.load(std::memory_order_relaxed) != 0;
+            state.is_allocated.store(0, std::memory_order_relaxed);
+#endif
+            if (!is_allocated)
             {
-                std::lock_guard<std::mutex> lock(mutex);
-                if (block_ptr->header.is_allocated == false)
+                LOG_E("This reference (%d:%d) is already deallocated", slabOf(ref), offsetOf(ref));
+                return false;
+            }
+
+            state.tag.clear();
+            FOR_DEBUG(block_ptr->header.tag.clear());
+
+            auto& magazine = getMagazine();
+            if (magazine.count < magazine.capacity)
+            {
+                magazine.blocks[magazine.count++] = ref;
+                count(magazine, -1);
+            }
+            else
+            {
+                flush(magazine, ref);
+            }
+
+            LOG_D("Memory block pool (idx : %d / block size : %d) deallocates %d:%d", idx, block_size, slabOf(ref), offsetOf(ref));
+            return true;
+        }
+
+    private:
+        constexpr static size_t block_size = BLOCK_SIZE_POOL[idx];
+        using Block = Bn3MemoryBlock<block_size>;
+        using Slab = Bn3MemoryBlockSlab<block_size>;
+        using Magazine = Bn3MemoryBlockMagazine<idx>;
+
+        // A reference is (block index + 1) so that 0 can mean null.
+        inline static uint32_t makeReference(size_t slab_id, size_t offset) { return static_cast<uint32_t>((slab_id << SLAB_INDEX_BITS) | offset) + 1; }
+        inline static size_t slabOf(uint32_t ref) { return (ref - 1) >> SLAB_INDEX_BITS; }
+        inline static size_t offsetOf(uint32_t ref) { return (ref - 1) & (MAX_SLAB_LENGTH - 1); }
+
+        // The head of the central free list is (ABA tag << 32 | reference).
+        inline static uint64_t makeHead(uint64_t old_head, uint32_t ref)
+        {
+            return (((old_head >> 32) + 1) << 32) | ref;
+        }
+        inline static uint32_t referenceOf(uint64_t head)
+        {
+            return static_cast<uint32_t>(head & 0xFFFFFFFF);
+        }
+
+        // O(1) lookup of a block and its side table entry from its reference
+        inline Block* blockOf(uint32_t ref)
+        {
+            return slabs[slabOf(ref)].front.load(std::memory_order_acquire) + offsetOf(ref);
+        }
+        inline Bn3MemoryBlockState& stateOf(uint32_t ref)
+        {
+            return slabs[slabOf(ref)].states.load(std::memory_order_acquire)[offsetOf(ref)];
+        }
+
+        // O(log slabs) lookup of the reference of a block from its address. Returns 0 if the block is not from this pool.
+        uint32_t findReference(Block* block)
+        {
+            if (block == nullptr)
+                return 0;
+
+            auto address = reinterpret_cast<uintptr_t>(block);
+            size_t slab_id{ MAX_SLAB_COUNT };
+            for (;;)
+            {
+                uint32_t sequence = directory_sequence.load(std::memory_order_acquire);
+                if (sequence & 1)
+                    continue;
+
+                size_t low = 0;
+                size_t high = directory_length.load(std::memory_order_relaxed);
+                while (low < high)
                 {
-                    LOG_E("This reference (%d) is already deallocated", block_ptr - front);
-                    return false;
+                    size_t mid = (low + high) / 2;
+                    if (directory_fronts[mid].load(std::memory_order_relaxed) <= address)
+                        low = mid + 1;
+                    else
+                        high = mid;
                 }
+                slab_id = low == 0 ? MAX_SLAB_COUNT : directory_ids[low - 1].load(std::memory_order_relaxed);
+
+                std::atomic_thread_fence(std::memory_order_acquire);
+                if (directory_sequence.load(std::memory_order_relaxed) == sequence)
+                    break;
+            }
+            if (slab_id >= MAX_SLAB_COUNT)
+                return 0;
+
+            auto& slab = slabs[slab_id];
+            auto* front = slab.front.load(std::memory_order_acquire);
+            if (front == nullptr || block < front || front + slab.length <= block)
+                return 0;
+            if ((address - reinterpret_cast<uintptr_t>(front)) % sizeof(Block) != 0)
+                return 0;
+            return makeReference(slab_id, block - front);
+        }
+
+        // Must be called with mutex locked. Rebuilds the address-ordered slab directory.
+        void updateDirectory()
+        {
+            size_t ids[MAX_SLAB_COUNT];
+            size_t length = 0;
+            for (size_t slab_id = 0; slab_id < MAX_SLAB_COUNT; slab_id++)
+            {
+                if (slabs[slab_id].front.load(std::memory_order_relaxed) != nullptr && !slabs[slab_id].is_retired)
+                    ids[length++] = slab_id;
+            }
+            std::sort(ids, ids + length, [&](size_t lhs, size_t rhs) {
+                return slabs[lhs].front.load(std::memory_order_relaxed) < slabs[rhs].front.load(std::memory_order_relaxed);
+                });
+
+            uint32_t sequence = directory_sequence.load(std::memory_order_relaxed);
+            directory_sequence.store(sequence + 1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+            for (size_t i = 0; i < length; i++)
+            {
+                directory_fronts[i].store(reinterpret_cast<uintptr_t>(slabs[ids[i]].front.load(std::memory_order_relaxed)), std::memory_order_relaxed);
+                directory_ids[i].store(ids[i], std::memory_order_relaxed);
+            }
+            directory_length.store(length, std::memory_order_relaxed);
+            directory_sequence.store(sequence + 2, std::memory_order_release);
+        }
 
-                current_allocated -= 1;
+        // Lock-free pop from the central free list.
+        uint32_t pop()
+        {
+            uint64_t head = freed_head.load(std::memory_order_acquire);
+            for (;;)
+            {
+                uint32_t ref = referenceOf(head);
+                if (ref == 0)
+                    return 0;
+                uint32_t next = stateOf(ref).freed_index.load(std::memory_order_relaxed);
+                if (freed_head.compare_exchange_weak(head, makeHead(head, next), std::memory_order_acquire, std::memory_order_acquire))
+                    return ref;
+            }
+        }
+        // Lock-free push of the list (first -> ... -> last) to the central free list.
+        void push(uint32_t first, uint32_t last)
+        {
+            auto& last_state = stateOf(last);
+            uint64_t head = freed_head.load(std::memory_order_relaxed);
+            do
+            {
+                last_state.freed_index.store(referenceOf(head), std::memory_order_relaxed);
+            } while (!freed_head.compare_exchange_weak(head, makeHead(head, first), std::memory_order_release, std::memory_order_relaxed));
+        }
 
-                block_ptr->header.is_allocated = false;
-                block_ptr->header.tag.clear();
+        inline Magazine& getMagazine()
+        {
+            static thread_local Magazine magazine;
+            if (magazine.generation != generation.load(std::memory_order_acquire))
+                attach(magazine);
+            return magazine;
+        }
 
-                block_ptr->header.freed_ptr = freed_ptr;
-                freed_ptr = block_ptr;
+        // Counting is done by the owner thread only, so it doesn't need any read-modify-write operation.
+        inline void count(Magazine& magazine, long long value)
+        {
+            magazine.allocated.store(magazine.allocated.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+        }
 
+        void publish(Magazine& magazine)
+        {
+            long long value = magazine.allocated.exchange(0, std::memory_order_relaxed);
+            long long allocated = published_allocated.fetch_add(value, std::memory_order_relaxed) + value;
+            long long max_value = max_published.load(std::memory_order_relaxed);
+            while (allocated > max_value && !max_published.compare_exchange_weak(max_value, allocated, std::memory_order_relaxed))
+            {
             }
+        }
 
-            LOG_D("Memory block pool (idx : %d / block size : %d) deallocates %d", idx, block_size, block_ptr - front);
-            return true;
+        uint32_t refill(Magazine& magazine)
+        {
+            auto ret = pop();
+            if (ret == 0)
+            {
+                ret = grow();
+                if (ret == 0)
+                    return 0;
+            }
+
+            size_t refill_count = magazine.capacity / 2;
+            while (magazine.count < refill_count)
+            {
+                auto ref = pop();
+                if (ref == 0)
+                    break;
+                magazine.blocks[magazine.count++] = ref;
+            }
+
+            count(magazine, 1);
+            publish(magazine);
+            return ret;
         }
 
-    private:
-        constexpr static size_t block_size = BLOCK_SIZE_POOL[idx];
+        void flush(Magazine& magazine, uint32_t ref)
+        {
+            // Return the given block and a half of the magazine to the central free list at once.
+            uint32_t first = ref;
+            uint32_t last = ref;
+            size_t flush_count = magazine.capacity / 2;
+            for (size_t i = 0; i < flush_count; i++)
+            {
+                auto next = magazine.blocks[--magazine.count];
+                stateOf(last).freed_index.store(next, std::memory_order_relaxed);
+                last = next;
+            }
+            push(first, last);
+
+            count(magazine, -1);
+            publish(magazine);
+
+            tryTrim();
+        }
+
+        void attach(Magazine& magazine)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            // The blocks of the previous generation are already released with the pool.
+            magazine.count = 0;
+            magazine.allocated.store(0, std::memory_order_relaxed);
+            magazine.capacity = std::min(MAGAZINE_CAPACITY, magazine_budget);
+            magazine_budget -= magazine.capacity;
+            magazine.generation = generation.load(std::memory_order_acquire);
+            magazine.pool = this;
+
+            magazine.prev = nullptr;
+            magazine.next = magazines;
+            if (magazines)
+                magazines->prev = &magazine;
+            magazines = &magazine;
+        }
+
+        void detach(Magazine& magazine)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (magazine.generation != generation.load(std::memory_order_acquire))
+                return;
+
+            returnCached(magazine);
+            publish(magazine);
+            magazine_budget += magazine.capacity;
+            magazine.capacity = 0;
+
+            if (magazine.prev)
+                magazine.prev->next = magazine.next;
+            else
+                magazines = magazine.next;
+            if (magazine.next)
+                magazine.next->prev = magazine.prev;
+            magazine.pool = nullptr;
+        }
+
+        // Must be called with mutex locked by the owner thread of magazine. Returns its cached blocks to the central free list.
+        void returnCached(Magazine& magazine)
+        {
+            if (magazine.count == 0)
+                return;
+            for (size_t i = 0; i + 1 < magazine.count; i++)
+                stateOf(magazine.blocks[i]).freed_index.store(magazine.blocks[i + 1], std::memory_order_relaxed);
+            push(magazine.blocks[0], magazine.blocks[magazine.count - 1]);
+            magazine.count = 0;
+        }
+
+        // Must be called with mutex locked.
+        void updateAllocated()
+        {
+            long long allocated = published_allocated.load(std::memory_order_relaxed);
+            for (auto* magazine = magazines; magazine; magazine = magazine->next)
+                allocated += magazine->allocated.load(std::memory_order_relaxed);
+            current_allocated = allocated < 0 ? 0 : static_cast<size_t>(allocated);
+
+            long long max_value = max_published.load(std::memory_order_relaxed);
+            if (max_value > 0 && static_cast<size_t>(max_value) > max_allocated)
+                max_allocated = static_cast<size_t>(max_value);
+            if (current_allocated > max_allocated)
+                max_allocated = current_allocated;
+        }
+
+        // Must be called with mutex locked. Returns the first and last block of the slab which are linked in order.
+        std::pair<uint32_t, uint32_t> createSlab(size_t slab_id, size_t length)
+        {
+            auto* front = new Block[length];
+            auto* states = new Bn3MemoryBlockState[length];
+            for (size_t i = 0; i + 1 < length; i++)
+            {
+                states[i].freed_index.store(makeReference(slab_id, i + 1), std::memory_order_relaxed);
+            }
+
+            auto& slab = slabs[slab_id];
+            slab.length = length;
+            slab.states.store(states, std::memory_order_release);
+            slab.front.store(front, std::memory_order_release);
+            updateDirectory();
+            return { makeReference(slab_id, 0), makeReference(slab_id, length - 1) };
+        }
 
-        std::vector<Bn3MemoryBlock<block_size>> blocks;
-        Bn3MemoryBlock<block_size>* freed_ptr;
+        // Adds a new slab when the pool is exhausted. Live blocks never move.
+        uint32_t grow()
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+
+            // Another thread may have grown the pool or returned blocks in the meantime.
+            if (auto ref = pop())
+                return ref;
+            if (capacity >= max_capacity)
+                return 0;
+
+            // A retired slab keeps its id until it is deleted.
+            size_t slab_id = 1;
+            while (slab_id < MAX_SLAB_COUNT && slabs[slab_id].front.load(std::memory_order_relaxed) != nullptr)
+                slab_id++;
+            if (slab_id == MAX_SLAB_COUNT)
+            {
+                LOG_E("Memory block pool (idx : %d / block size : %d) cannot have more slabs", idx, block_size);
+                return 0;
+            }
+
+            size_t length = static_cast<size_t>(static_cast<double>(capacity) * (growth.growth_factor - 1.0));
+            if (length == 0)
+                length = 1;
+            if (length > max_capacity - capacity)
+                length = max_capacity - capacity;
+            if (length > MAX_SLAB_LENGTH)
+                length = MAX_SLAB_LENGTH;
+
+            LOG_D("Memory block pool (idx : %d / block size : %d) grows by %d", idx, block_size, length);
+            auto [first, last] = createSlab(slab_id, length);
+            if (first != last)
+                push(first + 1, last);
+
+            capacity += length;
+            last_grown_time = std::chrono::steady_clock::now();
+            grown_slab_count.fetch_add(1, std::memory_order_relaxed);
+            return first;
+        }
+
+        void tryTrim()
+        {
+            if (growth.trim_period.count() == 0 || grown_slab_count.load(std::memory_order_relaxed) == 0)
+                return;
+
+            auto now = std::chrono::steady_clock::now();
+            std::unique_lock<std::mutex> lock(mutex, std::try_to_lock);
+            if (!lock.owns_lock())
+                return;
+            if (now - last_grown_time < growth.trim_period || now - last_trimmed_time < growth.trim_period)
+                return;
+            trimSlabs(now);
+        }
+
+        // Must be called with mutex locked.
+        // Releases grown slabs whose blocks are all in the central free list.
+        // A released slab is only removed from the directory, and its arrays stay reachable through slabs[] until the next trim,
+        // because a concurrent pop() which loaded the head before the list was detached may still read the link of one of its blocks.
+        void trimSlabs(std::chrono::steady_clock::time_point now)
+        {
+            releaseRetiredSlabs();
+            last_trimmed_time = now;
+            if (grown_slab_count.load(std::memory_order_relaxed) == 0)
+                return;
+
+            uint64_t head = freed_head.load(std::memory_order_acquire);
+            while (!freed_head.compare_exchange_weak(head, makeHead(head, 0), std::memory_order_acq_rel, std::memory_order_acquire))
+            {
+            }
+
+            size_t free_counts[MAX_SLAB_COUNT]{ 0 };
+            for (auto ref = referenceOf(head); ref; ref = stateOf(ref).freed_index.load(std::memory_order_relaxed))
+                free_counts[slabOf(ref)] += 1;
 
-        Bn3MemoryBlock<block_size>* front;
-        Bn3MemoryBlock<block_size>* back;
+            bool is_trimmed[MAX_SLAB_COUNT]{ false };
+            for (size_t slab_id = 1; slab_id < MAX_SLAB_COUNT; slab_id++)
+            {
+                auto& slab = slabs[slab_id];
+                is_trimmed[slab_id] = slab.front.load(std::memory_order_relaxed) != nullptr && !slab.is_retired && free_counts[slab_id] == slab.length;
+            }
+
+            uint32_t first{ 0 };
+            uint32_t last{ 0 };
+            for (auto ref = referenceOf(head); ref;)
+            {
+                auto next = stateOf(ref).freed_index.load(std::memory_order_relaxed);
+                if (!is_trimmed[slabOf(ref)])
+                {
+                    if (last)
+                        stateOf(last).freed_index.store(ref, std::memory_order_relaxed);
+                    else
+                        first = ref;
+                    last = ref;
+                }
+                ref = next;
+            }
+            if (first)
+                push(first, last);
+
+            bool is_changed{ false };
+            for (size_t slab_id = 1; slab_id < MAX_SLAB_COUNT; slab_id++)
+            {
+                if (!is_trimmed[slab_id])
+                    continue;
+                auto& slab = slabs[slab_id];
+                LOG_D("Memory block pool (idx : %d / block size : %d) trims slab %d", idx, block_size, slab_id);
+                slab.is_retired = true;
+                retired_slab_ids[retired_slab_count++] = slab_id;
+                capacity -= slab.length;
+                grown_slab_count.fetch_sub(1, std::memory_order_relaxed);
+                is_changed = true;
+            }
+            if (is_changed)
+                updateDirectory();
+        }
+
+        // Must be called with mutex locked.
+        void releaseSlabs()
+        {
+            freed_head.store(0, std::memory_order_relaxed);
+            releaseRetiredSlabs();
+            for (auto& slab : slabs)
+            {
+                delete[] slab.front.exchange(nullptr, std::memory_order_acq_rel);
+                delete[] slab.states.exchange(nullptr, std::memory_order_acq_rel);
+                slab.length = 0;
+            }
+            grown_slab_count.store(0, std::memory_order_relaxed);
+            updateDirectory();
+        }
+
+        // Must be called with mutex locked.
+        void releaseRetiredSlabs()
+        {
+            for (size_t i = 0; i < retired_slab_count; i++)
+            {
+                auto& slab = slabs[retired_slab_ids[i]];
+                delete[] slab.front.exchange(nullptr, std::memory_order_acq_rel);
+                delete[] slab.states.exchange(nullptr, std::memory_order_acq_rel);
+                slab.length = 0;
+                slab.is_retired = false;
+            }
+            retired_slab_count = 0;
+        }
+
+        Slab slabs[MAX_SLAB_COUNT];
+        size_t retired_slab_ids[MAX_SLAB_COUNT]{ 0 };
+        size_t retired_slab_count{ 0 };
+        std::atomic<uint64_t> freed_head{ 0 };
+
+        // Slab directory ordered by address, guarded by a sequence lock.
+        std::atomic<uint32_t> directory_sequence{ 0 };
+        std::atomic<size_t> directory_length{ 0 };
+        std::atomic<uintptr_t> directory_fronts[MAX_SLAB_COUNT]{};
+        std::atomic<size_t> directory_ids[MAX_SLAB_COUNT]{};
+
+        size_t capacity{ 0 };
+        size_t max_capacity{ 0 };
+        Bn3MemoryPoolGrowth growth;
+        std::chrono::steady_clock::time_point last_grown_time;
+        std::chrono::steady_clock::time_point last_trimmed_time;
+        std::atomic<size_t> grown_slab_count{ 0 };
+
+        std::atomic<size_t> generation{ 0 };
+        // Magazine capacity which is not handed out yet. Guarded by mutex.
+        size_t magazine_budget{ 0 };
+        Magazine* magazines{ nullptr };
+        std::atomic<long long> published_allocated{ 0 };
+        std::atomic<long long> max_published{ 0 };
     };
 
     template<size_t idx>
@@ -329,11 +907,35 @@ namespace Bn3Monkey
             size_t idx = 0;
             for (auto& size : sizes)
             {
-                if (!_pools[idx++]->initialize(size))
+                if (!_pools[idx++]->initialize(size, size, Bn3MemoryPoolGrowth()))
+                    return false;
+            }
+            return true;
+        }
+
+        bool initialize(std::initializer_list<size_t> sizes, std::initializer_list<size_t> max_sizes, const Bn3MemoryPoolGrowth& growth)
+        {
+            LOG_D("Memory Block Pools Initialize (growable)");
+            if (sizes.size() != max_sizes.size())
+                return false;
+
+            size_t idx = 0;
+            auto max_size = max_sizes.begin();
+            for (auto& size : sizes)
+            {
+                if (!_pools[idx++]->initialize(size, *max_size++, growth))
                     return false;
             }
             return true;
         }
+
+        void trim()
+        {
+            for (auto* pool : _pools)
+            {
+                pool->trim();
+            }
+        }
         void release()
         {
             LOG_D("Memory Block Pools release");
@@ -24,6 +24,29 @@ ScopedTaskScope::ScopedTaskScope(const Bn3Tag& scope_name) : _impl(getScope(scop
 {
 }
 
+ScopedTaskTimer ScopedTaskScope::schedule(ScopedTaskTimerHandle timer, std::chrono::steady_clock::time_point launch_time)
+{
+    assert(looper_scheduler != nullptr);
+
+    if (!timer)
+    {
+        LOG_E("Timer cannot be allocated");
+        return ScopedTaskTimer();
+    }
+    looper_scheduler->addTimer(timer, launch_time);
+    return ScopedTaskTimer(std::move(timer));
+}
+
+bool ScopedTaskTimer::cancel()
+{
+    if (!_impl || !_impl->cancel())
+        return false;
+    // Frees the slot in the heap now rather than when it would have fired.
+    if (looper_scheduler)
+        looper_scheduler->removeTimer(*_impl.get());
+    return true;
+}
+
 ScopedTaskLooperImpl& ScopedTaskLooper::getLooper(const Bn3Tag& looper_name)
 {
     assert(looper_scheduler != nullptr);
@@ -36,9 +59,82 @@ ScopedTaskLooper::ScopedTaskLooper(const Bn3Tag& looper_name) : _impl(getLooper(
 
 }
 
-bool ScopedTaskRunner::initialize()
+// Shared by the continuations of joined results. Freed by the last of them.
+struct ScopedTaskJoinState
+{
+    std::atomic<size_t> remaining{ 0 };
+    std::atomic<size_t> finished{ 0 };
+    std::atomic<bool> is_notified{ false };
+    bool is_any{ false };
+    ScopedTaskResultHandle<size_t> result;
+};
+
+static void onJoinedResultCompleted(ScopedTaskJoinState* join, size_t idx, ScopedTaskState state)
+{
+    if (ScopedTaskState::FINISHED == state)
+    {
+        join->finished.fetch_add(1, std::memory_order_relaxed);
+        if (join->is_any && !join->is_notified.exchange(true, std::memory_order_acq_rel))
+            join->result->notify(idx);
+    }
+
+    if (join->remaining.fetch_sub(1, std::memory_order_acq_rel) != 1)
+        return;
+
+    if (!join->is_any)
+        join->result->notify(join->finished.load(std::memory_order_relaxed));
+    else if (!join->is_notified.exchange(true, std::memory_order_acq_rel))
+        join->result->cancel();
+    Bn3MemoryPool::destroy(join);
+}
+
+ScopedTaskResultHandle<size_t> ScopedTaskJoin::join(ScopedTaskResultBase** impls, size_t count, bool is_any)
+{
+    static const Bn3Tag any_tag("when_any");
+    static const Bn3Tag all_tag("when_all");
+    const Bn3Tag& tag = is_any ? any_tag : all_tag;
+    auto ret = ScopedTaskResultHandle<size_t>::make(tag);
+    if (!ret)
+        return ret;
+
+    if (count == 0)
+    {
+        if (is_any)
+            ret->cancel();
+        else
+            ret->notify(size_t(0));
+        return ret;
+    }
+
+    auto* join = Bn3MemoryPool::construct<ScopedTaskJoinState>(tag);
+    if (!join)
+    {
+        LOG_E("Cannot join task results");
+        ret->cancel();
+        return ret;
+    }
+    join->remaining.store(count, std::memory_order_relaxed);
+    join->is_any = is_any;
+    join->result = ret;
+
+    for (size_t idx = 0; idx < count; idx++)
+    {
+        // A result without a task counts as cancelled.
+        if (!impls[idx])
+        {
+            onJoinedResultCompleted(join, idx, ScopedTaskState::CANCELLED);
+            continue;
+        }
+        impls[idx]->setContinuation([join, idx](ScopedTaskState state) {
+            onJoinedResultCompleted(join, idx, state);
+            });
+    }
+    return ret;
+}
+
+bool ScopedTaskRunner::initialize(ScopedTaskExecution execution, size_t worker_count)
 {
-    scope_pool = MAKE_SHARED(ScopedTaskScopeImplPool, Bn3Tag("global_scope_pools"));
+    scope_pool = MAKE_SHARED(ScopedTaskScopeImplPool, Bn3Tag("global_scope_pools"), execution, worker_count);
     if (!scope_pool)
         return false;
 
@@ -51,10 +147,11 @@ bool ScopedTaskRunner::initialize()
 }
 void ScopedTaskRunner::release()
 {
-
+    // Scopes are released before the scheduler is destroyed, because queued ticks refer to it.
     looper_scheduler->stop();
-    looper_scheduler.reset();
 
     scope_pool->release();
-    scope_pool.reset();    
+    scope_pool.reset();
+
+    looper_scheduler.reset();
 }
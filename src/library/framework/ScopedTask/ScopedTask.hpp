@@ -6,6 +6,7 @@
 #include "ScopedTaskImpl.hpp"
 #include "ScopedTaskScopeImpl.hpp"
 #include "ScopedTaskLooperImpl.hpp"
+#include "ScopedTaskCoroutine.hpp"
 
 
 namespace Bn3Monkey
@@ -15,6 +16,7 @@ namespace Bn3Monkey
     class ScopedTaskScope;
     class ScopedTaskLooper;
     class ScopedTaskRunner;
+    class ScopedTaskJoin;
 
 
     template<class ReturnType>
@@ -22,11 +24,13 @@ namespace Bn3Monkey
     {
     public: 
         ScopedTaskResult() {}
-        ReturnType* wait()
+        // Returns nullptr (false for void) if the task is cancelled.
+        auto wait()
         {
-            if (_impl)
-                return _impl->wait();
-            return nullptr;
+            if constexpr (std::is_void_v<ReturnType>)
+                return _impl ? _impl->wait() : false;
+            else
+                return _impl ? _impl->wait() : nullptr;
         }
         ScopedTaskResult(const ScopedTaskResult& other) = delete;
         ScopedTaskResult(ScopedTaskResult&& other) : _impl(std::move(other._impl))
@@ -34,32 +38,82 @@ namespace Bn3Monkey
         }
         ScopedTaskResult& operator=(ScopedTaskResult&& other)
         {
-            _impl = other._impl;
+            _impl = std::move(other._impl);
             return *this;
         }
 
+        // Calls func(value) on scope once this task finishes, without blocking any thread. func() if ReturnType is void.
+        // This result is consumed. The continuation is cancelled if this task is cancelled.
+        template<class Func>
+        auto then(const ScopedTaskScope& scope, const Bn3Tag& task_name, Func&& func);
+
+#ifdef BN3MONKEY_SCOPED_TASK_COROUTINE
+        // co_await scope.call(...) suspends the coroutine instead of blocking. This result is consumed.
+        ScopedTaskResultAwaiter<ReturnType> operator co_await() &&
+        {
+            return ScopedTaskResultAwaiter<ReturnType>(std::move(_impl));
+        }
+#endif
+
     private:
         friend class ScopedTaskScope;
+        friend class ScopedTaskJoin;
+        template<class Type>
+        friend class ScopedTaskResult;
 
-        ScopedTaskResult(std::shared_ptr<ScopedTaskResultImpl<ReturnType>> impl) : _impl(std::move(impl))
+        ScopedTaskResult(ScopedTaskResultHandle<ReturnType> impl) : _impl(std::move(impl))
         {
         }
-        std::shared_ptr<ScopedTaskResultImpl<ReturnType>> _impl;
+        ScopedTaskResultHandle<ReturnType> _impl;
+    };
+
+    // Handle of a task run by ScopedTaskScope::runAfter or runAt
+    class ScopedTaskTimer
+    {
+    public:
+        ScopedTaskTimer() {}
+
+        // False if the timer could not be scheduled
+        explicit operator bool() const { return static_cast<bool>(_impl); }
+        // Returns true if the task is cancelled before it starts.
+        bool cancel();
+        // True until the task starts or is cancelled
+        bool isPending() const
+        {
+            return _impl && _impl->state() == ScopedTaskTimerImpl::State::SCHEDULED;
+        }
+        // True if the task will never run, because it is cancelled or the scope refused it
+        bool isCancelled() const
+        {
+            return _impl && _impl->state() == ScopedTaskTimerImpl::State::CANCELLED;
+        }
+
+    private:
+        friend class ScopedTaskScope;
+        ScopedTaskTimer(ScopedTaskTimerHandle impl) : _impl(std::move(impl)) {}
+        ScopedTaskTimerHandle _impl;
     };
 
     class ScopedTaskScope
     {
     public:
         friend class ScopedTaskLooper;
+        template<class Type>
+        friend class ScopedTaskResult;
 
         ScopedTaskScope(const Bn3Tag& scope_name = Bn3Tag("main"));
         ScopedTaskScope(const ScopedTaskScope& other) : _impl(other._impl) {}
+
+        // Scopes of the same name share one queue.
+        bool operator==(const ScopedTaskScope& other) const { return &_impl == &other._impl; }
+        bool operator!=(const ScopedTaskScope& other) const { return &_impl != &other._impl; }
         
 
+        // Returns whether the task is queued, or why it is cancelled.
         template<class Func, class... Args>
-        void run(const Bn3Tag& task_name, Func&& func, Args&&... args)
+        ScopedTaskRunStatus run(const Bn3Tag& task_name, Func&& func, Args&&... args)
         {
-            _impl.run(task_name, std::forward<Func>(func), std::forward<Args>(args)...);
+            return _impl.run(task_name, std::forward<Func>(func), std::forward<Args>(args)...);
         }
 
         template<class Func, class... Args>
@@ -71,12 +125,141 @@ namespace Bn3Monkey
             return ScopedTaskResult(std::move(_result));
         }
 
+        // Tasks of a higher priority run ahead of the ones queued in lower lanes.
+        template<class Func, class... Args>
+        ScopedTaskRunStatus run(ScopedTaskPriority priority, const Bn3Tag& task_name, Func&& func, Args&&... args)
+        {
+            return _impl.run(priority, task_name, std::forward<Func>(func), std::forward<Args>(args)...);
+        }
+
+        template<class Func, class... Args>
+        auto call(ScopedTaskPriority priority, const Bn3Tag& task_name, Func&& func, Args&&... args) -> ScopedTaskResult<std::result_of_t<Func(Args...)>>
+        {
+            return ScopedTaskResult(_impl.call(priority, task_name, std::forward<Func>(func), std::forward<Args>(args)...));
+        }
+
+        // Tasks pushed to a lane holding capacity tasks are cancelled. 0 means no limit.
+        void setLaneCapacity(ScopedTaskPriority priority, size_t capacity)
+        {
+            _impl.setLaneCapacity(priority, capacity);
+        }
+
+        // Bounds the number of queued tasks of all lanes. 0 means no limit.
+        void setCapacity(size_t capacity, ScopedTaskCapacityPolicy policy = ScopedTaskCapacityPolicy::BLOCK)
+        {
+            _impl.setCapacity(capacity, policy);
+        }
+
+        // Runs the task once after delay. It takes a slot of the looper scheduler only until it fires or is cancelled.
+        template<class Rep, class Period, class Func, class... Args>
+        ScopedTaskTimer runAfter(std::chrono::duration<Rep, Period> delay, const Bn3Tag& task_name, Func&& func, Args&&... args)
+        {
+            auto launch_time = std::chrono::steady_clock::now() + std::chrono::duration_cast<std::chrono::steady_clock::duration>(delay);
+            return runAt(launch_time, task_name, std::forward<Func>(func), std::forward<Args>(args)...);
+        }
+
+        template<class Func, class... Args>
+        ScopedTaskTimer runAt(std::chrono::steady_clock::time_point launch_time, const Bn3Tag& task_name, Func&& func, Args&&... args)
+        {
+            auto timer = ScopedTaskTimerHandle::make(task_name, _impl, std::bind(std::forward<Func>(func), std::forward<Args>(args)...));
+            return schedule(std::move(timer), launch_time);
+        }
+
+#ifdef BN3MONKEY_SCOPED_TASK_COROUTINE
+        // co_await scope.schedule() continues the coroutine on this scope.
+        ScopedTaskScheduleAwaiter schedule() const
+        {
+            return ScopedTaskScheduleAwaiter(_impl);
+        }
+#endif
+
 
     private:
         ScopedTaskScopeImpl& getScope(const Bn3Tag& scope_name);
+        static ScopedTaskTimer schedule(ScopedTaskTimerHandle timer, std::chrono::steady_clock::time_point launch_time);
         ScopedTaskScopeImpl& _impl;
     };
 
+    template<class ReturnType>
+    template<class Func>
+    auto ScopedTaskResult<ReturnType>::then(const ScopedTaskScope& scope, const Bn3Tag& task_name, Func&& func)
+    {
+        auto next = scope._impl.callAfter(std::move(_impl), task_name, std::forward<Func>(func));
+        return ScopedTaskResult<typename decltype(next)::value_type>(std::move(next));
+    }
+
+    // Combines results without blocking. The combined result completes on the thread completing the last (or first) of them.
+    // Each result can take only one continuation, so it cannot be joined twice or joined after then().
+    class ScopedTaskJoin
+    {
+    public:
+        // The number of the results which finished without being cancelled. It completes when all of them complete.
+        template<class... Types>
+        static ScopedTaskResult<size_t> all(ScopedTaskResult<Types>&... results)
+        {
+            ScopedTaskResultBase* impls[] = { results._impl.get()..., nullptr };
+            return ScopedTaskResult<size_t>(join(impls, sizeof...(Types), false));
+        }
+        template<class Type>
+        static ScopedTaskResult<size_t> all(ScopedTaskResult<Type>* results, size_t count)
+        {
+            ScopedTaskResultBase* impls[MAX_JOIN_COUNT];
+            return ScopedTaskResult<size_t>(join(collect(impls, results, count), count, false));
+        }
+
+        // The index of the result which finished first. It is cancelled if all of them are cancelled.
+        template<class... Types>
+        static ScopedTaskResult<size_t> any(ScopedTaskResult<Types>&... results)
+        {
+            ScopedTaskResultBase* impls[] = { results._impl.get()..., nullptr };
+            return ScopedTaskResult<size_t>(join(impls, sizeof...(Types), true));
+        }
+        template<class Type>
+        static ScopedTaskResult<size_t> any(ScopedTaskResult<Type>* results, size_t count)
+        {
+            ScopedTaskResultBase* impls[MAX_JOIN_COUNT];
+            return ScopedTaskResult<size_t>(join(collect(impls, results, count), count, true));
+        }
+
+        static constexpr size_t MAX_JOIN_COUNT = 64;
+
+    private:
+        template<class Type>
+        static ScopedTaskResultBase** collect(ScopedTaskResultBase** impls, ScopedTaskResult<Type>* results, size_t& count)
+        {
+            if (count > MAX_JOIN_COUNT)
+            {
+                LOG_E("Only %zu results can be joined at once", MAX_JOIN_COUNT);
+                count = MAX_JOIN_COUNT;
+            }
+            for (size_t i = 0; i < count; i++)
+                impls[i] = results[i]._impl.get();
+            return impls;
+        }
+        static ScopedTaskResultHandle<size_t> join(ScopedTaskResultBase** impls, size_t count, bool is_any);
+    };
+
+    template<class... Types>
+    inline ScopedTaskResult<size_t> whenAll(ScopedTaskResult<Types>&... results)
+    {
+        return ScopedTaskJoin::all(results...);
+    }
+    template<class Type>
+    inline ScopedTaskResult<size_t> whenAll(ScopedTaskResult<Type>* results, size_t count)
+    {
+        return ScopedTaskJoin::all(results, count);
+    }
+    template<class... Types>
+    inline ScopedTaskResult<size_t> whenAny(ScopedTaskResult<Types>&... results)
+    {
+        return ScopedTaskJoin::any(results...);
+    }
+    template<class Type>
+    inline ScopedTaskResult<size_t> whenAny(ScopedTaskResult<Type>* results, size_t count)
+    {
+        return ScopedTaskJoin::any(results, count);
+    }
+
     class ScopedTaskLooper
     {
     public:
@@ -100,11 +283,23 @@ namespace Bn3Monkey
             _impl.start(interval, scope._impl, std::forward<Func>(func), std::forward<Args>(args)...);
         }
 
+        // The overloads above run at a fixed rate without coalescing.
+        template<class Rep, class Period, class Func, class... Args>
+        void start(const ScopedTaskLooperOption& option, std::chrono::duration<Rep, Period> interval, const ScopedTaskScope& scope, Func&& func, Args&&... args)
+        {
+            _impl.start(option, interval, scope._impl, std::forward<Func>(func), std::forward<Args>(args)...);
+        }
+
         void stop()
         {
             _impl.stop();
         }
 
+        ScopedTaskLooperStatistics statistics() const
+        {
+            return _impl.statistics();
+        }
+
     private:
         ScopedTaskLooperImpl& getLooper(const Bn3Tag& looper_name);
         ScopedTaskLooperImpl& _impl;
@@ -113,7 +308,8 @@ namespace Bn3Monkey
     class ScopedTaskRunner
     {
     public:
-        bool initialize();
+        // SHARED_POOL runs every scope as a strand on worker_count shared workers (0 means the number of hardware threads).
+        bool initialize(ScopedTaskExecution execution = ScopedTaskExecution::DEDICATED_THREAD, size_t worker_count = 0);
         void release();
     private:
     };
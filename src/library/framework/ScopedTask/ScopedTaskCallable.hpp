@@ -0,0 +1,166 @@
+#ifndef __BN3MONKEY_SCOPED_TASK_CALLABLE__
+#define __BN3MONKEY_SCOPED_TASK_CALLABLE__
+
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+#include "../MemoryPool/MemoryPool.hpp"
+
+namespace Bn3Monkey
+{
+    template<class Signature>
+    class ScopedTaskCallable;
+
+    // Move-only replacement of std::function for tasks.
+    // A callable up to INLINE_SIZE bytes is stored inline. A bigger one is constructed in the memory pool.
+    template<class ReturnType, class... Args>
+    class ScopedTaskCallable<ReturnType(Args...)>
+    {
+    public:
+        static constexpr size_t INLINE_SIZE = 64;
+
+        ScopedTaskCallable() {}
+        ScopedTaskCallable(std::nullptr_t) {}
+
+        template<class Func, class = std::enable_if_t<!std::is_same_v<std::decay_t<Func>, ScopedTaskCallable>>>
+        ScopedTaskCallable(Func&& func)
+        {
+            using Type = std::decay_t<Func>;
+            if constexpr (isInline<Type>())
+            {
+                new (_storage) Type(std::forward<Func>(func));
+                _operations = &InlineOperations<Type>::value;
+            }
+            else
+            {
+                static const Bn3Tag tag("task_callable");
+                Type* ptr = Bn3MemoryPool::construct<Type>(tag, Type(std::forward<Func>(func)));
+                if (!ptr)
+                    return;
+                new (_storage) Type* (ptr);
+                _operations = &PooledOperations<Type>::value;
+            }
+        }
+
+        ScopedTaskCallable(const ScopedTaskCallable& other) = delete;
+        ScopedTaskCallable(ScopedTaskCallable&& other) noexcept
+        {
+            moveFrom(other);
+        }
+
+        ScopedTaskCallable& operator=(const ScopedTaskCallable& other) = delete;
+        ScopedTaskCallable& operator=(ScopedTaskCallable&& other) noexcept
+        {
+            if (this != &other)
+            {
+                reset();
+                moveFrom(other);
+            }
+            return *this;
+        }
+        ScopedTaskCallable& operator=(std::nullptr_t)
+        {
+            reset();
+            return *this;
+        }
+
+        ~ScopedTaskCallable()
+        {
+            reset();
+        }
+
+        explicit operator bool() const { return _operations != nullptr; }
+
+        ReturnType operator()(Args... args)
+        {
+            return _operations->invoke(_storage, std::forward<Args>(args)...);
+        }
+
+    private:
+        struct Operations
+        {
+            ReturnType(*invoke)(void* storage, Args&&... args);
+            // Moves the callable from src to the uninitialized dst and destroys src.
+            void (*relocate)(void* dst, void* src);
+            void (*destroy)(void* storage);
+        };
+
+        template<class Type>
+        static constexpr bool isInline()
+        {
+            return sizeof(Type) <= INLINE_SIZE &&
+                alignof(Type) <= alignof(std::max_align_t) &&
+                std::is_nothrow_move_constructible_v<Type>;
+        }
+
+        template<class Type>
+        struct InlineOperations
+        {
+            static ReturnType invoke(void* storage, Args&&... args)
+            {
+                // As std::function, a void signature discards the result.
+                if constexpr (std::is_void_v<ReturnType>)
+                    (*static_cast<Type*>(storage))(std::forward<Args>(args)...);
+                else
+                    return (*static_cast<Type*>(storage))(std::forward<Args>(args)...);
+            }
+            static void relocate(void* dst, void* src)
+            {
+                auto* value = static_cast<Type*>(src);
+                new (dst) Type(std::move(*value));
+                value->~Type();
+            }
+            static void destroy(void* storage)
+            {
+                static_cast<Type*>(storage)->~Type();
+            }
+            static constexpr Operations value{ &invoke, &relocate, &destroy };
+        };
+
+        template<class Type>
+        struct PooledOperations
+        {
+            static ReturnType invoke(void* storage, Args&&... args)
+            {
+                if constexpr (std::is_void_v<ReturnType>)
+                    (**static_cast<Type**>(storage))(std::forward<Args>(args)...);
+                else
+                    return (**static_cast<Type**>(storage))(std::forward<Args>(args)...);
+            }
+            static void relocate(void* dst, void* src)
+            {
+                new (dst) Type* (*static_cast<Type**>(src));
+            }
+            static void destroy(void* storage)
+            {
+                Bn3MemoryPool::destroy<Type>(*static_cast<Type**>(storage));
+            }
+            static constexpr Operations value{ &invoke, &relocate, &destroy };
+        };
+
+        inline void moveFrom(ScopedTaskCallable& other)
+        {
+            if (other._operations)
+            {
+                other._operations->relocate(_storage, other._storage);
+                _operations = other._operations;
+                other._operations = nullptr;
+            }
+        }
+        inline void reset()
+        {
+            if (_operations)
+            {
+                _operations->destroy(_storage);
+                _operations = nullptr;
+            }
+        }
+
+        alignas(std::max_align_t) unsigned char _storage[INLINE_SIZE];
+        const Operations* _operations{ nullptr };
+    };
+}
+
+#endif // __BN3MONKEY_SCOPED_TASK_CALLABLE__
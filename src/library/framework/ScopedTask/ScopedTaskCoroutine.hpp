@@ -0,0 +1,303 @@
+#ifndef __BN3MONKEY_SCOPED_TASK_COROUTINE__
+#define __BN3MONKEY_SCOPED_TASK_COROUTINE__
+
+// Coroutine support needs C++20. Build with BN3MONKEY_ENABLE_COROUTINE to use it.
+#if defined(__cpp_impl_coroutine) && __has_include(<coroutine>)
+
+#include <coroutine>
+#include <optional>
+#include <exception>
+#include <cstdint>
+
+#include "ScopedTaskImpl.hpp"
+#include "ScopedTaskScopeImpl.hpp"
+
+#define BN3MONKEY_SCOPED_TASK_COROUTINE
+
+namespace Bn3Monkey
+{
+    // Resumes handle by a task of scope. If the scope cancels the task, handle is resumed on the cancelling thread and is_cancelled is set.
+    inline void resumeOnScope(ScopedTaskScopeImpl& scope, std::coroutine_handle<> handle, bool& is_cancelled)
+    {
+        static const Bn3Tag tag("resume_coroutine");
+        ScopedTask task{ tag };
+        task.makeHandler([handle, &is_cancelled](bool value) {
+            is_cancelled = !value;
+            handle.resume();
+            });
+        scope.dispatch(std::move(task));
+    }
+
+    // co_await scope.schedule() continues the coroutine on the scope. Returns false if the scope has stopped.
+    class ScopedTaskScheduleAwaiter
+    {
+    public:
+        explicit ScopedTaskScheduleAwaiter(ScopedTaskScopeImpl& scope) : _scope(scope) {}
+
+        bool await_ready() const noexcept { return false; }
+        // The coroutine may be resumed before this returns, so nothing is touched after dispatching.
+        void await_suspend(std::coroutine_handle<> handle)
+        {
+            resumeOnScope(_scope, handle, _is_cancelled);
+        }
+        bool await_resume() const noexcept { return !_is_cancelled; }
+
+    private:
+        ScopedTaskScopeImpl& _scope;
+        bool _is_cancelled{ false };
+    };
+
+    // co_await on a task result. The coroutine continues on the scope it was suspended on, or on the thread completing the task if it was not on any scope.
+    // Returns std::optional of the value (bool for void), which is empty (false) if the task is cancelled.
+    template<class Type>
+    class ScopedTaskResultAwaiter
+    {
+    public:
+        explicit ScopedTaskResultAwaiter(ScopedTaskResultHandle<Type> result) : _result(std::move(result)) {}
+
+        bool await_ready()
+        {
+            return !_result || ScopedTaskState::NOT_FINISHED != _result->state();
+        }
+        void await_suspend(std::coroutine_handle<> handle)
+        {
+            auto* scope = ScopedTaskScopeImpl::currentScope();
+            _result->setContinuation([this, scope, handle](ScopedTaskState) {
+                if (scope)
+                    resumeOnScope(*scope, handle, _is_cancelled);
+                else
+                    handle.resume();
+                });
+        }
+        auto await_resume()
+        {
+            if constexpr (std::is_void_v<Type>)
+            {
+                return _result && ScopedTaskState::FINISHED == _result->state();
+            }
+            else
+            {
+                std::optional<Type> ret;
+                if (_result)
+                {
+                    if (auto* value = _result->value())
+                        ret.emplace(std::move(*value));
+                }
+                return ret;
+            }
+        }
+
+    private:
+        ScopedTaskResultHandle<Type> _result;
+        bool _is_cancelled{ false };
+    };
+
+    class ScopedCoroutinePromiseBase
+    {
+    public:
+        // Coroutine frames are allocated from the memory pool.
+        static void* operator new(size_t size) noexcept
+        {
+            static const Bn3Tag tag("coroutine_frame");
+            return Bn3MemoryPool::allocate<char>(tag, size);
+        }
+        static void operator delete(void* ptr, size_t size)
+        {
+            Bn3MemoryPool::deallocate<char>(static_cast<char*>(ptr), size);
+        }
+
+        // Starts eagerly on the calling thread. co_await scope.schedule() moves it to a scope.
+        std::suspend_never initial_suspend() noexcept { return {}; }
+
+        struct FinalAwaiter
+        {
+            bool await_ready() const noexcept { return false; }
+            template<class Promise>
+            std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> handle) noexcept
+            {
+                auto* prev = handle.promise()._continuation.exchange(done(), std::memory_order_acq_rel);
+                if (prev == detached())
+                {
+                    handle.destroy();
+                    return std::noop_coroutine();
+                }
+                if (prev == nullptr)
+                    return std::noop_coroutine();
+
+                // The awaiting coroutine continues on its own scope, not on the thread which finished this one.
+                auto& promise = handle.promise();
+                auto continuation = std::coroutine_handle<>::from_address(prev);
+                auto* scope = promise._continuation_scope;
+                if (scope && scope != ScopedTaskScopeImpl::currentScope())
+                {
+                    resumeOnScope(*scope, continuation, promise._is_continuation_cancelled);
+                    return std::noop_coroutine();
+                }
+                return continuation;
+            }
+            void await_resume() const noexcept {}
+        };
+        FinalAwaiter final_suspend() noexcept { return {}; }
+
+        void unhandled_exception()
+        {
+            _exception = std::current_exception();
+        }
+
+        inline bool isDone() const
+        {
+            return _continuation.load(std::memory_order_acquire) == done();
+        }
+        // Returns false if the coroutine has finished already.
+        // handle is resumed on scope when the coroutine finishes, or on the finishing thread if scope is nullptr.
+        inline bool setContinuation(std::coroutine_handle<> handle, ScopedTaskScopeImpl* scope)
+        {
+            // Published by the exchange below
+            _continuation_scope = scope;
+            void* expected = nullptr;
+            return _continuation.compare_exchange_strong(expected, handle.address(), std::memory_order_acq_rel, std::memory_order_acquire);
+        }
+        // Returns true if the coroutine has finished, so that the owner destroys it. Otherwise it destroys itself when it finishes.
+        inline bool detach()
+        {
+            return _continuation.exchange(detached(), std::memory_order_acq_rel) == done();
+        }
+
+        inline void rethrow()
+        {
+            if (_exception)
+                std::rethrow_exception(_exception);
+        }
+
+    private:
+        static inline void* done() { return reinterpret_cast<void*>(uintptr_t(1)); }
+        static inline void* detached() { return reinterpret_cast<void*>(uintptr_t(2)); }
+
+        // nullptr, the address of the awaiting coroutine, done() or detached()
+        std::atomic<void*> _continuation{ nullptr };
+        ScopedTaskScopeImpl* _continuation_scope{ nullptr };
+        bool _is_continuation_cancelled{ false };
+        std::exception_ptr _exception;
+    };
+
+    template<class Type>
+    class ScopedCoroutinePromiseValue
+    {
+    public:
+        template<class Value>
+        void return_value(Value&& value)
+        {
+            _value.emplace(std::forward<Value>(value));
+        }
+        std::optional<Type> takeValue() { return std::move(_value); }
+
+    private:
+        std::optional<Type> _value;
+    };
+
+    template<>
+    class ScopedCoroutinePromiseValue<void>
+    {
+    public:
+        void return_void() { _is_returned = true; }
+        bool takeValue() { return _is_returned; }
+
+    private:
+        bool _is_returned{ false };
+    };
+
+    // Return type of a coroutine. Awaiting it gives std::optional of the returned value (bool for void), which is empty if the frame could not be allocated.
+    // If it is destroyed before the coroutine finishes, the coroutine keeps running and frees itself at the end.
+    template<class Type = void>
+    class ScopedCoroutineTask
+    {
+    public:
+        class promise_type : public ScopedCoroutinePromiseBase, public ScopedCoroutinePromiseValue<Type>
+        {
+        public:
+            ScopedCoroutineTask get_return_object()
+            {
+                return ScopedCoroutineTask(std::coroutine_handle<promise_type>::from_promise(*this));
+            }
+            static ScopedCoroutineTask get_return_object_on_allocation_failure()
+            {
+                LOG_E("Coroutine frame cannot be allocated");
+                return ScopedCoroutineTask();
+            }
+        };
+
+        ScopedCoroutineTask() {}
+        ScopedCoroutineTask(const ScopedCoroutineTask& other) = delete;
+        ScopedCoroutineTask(ScopedCoroutineTask&& other) noexcept : _handle(other._handle)
+        {
+            other._handle = nullptr;
+        }
+        ScopedCoroutineTask& operator=(ScopedCoroutineTask&& other) noexcept
+        {
+            if (this != &other)
+            {
+                reset();
+                _handle = other._handle;
+                other._handle = nullptr;
+            }
+            return *this;
+        }
+        ~ScopedCoroutineTask()
+        {
+            reset();
+        }
+
+        explicit operator bool() const { return static_cast<bool>(_handle); }
+        bool isDone() const { return !_handle || _handle.promise().isDone(); }
+
+        class Awaiter
+        {
+        public:
+            explicit Awaiter(std::coroutine_handle<promise_type> handle) : _handle(handle) {}
+
+            bool await_ready() const { return !_handle || _handle.promise().isDone(); }
+            bool await_suspend(std::coroutine_handle<> handle)
+            {
+                return _handle.promise().setContinuation(handle, ScopedTaskScopeImpl::currentScope());
+            }
+            auto await_resume()
+            {
+                if constexpr (std::is_void_v<Type>)
+                {
+                    if (!_handle)
+                        return false;
+                }
+                else
+                {
+                    if (!_handle)
+                        return std::optional<Type>();
+                }
+                _handle.promise().rethrow();
+                return _handle.promise().takeValue();
+            }
+
+        private:
+            std::coroutine_handle<promise_type> _handle;
+        };
+        Awaiter operator co_await() const noexcept
+        {
+            return Awaiter(_handle);
+        }
+
+    private:
+        explicit ScopedCoroutineTask(std::coroutine_handle<promise_type> handle) : _handle(handle) {}
+
+        void reset()
+        {
+            if (_handle && _handle.promise().detach())
+                _handle.destroy();
+            _handle = nullptr;
+        }
+
+        std::coroutine_handle<promise_type> _handle;
+    };
+}
+
+#endif // __cpp_impl_coroutine
+
+#endif // __BN3MONKEY_SCOPED_TASK_COROUTINE__
@@ -2,11 +2,14 @@
 #define __BN3MONKEY_SCOPED_TASK_IMPL__
 
 #include <functional>
+#include <atomic>
+#include <new>
 #include <mutex>
 #include <condition_variable>
 #include <type_traits>
 #include <chrono>
 #include <queue>
+#include <tuple>
 #include <cassert>
 
 
@@ -68,6 +71,8 @@
 #endif
 
 #include "../StaticVector/StaticVector.hpp"
+#include "ScopedTaskCallable.hpp"
+#include "ScopedTaskWait.hpp"
 
 namespace Bn3Monkey
 {
@@ -81,165 +86,307 @@ namespace Bn3Monkey
 
     
 
-    template<class Type>
-    class ScopedTaskResultImpl
+    // A worker of the shared pool which blocks is replaced by a spare worker until it unblocks. Defined in ScopedTaskWorkerPoolImpl.cpp.
+    bool isScopedTaskWorker();
+    void blockScopedTaskWorker();
+    void unblockScopedTaskWorker();
+
+    // Marks the current thread blocked while alive if it is a worker of the shared pool.
+    class ScopedTaskWorkerBlocking
+    {
+    public:
+        ScopedTaskWorkerBlocking() : _is_worker(isScopedTaskWorker())
+        {
+            if (_is_worker)
+                blockScopedTaskWorker();
+        }
+        ~ScopedTaskWorkerBlocking()
+        {
+            if (_is_worker)
+                unblockScopedTaskWorker();
+        }
+        ScopedTaskWorkerBlocking(const ScopedTaskWorkerBlocking& other) = delete;
+
+    private:
+        bool _is_worker;
+    };
+
+    // Completion state shared by a task and the waiter of its result.
+    // The low byte of the state word is ScopedTaskState. HAS_WAITER is set by a waiter before it parks,
+    // so that completing a task which nobody sleeps on costs no system call.
+    // HAS_CONTINUATION is set when a continuation is registered before completion.
+    class ScopedTaskResultBase
     {
     public:
-        ScopedTaskResultImpl(const Bn3Tag& task_name)
+        static constexpr uint32_t STATE_MASK = 0xFF;
+        static constexpr uint32_t HAS_WAITER = 0x100;
+        static constexpr uint32_t HAS_CONTINUATION = 0x200;
+        // Called once with FINISHED or CANCELLED. Captures up to 64 bytes are stored without allocation.
+        using Continuation = ScopedTaskCallable<void(ScopedTaskState)>;
+        // Most calls finish in a few microseconds, so the waiter spins a little before parking.
+        static constexpr int SPIN_COUNT = 256;
+
+        explicit ScopedTaskResultBase(const Bn3Tag& task_name) : _name(task_name)
         {
-            _name = task_name;
-            LOG_D("ScopedTaskResultImpl (%s) Created", _name.str());
         }
-        virtual ~ScopedTaskResultImpl()
+        ScopedTaskResultBase(ScopedTaskResultBase&& other) = delete;
+        ScopedTaskResultBase(const ScopedTaskResultBase& other) = delete;
+
+        inline void retain()
+        {
+            _references.fetch_add(1, std::memory_order_relaxed);
+        }
+        // Returns true if the last reference is released.
+        inline bool release()
         {
-            LOG_D("ScopedTaskResultImpl (%s) Removed", _name.str());
+            return _references.fetch_sub(1, std::memory_order_acq_rel) == 1;
         }
-        ScopedTaskResultImpl(ScopedTaskResultImpl&& other) = delete;
-        ScopedTaskResultImpl(const ScopedTaskResultImpl& other) = delete;
 
         void cancel()
         {
-            {
-                std::unique_lock<std::mutex> lock(_mtx);
-                _state = ScopedTaskState::CANCELLED;
-            }
-            _cv.notify_all();
             LOG_D("Task Result cancelled (%s)", _name.str());
+            complete(ScopedTaskState::CANCELLED);
         }
-        
-        virtual void notify(const Type& result)
+
+        // Runs continuation on the thread which completes the task, or right now if it has completed already.
+        // A result has at most one continuation.
+        void setContinuation(Continuation&& continuation)
         {
+            assert(!_continuation);
+            _continuation = std::move(continuation);
+
+            uint32_t value = _state.load(std::memory_order_acquire);
+            while (ScopedTaskState::NOT_FINISHED == static_cast<ScopedTaskState>(value & STATE_MASK))
             {
-                std::unique_lock<std::mutex> lock(_mtx);
-                _state = ScopedTaskState::FINISHED;
-                memcpy(_result, &result, sizeof(Type));
+                if (_state.compare_exchange_weak(value, value | HAS_CONTINUATION, std::memory_order_acq_rel, std::memory_order_acquire))
+                    return;
             }
-            _cv.notify_all();
-            LOG_D("Task Result notified (%s)", _name.str());
+            runContinuation(static_cast<ScopedTaskState>(value & STATE_MASK));
+        }
+
+        inline ScopedTaskState state() { return loadState(); }
+        inline const char* name() { return _name.str(); }
+
+    protected:
+        inline void complete(ScopedTaskState state)
+        {
+            auto prev = _state.exchange(static_cast<uint32_t>(state), std::memory_order_acq_rel);
+            if (prev & HAS_CONTINUATION)
+                runContinuation(state);
+            if (prev & HAS_WAITER)
+                wakeByAddress(_state);
         }
-        virtual Type* wait()
+
+        // Returns FINISHED or CANCELLED. The result cannot be waited again.
+        ScopedTaskState waitCompletion()
         {
-            if (_state == ScopedTaskState::INVALID)
+            if (_is_waited)
             {
                 LOG_E("This task (%s) is invalid!\n", _name.str());
                 assert(false);
             }
 
             LOG_D("Waited by Task Result (%s)", _name.str());
-            // 처리하고 있는 Scope가 처리가 끝나면 알려준다.
+            auto state = park();
+            _is_waited = true;
+            return state;
+        }
+
+    private:
+        inline void runContinuation(ScopedTaskState state)
+        {
+            auto continuation = std::move(_continuation);
+            if (continuation)
+                continuation(state);
+        }
+
+        inline ScopedTaskState loadState()
+        {
+            return static_cast<ScopedTaskState>(_state.load(std::memory_order_acquire) & STATE_MASK);
+        }
+
+        ScopedTaskState park()
+        {
+            for (int i = 0; i < SPIN_COUNT; i++)
             {
-                std::unique_lock<std::mutex> lock(_mtx);
-                _cv.wait(lock, [&]() {
-                    return _state != ScopedTaskState::NOT_FINISHED;
-                    });
+                auto state = loadState();
+                if (ScopedTaskState::NOT_FINISHED != state)
+                    return state;
+                relaxCpu();
+            }
+
+            // The result may depend on a strand which no other worker of the shared pool is free to run.
+            ScopedTaskWorkerBlocking blocking;
+            for (;;)
+            {
+                uint32_t value = _state.load(std::memory_order_acquire);
+                auto state = static_cast<ScopedTaskState>(value & STATE_MASK);
+                if (ScopedTaskState::NOT_FINISHED != state)
+                    return state;
+
+                if (!(value & HAS_WAITER))
+                {
+                    if (!_state.compare_exchange_weak(value, value | HAS_WAITER, std::memory_order_acq_rel, std::memory_order_acquire))
+                        continue;
+                    value |= HAS_WAITER;
+                }
+                waitOnAddress(_state, value);
             }
-            
-            Type* ret{ nullptr };
-            if (_state == ScopedTaskState::FINISHED)
-                ret = (Type*)_result;
-            _state = ScopedTaskState::INVALID;
-            return ret;
         }
 
+        Bn3Tag _name;
+        std::atomic<uint32_t> _state{ static_cast<uint32_t>(ScopedTaskState::NOT_FINISHED) };
+        std::atomic<uint32_t> _references{ 1 };
+        // Touched by the waiter only
+        bool _is_waited{ false };
+        Continuation _continuation;
+    };
+
+    template<class Type>
+    class ScopedTaskResultImpl : public ScopedTaskResultBase
+    {
+    public:
+        explicit ScopedTaskResultImpl(const Bn3Tag& task_name) : ScopedTaskResultBase(task_name)
+        {
+            LOG_D("ScopedTaskResultImpl (%s) Created", name());
+        }
+        ~ScopedTaskResultImpl()
+        {
+            if (_has_value)
+                reinterpret_cast<Type*>(_result)->~Type();
+            LOG_D("ScopedTaskResultImpl (%s) Removed", name());
+        }
+
+        template<class Value>
+        void notify(Value&& result)
+        {
+            LOG_D("Task Result notified (%s)", name());
+            new (_result) Type(std::forward<Value>(result));
+            _has_value = true;
+            complete(ScopedTaskState::FINISHED);
+        }
+        // Returns nullptr if the task is cancelled. The value lives as long as the result.
+        Type* wait()
+        {
+            if (ScopedTaskState::FINISHED == waitCompletion())
+                return reinterpret_cast<Type*>(_result);
+            return nullptr;
+        }
+        // Doesn't wait. Returns nullptr unless the task has finished.
+        Type* value()
+        {
+            if (ScopedTaskState::FINISHED == state())
+                return reinterpret_cast<Type*>(_result);
+            return nullptr;
+        }
 
-        inline const char* name() { return _name.str(); }
     private:
-        Bn3Tag _name;
-        ScopedTaskState _state{ ScopedTaskState::NOT_FINISHED };
-        char _result[sizeof(Type)]{ 0 };
-        // Not moved. Just use.
-        std::mutex _mtx;
-        std::condition_variable _cv;
+        alignas(Type) unsigned char _result[sizeof(Type)];
+        bool _has_value{ false };
     };
 
     template<>
-    class ScopedTaskResultImpl<void>
+    class ScopedTaskResultImpl<void> : public ScopedTaskResultBase
     {
     public:
-        ScopedTaskResultImpl(const Bn3Tag& task_name)
+        explicit ScopedTaskResultImpl(const Bn3Tag& task_name) : ScopedTaskResultBase(task_name)
         {
-            _name = task_name;
-            LOG_D("ScopedTaskResultImpl (%s) Created", _name.str());
+            LOG_D("ScopedTaskResultImpl (%s) Created", name());
         }
-        virtual ~ScopedTaskResultImpl()
+        ~ScopedTaskResultImpl()
         {
-            LOG_D("ScopedTaskResultImpl (%s) Removed", _name.str());
+            LOG_D("ScopedTaskResultImpl (%s) Removed", name());
         }
-        ScopedTaskResultImpl(ScopedTaskResultImpl&& other) = delete;
-        ScopedTaskResultImpl(const ScopedTaskResultImpl& other) = delete;
 
-        void cancel()
+        void notify()
         {
-            {
-                std::unique_lock<std::mutex> lock(_mtx);
-                _state = ScopedTaskState::CANCELLED;
-            }
-            _cv.notify_all();
-            LOG_D("Task Result cancelled (%s)", _name.str());
+            LOG_D("Task Result notified (%s)", name());
+            complete(ScopedTaskState::FINISHED);
+        }
+        // Returns false if the task is cancelled.
+        bool wait()
+        {
+            return ScopedTaskState::FINISHED == waitCompletion();
         }
+    };
 
-        void notify()
+    // Intrusive reference to a result allocated from the memory pool. The task and the waiter hold one each.
+    template<class Type>
+    class ScopedTaskResultHandle
+    {
+    public:
+        using value_type = Type;
+
+        ScopedTaskResultHandle() {}
+        ScopedTaskResultHandle(const ScopedTaskResultHandle& other) : _ptr(other._ptr)
+        {
+            if (_ptr)
+                _ptr->retain();
+        }
+        ScopedTaskResultHandle(ScopedTaskResultHandle&& other) noexcept : _ptr(other._ptr)
+        {
+            other._ptr = nullptr;
+        }
+        ScopedTaskResultHandle& operator=(const ScopedTaskResultHandle& other)
         {
+            if (this != &other)
             {
-                std::unique_lock<std::mutex> lock(_mtx);
-                _state = ScopedTaskState::FINISHED;
+                reset();
+                _ptr = other._ptr;
+                if (_ptr)
+                    _ptr->retain();
             }
-            _cv.notify_all();
-            LOG_D("Task Result notified (%s)", _name.str());
+            return *this;
         }
-        void wait()
+        ScopedTaskResultHandle& operator=(ScopedTaskResultHandle&& other) noexcept
         {
-            if (_state == ScopedTaskState::INVALID)
+            if (this != &other)
             {
-                LOG_E("This task (%s) is invalid!\n", _name.str());
-                assert(false);
+                reset();
+                _ptr = other._ptr;
+                other._ptr = nullptr;
             }
+            return *this;
+        }
+        ~ScopedTaskResultHandle()
+        {
+            reset();
+        }
 
-            LOG_D("Waited by Task Result (%s)", _name.str());
-            // 처리하고 있는 Scope가 처리가 끝나면 알려준다.
-            {
-                std::unique_lock<std::mutex> lock(_mtx);
-                _cv.wait(lock, [&]() {
-                    return _state != ScopedTaskState::NOT_FINISHED;
-                    });
-            }
+        static ScopedTaskResultHandle make(const Bn3Tag& task_name)
+        {
+            ScopedTaskResultHandle ret;
+            ret._ptr = Bn3MemoryPool::construct<ScopedTaskResultImpl<Type>>(task_name, task_name);
+            return ret;
+        }
 
-            _state = ScopedTaskState::INVALID;
+        void reset()
+        {
+            if (_ptr && _ptr->release())
+                Bn3MemoryPool::destroy(_ptr);
+            _ptr = nullptr;
         }
 
+        explicit operator bool() const { return _ptr != nullptr; }
+        inline ScopedTaskResultImpl<Type>* operator->() const { return _ptr; }
+        inline ScopedTaskResultImpl<Type>* get() const { return _ptr; }
 
-        inline const char* name() { return _name.str(); }
     private:
-        Bn3Tag _name;
-        ScopedTaskState _state{ ScopedTaskState::NOT_FINISHED };
-
-        // Not moved. Just use.
-        std::mutex _mtx;
-        std::condition_variable _cv;
+        ScopedTaskResultImpl<Type>* _ptr{ nullptr };
     };
 
-   
-
-    template<class ReturnType>
-    inline void invokeScopedTaskImpl(const std::function<ReturnType()>& onTaskRunning, std::weak_ptr<ScopedTaskResultImpl<ReturnType>> wresult)
-    {
-        auto ret = onTaskRunning();
-        if (auto result = wresult.lock())
-            result->notify(ret);
-    }
-    template<>
-    inline void invokeScopedTaskImpl<void>(const std::function<void()>& onTaskRunning, std::weak_ptr<ScopedTaskResultImpl<void>> wresult)
+    template<class ReturnType, class Function>
+    inline void invokeScopedTaskImpl(Function& onTaskRunning, ScopedTaskResultHandle<ReturnType>& result)
     {
-        onTaskRunning();
-        if (auto result = wresult.lock())
+        if constexpr (std::is_void_v<ReturnType>)
+        {
+            onTaskRunning();
             result->notify();
-    }
-
-    template<class ReturnType>
-    inline void cancelScopedTaskImpl(std::weak_ptr<ScopedTaskResultImpl<ReturnType>> wresult)
-    {
-        if (auto result = wresult.lock())
-            result->cancel();
+        }
+        else
+        {
+            result->notify(onTaskRunning());
+        }
     }
 
     class ScopedTask
@@ -295,9 +442,17 @@ namespace Bn3Monkey
             _invoke(false);
         }
 
+        // False if nothing is made, or the callable could not be allocated from the memory pool.
+        explicit operator bool() const {
+            return static_cast<bool>(_invoke);
+        }
+
         const char* name() const {
             return _name.str();
         }
+        const Bn3Tag& tag() const {
+            return _name;
+        }
 
         bool isInStack(const Bn3Tag& target_scope_name)
         {
@@ -324,38 +479,60 @@ namespace Bn3Monkey
         }
 
         template<class Func, class... Args>
-        auto make(Func&& func, Args&&... args) -> std::shared_ptr<ScopedTaskResultImpl<decltype(func(args...))>>
+        auto make(Func&& func, Args&&... args) -> ScopedTaskResultHandle<decltype(func(args...))>
         {
             using ReturnType = decltype(func(args...));
 
-            std::function<ReturnType()> onTaskRunning = std::bind(std::forward<Func>(func), std::forward<Args>(args)...);
+            // Arguments are decay-copied like std::bind, but the callable is stored in the task itself.
+            auto onTaskRunning = [func = std::forward<Func>(func), arguments = std::make_tuple(std::forward<Args>(args)...)]() mutable -> ReturnType {
+                return std::apply(func, arguments);
+            };
 
-            auto result = MAKE_SHARED(ScopedTaskResultImpl<ReturnType>, _name, _name);
+            auto result = ScopedTaskResultHandle<ReturnType>::make(_name);
             if (!result)
             {
                 LOG_E("Cannot make task result from task (%s)", _name.str());
                 return result;
             }
 
-            auto wresult = std::weak_ptr<ScopedTaskResultImpl<ReturnType>>(result);
-           
-            _invoke = [onTaskRunning = std::move(onTaskRunning), wresult = wresult](bool value) mutable
+            _invoke = [onTaskRunning = std::move(onTaskRunning), result = result](bool value) mutable
             {
                 if (value)
-                    invokeScopedTaskImpl(onTaskRunning, wresult);
+                    invokeScopedTaskImpl<ReturnType>(onTaskRunning, result);
                 else
-                {
-                    cancelScopedTaskImpl(wresult);
-                }
+                    result->cancel();
             };
+            if (!_invoke)
+            {
+                LOG_E("Cannot allocate task (%s)", _name.str());
+                return ScopedTaskResultHandle<ReturnType>();
+            }
             return result;
         }
 
+        // handler(true) runs the task and handler(false) cancels it.
+        template<class Func>
+        void makeHandler(Func&& handler)
+        {
+            _invoke = std::forward<Func>(handler);
+        }
+
+        // Same as make() but nobody waits for the result, so no result is allocated.
+        template<class Func, class... Args>
+        void makeDetached(Func&& func, Args&&... args)
+        {
+            _invoke = [func = std::forward<Func>(func), arguments = std::make_tuple(std::forward<Args>(args)...)](bool value) mutable
+            {
+                if (value)
+                    std::apply(func, arguments);
+            };
+        }
+
     private:   
 
         Bn3Tag _name;
         Bn3StaticVector<Bn3Tag, 8> _call_stack;
-        std::function<void(bool)> _invoke;
+        ScopedTaskCallable<void(bool)> _invoke;
     };
 
     
@@ -2,16 +2,46 @@
 
 
 Bn3Monkey::ScopedTaskLooperImpl::ScopedTaskLooperImpl(ScopedTaskLooperImpl&& other) : 
+	ScopedTaskTimerEntry(false),
 	_name(std::move(other._name)), 
 	_onAdd(std::move(other._onAdd)),
 	_onRemove(std::move(other._onRemove)),
-	_interval(std::move(other._interval)),
 	_scope(std::move(other._scope)),
-	_task(std::move(other._task)),
+	_state(std::move(other._state)),
 	_is_started(std::move(other._is_started))
 
 {
+	// A looper in the heap is never moved, because loopers live in a deque.
+	assert(other._heap_index == NOT_SCHEDULED);
+}
+
+
+void Bn3Monkey::ScopedTaskLooperState::record(std::chrono::steady_clock::duration delay)
+{
+	auto us = std::chrono::duration_cast<std::chrono::microseconds>(delay).count();
+	uint64_t value = us > 0 ? static_cast<uint64_t>(us) : 0;
+
+	size_t bucket = 0;
+	while (bucket + 1 < ScopedTaskLooperStatistics::JITTER_BUCKET_COUNT && (uint64_t(1) << bucket) <= value)
+		bucket++;
+	jitter[bucket].fetch_add(1, std::memory_order_relaxed);
+
+	auto prev = max_jitter_us.load(std::memory_order_relaxed);
+	while (prev < value && !max_jitter_us.compare_exchange_weak(prev, value, std::memory_order_relaxed));
 
+	fired.fetch_add(1, std::memory_order_relaxed);
+}
+
+Bn3Monkey::ScopedTaskLooperStatistics Bn3Monkey::ScopedTaskLooperState::statistics() const
+{
+	ScopedTaskLooperStatistics ret;
+	ret.fired = fired.load(std::memory_order_relaxed);
+	ret.missed = missed.load(std::memory_order_relaxed);
+	ret.coalesced = coalesced.load(std::memory_order_relaxed);
+	ret.max_jitter_us = max_jitter_us.load(std::memory_order_relaxed);
+	for (size_t i = 0; i < ScopedTaskLooperStatistics::JITTER_BUCKET_COUNT; i++)
+		ret.jitter[i] = jitter[i].load(std::memory_order_relaxed);
+	return ret;
 }
 
 
@@ -25,13 +55,26 @@ Bn3Monkey::ScopedTaskLooperScheduler::ScopedTaskLooperScheduler()
 	};
 
 	_loopers = Bn3Deque(ScopedTaskLooperImpl) { Bn3DequeAllocator(ScopedTaskLooperImpl, Bn3Tag("loopers")) };
-	_activated_loopers = Bn3List(ScopedTaskLooperImpl*) { Bn3ListAllocator(ScopedTaskLooperImpl*, Bn3Tag("activated_loopers")) };
+	_heap = Bn3Vector(ScopedTaskTimerEntry*) { Bn3VectorAllocator(ScopedTaskTimerEntry*, Bn3Tag("looper_heap")) };
+	_dispatches = Bn3Vector(Dispatch) { Bn3VectorAllocator(Dispatch, Bn3Tag("looper_dispatches")) };
+	_timers = Bn3Vector(ScopedTaskTimerHandle) { Bn3VectorAllocator(ScopedTaskTimerHandle, Bn3Tag("looper_timers")) };
+}
+
+Bn3Monkey::ScopedTaskLooperScheduler::~ScopedTaskLooperScheduler()
+{
+	// Timers which have not fired yet
+	for (auto* entry : _heap)
+	{
+		if (entry->_is_one_shot)
+			ScopedTaskTimerHandle::adopt(static_cast<ScopedTaskTimerImpl*>(entry));
+	}
 }
 
 
 
 Bn3Monkey::ScopedTaskLooperImpl& Bn3Monkey::ScopedTaskLooperScheduler::getLooper(const Bn3Tag& looper_name)
 {
+	std::unique_lock<std::mutex> lock(_mtx);
 	_loopers.emplace_back(looper_name, _onAdd, _onRemove);
 	auto& ret = _loopers.back();
 	return ret;
@@ -67,63 +110,134 @@ void Bn3Monkey::ScopedTaskLooperScheduler::stop()
 
 void Bn3Monkey::ScopedTaskLooperScheduler::routine()
 {
+	std::unique_lock<std::mutex> lock(_mtx);
 	for (;;)
 	{
+		if (!_is_running)
+			break;
+
+		if (_heap.empty())
 		{
-			std::unique_lock<std::mutex> lock(_mtx);
-			
-			if (_activated_loopers.empty())
+			_cv.wait(lock, [&]() {
+				return !_is_running || !_heap.empty();
+				});
+			continue;
+		}
+
+		auto now = std::chrono::steady_clock::now();
+		auto next_launch_time = _heap.front()->_next_launch_time;
+		if (now < next_launch_time)
+		{
+			// add and remove notify, so the earliest launch time is checked again.
+			_cv.wait_until(lock, next_launch_time);
+			continue;
+		}
+
+		while (!_heap.empty() && _heap.front()->_next_launch_time <= now)
+		{
+			auto* entry = _heap.front();
+			if (entry->_is_one_shot)
 			{
-				_cv.wait(lock, [&]() {
-					return !_is_running || !_activated_loopers.empty();
-					});
+				// The reference of the heap moves to the dispatched task.
+				erase(*entry);
+				_timers.push_back(ScopedTaskTimerHandle::adopt(static_cast<ScopedTaskTimerImpl*>(entry)));
+				continue;
 			}
+
+			auto* looper = static_cast<ScopedTaskLooperImpl*>(entry);
+			auto& state = looper->_state;
+			auto deadline = looper->_next_launch_time;
+
+			bool is_dispatched = !state->option.is_coalesced || !state->is_queued.exchange(true, std::memory_order_acq_rel);
+			if (is_dispatched)
+				_dispatches.push_back({ looper->_scope, looper->_name, looper, state, deadline });
 			else
+				state->coalesced.fetch_add(1, std::memory_order_relaxed);
+
+			if (is_dispatched && state->option.mode == ScopedTaskLooperMode::FIXED_DELAY)
+			{
+				// Scheduled again when the tick finishes
+				erase(*looper);
+				continue;
+			}
+
+			// Anchored to the previous deadline, not to now, so that lateness doesn't accumulate.
+			auto next_launch_time = deadline + state->interval;
+			if (next_launch_time <= now)
 			{
-				auto now = std::chrono::steady_clock::now();
-
-				for (auto& looper : _activated_loopers)
-				{
-					if (now >= looper->_next_launch_time)
-					{
-						looper->_scope->run(looper->_name, looper->_task);
-						looper->_next_launch_time = now + looper->_interval;
-					}
-
-				}
-
-				std::chrono::steady_clock::time_point wait_until_time;
-				wait_until_time = _activated_loopers.front()->_next_launch_time;
-				for (auto& looper : _activated_loopers)
-				{
-					if (wait_until_time > looper->_next_launch_time)
-						wait_until_time = looper->_next_launch_time;
-				}
-
-
-				_cv.wait_until(lock, wait_until_time, [&]() {
-					return !_is_running || !_activated_loopers.empty();
-					});
+				auto missed = (now - deadline) / state->interval;
+				state->missed.fetch_add(static_cast<uint64_t>(missed), std::memory_order_relaxed);
+				next_launch_time = deadline + (missed + 1) * state->interval;
 			}
+			looper->_next_launch_time = next_launch_time;
+			siftDown(0);
+		}
 
-			if (!_is_running)
-				break;
+		lock.unlock();
+		for (auto& dispatch : _dispatches)
+		{
+			auto* looper = dispatch.looper;
+			auto deadline = dispatch.deadline;
+			// The tick is cancelled if the scope doesn't accept it, or drops it later for its capacity.
+			// A full scope never blocks the scheduler, whatever its policy.
+			ScopedTask task{ dispatch.name };
+			task.makeHandler([this, looper, state = std::move(dispatch.state), deadline](bool value) {
+				if (value)
+					tick(*looper, state, deadline);
+				else
+					dropTick(*looper, state);
+			});
+			dispatch.scope->tryDispatch(std::move(task));
+		}
+		_dispatches.clear();
+		for (auto& timer : _timers)
+		{
+			if (timer->state() != ScopedTaskTimerImpl::State::SCHEDULED)
+				continue;
+			auto* scope = timer->_scope;
+			// A fire which the scope refuses or drops cancels the timer, so that it doesn't look pending forever.
+			ScopedTask task{ timer->_name };
+			task.makeHandler([timer = std::move(timer)](bool value) {
+				if (value)
+					timer->fire();
+				else
+					timer->cancel();
+			});
+			scope->tryDispatch(std::move(task));
 		}
+		_timers.clear();
+		lock.lock();
 	}
 }
 
+void Bn3Monkey::ScopedTaskLooperScheduler::tick(ScopedTaskLooperImpl& looper, const std::shared_ptr<ScopedTaskLooperState>& state, std::chrono::steady_clock::time_point deadline)
+{
+	// Cleared before running, so the next tick is queued while this one runs.
+	state->is_queued.store(false, std::memory_order_release);
+	if (!state->is_active.load(std::memory_order_acquire))
+		return;
+
+	state->record(std::chrono::steady_clock::now() - deadline);
+	state->task();
+
+	if (state->option.mode == ScopedTaskLooperMode::FIXED_DELAY)
+		rearm(looper, state, std::chrono::steady_clock::now() + state->interval);
+}
+
+void Bn3Monkey::ScopedTaskLooperScheduler::dropTick(ScopedTaskLooperImpl& looper, const std::shared_ptr<ScopedTaskLooperState>& state)
+{
+	// Otherwise a coalesced looper would coalesce every later tick into this one.
+	state->is_queued.store(false, std::memory_order_release);
+	// A fixed-delay looper left the heap when this tick was dispatched.
+	if (state->option.mode == ScopedTaskLooperMode::FIXED_DELAY)
+		rearm(looper, state, std::chrono::steady_clock::now() + state->interval);
+}
+
 void Bn3Monkey::ScopedTaskLooperScheduler::add(ScopedTaskLooperImpl& looper)
 {
 	{
 		std::unique_lock<std::mutex> lock(_mtx);
-		for (auto& activated_looper : _activated_loopers)
-			if (activated_looper->_name == looper._name)
-			{
-				return;
-			}
-
-		looper._next_launch_time = std::chrono::steady_clock::now();
-		_activated_loopers.push_back(&looper);
+		schedule(looper, std::chrono::steady_clock::now());
 	}
 	_cv.notify_all();
 }
@@ -132,14 +246,110 @@ void Bn3Monkey::ScopedTaskLooperScheduler::remove(ScopedTaskLooperImpl& looper)
 {
 	{
 		std::unique_lock<std::mutex> lock(_mtx);
-		for (auto iter = _activated_loopers.begin(); iter != _activated_loopers.end(); iter++)
-		{
-			if ((*iter)->_name == looper._name)
-			{
-				_activated_loopers.erase(iter);
-				break;
-			}
-		}
+		erase(looper);
+	}
+	_cv.notify_all();
+}
+
+void Bn3Monkey::ScopedTaskLooperScheduler::addTimer(ScopedTaskTimerHandle timer, std::chrono::steady_clock::time_point launch_time)
+{
+	{
+		std::unique_lock<std::mutex> lock(_mtx);
+		schedule(*timer.get(), launch_time);
+		timer.detach();
 	}
 	_cv.notify_all();
 }
+
+void Bn3Monkey::ScopedTaskLooperScheduler::removeTimer(ScopedTaskTimerImpl& timer)
+{
+	ScopedTaskTimerHandle reference;
+	{
+		std::unique_lock<std::mutex> lock(_mtx);
+		if (erase(timer))
+			reference = ScopedTaskTimerHandle::adopt(&timer);
+	}
+	// The earliest launch time only gets later, so routine doesn't need to be woken.
+}
+
+void Bn3Monkey::ScopedTaskLooperScheduler::rearm(ScopedTaskLooperImpl& looper, const std::shared_ptr<ScopedTaskLooperState>& state, std::chrono::steady_clock::time_point launch_time)
+{
+	{
+		std::unique_lock<std::mutex> lock(_mtx);
+		// stop clears is_active before removing the looper, so a stopped run is never scheduled again.
+		if (!state->is_active.load(std::memory_order_acquire))
+			return;
+		schedule(looper, launch_time);
+	}
+	_cv.notify_all();
+}
+
+void Bn3Monkey::ScopedTaskLooperScheduler::schedule(ScopedTaskTimerEntry& entry, std::chrono::steady_clock::time_point launch_time)
+{
+	if (entry._heap_index != ScopedTaskTimerEntry::NOT_SCHEDULED)
+		return;
+
+	entry._next_launch_time = launch_time;
+	_heap.push_back(&entry);
+	entry._heap_index = _heap.size() - 1;
+	siftUp(entry._heap_index);
+}
+
+bool Bn3Monkey::ScopedTaskLooperScheduler::erase(ScopedTaskTimerEntry& entry)
+{
+	size_t idx = entry._heap_index;
+	if (idx == ScopedTaskTimerEntry::NOT_SCHEDULED)
+		return false;
+
+	entry._heap_index = ScopedTaskTimerEntry::NOT_SCHEDULED;
+	auto* last = _heap.back();
+	_heap.pop_back();
+	if (last != &entry)
+	{
+		place(idx, last);
+		siftUp(idx);
+		siftDown(last->_heap_index);
+	}
+	return true;
+}
+
+void Bn3Monkey::ScopedTaskLooperScheduler::place(size_t idx, ScopedTaskTimerEntry* entry)
+{
+	_heap[idx] = entry;
+	entry->_heap_index = idx;
+}
+
+void Bn3Monkey::ScopedTaskLooperScheduler::siftUp(size_t idx)
+{
+	while (idx > 0)
+	{
+		size_t parent = (idx - 1) / 2;
+		if (!isEarlier(idx, parent))
+			break;
+		auto* entry = _heap[idx];
+		place(idx, _heap[parent]);
+		place(parent, entry);
+		idx = parent;
+	}
+}
+
+void Bn3Monkey::ScopedTaskLooperScheduler::siftDown(size_t idx)
+{
+	size_t size = _heap.size();
+	for (;;)
+	{
+		size_t earliest = idx;
+		size_t left = idx * 2 + 1;
+		size_t right = left + 1;
+		if (left < size && isEarlier(left, earliest))
+			earliest = left;
+		if (right < size && isEarlier(right, earliest))
+			earliest = right;
+		if (earliest == idx)
+			break;
+		auto* entry = _heap[idx];
+		place(idx, _heap[earliest]);
+		place(earliest, entry);
+		idx = earliest;
+	}
+}
@@ -3,11 +3,14 @@
 
 #include "../Tag/Tag.hpp"
 #include "ScopedTaskScopeImpl.hpp"
+#include "ScopedTaskCallable.hpp"
 
 #include <mutex>
 #include <condition_variable>
 #include <thread>
 #include <functional>
+#include <atomic>
+#include <cstdint>
 #include <unordered_map>
 
 #ifdef BN3MONKEY_DEBUG
@@ -71,64 +74,131 @@ namespace Bn3Monkey
 {
 	class ScopedTaskLooperScheduler;
 
-	class ScopedTaskLooperImpl
+	// Entry of the timer heap of the scheduler. Its fields are guarded by the mutex of the scheduler.
+	class ScopedTaskTimerEntry
+	{
+	protected:
+		explicit ScopedTaskTimerEntry(bool is_one_shot) : _is_one_shot(is_one_shot) {}
+
+		std::chrono::steady_clock::time_point _next_launch_time;
+
+		// Position in the heap. It is the handle for add and remove.
+		static constexpr size_t NOT_SCHEDULED = static_cast<size_t>(-1);
+		size_t _heap_index {NOT_SCHEDULED};
+
+		// A looper, or a ScopedTaskTimerImpl
+		const bool _is_one_shot;
+
+		friend class ScopedTaskLooperScheduler;
+	};
+
+	enum class ScopedTaskLooperMode
+	{
+		// Ticks are anchored to the start time (start + k * interval), so they don't drift.
+		// If the scheduler is late by more than an interval, the deadlines in between are skipped and counted as missed.
+		FIXED_RATE,
+		// The next tick is scheduled an interval after the previous one finishes.
+		FIXED_DELAY,
+	};
+
+	struct ScopedTaskLooperOption
+	{
+		ScopedTaskLooperMode mode {ScopedTaskLooperMode::FIXED_RATE};
+		// Skips a tick while the previous one is still queued on the scope, instead of queueing another.
+		bool is_coalesced {false};
+	};
+
+	struct ScopedTaskLooperStatistics
+	{
+		static constexpr size_t JITTER_BUCKET_COUNT = 16;
+
+		uint64_t fired {0};
+		uint64_t missed {0};
+		uint64_t coalesced {0};
+		uint64_t max_jitter_us {0};
+		// Delay from the deadline to the start of a tick. jitter[0] counts the ticks started within 1 us,
+		// jitter[k] the ones started within [2^(k-1), 2^k) us and the last bucket all the later ones.
+		uint64_t jitter[JITTER_BUCKET_COUNT] {};
+	};
+
+	// Shared by a looper and the ticks dispatched for it. Every start makes a new one, so the ticks of a previous run are told apart.
+	struct ScopedTaskLooperState
+	{
+		ScopedTaskLooperState(const ScopedTaskLooperOption& option, std::chrono::steady_clock::duration interval) : option(option), interval(interval) {}
+
+		ScopedTaskCallable<void()> task;
+		const ScopedTaskLooperOption option;
+		const std::chrono::steady_clock::duration interval;
+
+		std::atomic<bool> is_active {true};
+		std::atomic<bool> is_queued {false};
+
+		std::atomic<uint64_t> fired {0};
+		std::atomic<uint64_t> missed {0};
+		std::atomic<uint64_t> coalesced {0};
+		std::atomic<uint64_t> max_jitter_us {0};
+		std::atomic<uint64_t> jitter[ScopedTaskLooperStatistics::JITTER_BUCKET_COUNT] {};
+
+		void record(std::chrono::steady_clock::duration delay);
+		ScopedTaskLooperStatistics statistics() const;
+	};
+
+	class ScopedTaskLooperImpl : private ScopedTaskTimerEntry
 	{
 	public:
 		ScopedTaskLooperImpl(
 			const Bn3Tag& looper_name,
 			std::function<void(ScopedTaskLooperImpl&)> onAdd,
-			std::function<void(ScopedTaskLooperImpl&)> onRemove) : _name(looper_name), _onAdd(onAdd), _onRemove(onRemove)
+			std::function<void(ScopedTaskLooperImpl&)> onRemove) : ScopedTaskTimerEntry(false), _name(looper_name), _onAdd(onAdd), _onRemove(onRemove)
 		{}
 
 		ScopedTaskLooperImpl(const ScopedTaskLooperImpl& other) = delete;
 		ScopedTaskLooperImpl(ScopedTaskLooperImpl&& other);
 
-		template<class Func, class... Args>
-		void start(std::chrono::microseconds interval, ScopedTaskScopeImpl& scope, Func func, Args... args)
+		template<class Rep, class Period, class Func, class... Args>
+		void start(const ScopedTaskLooperOption& option, std::chrono::duration<Rep, Period> interval, ScopedTaskScopeImpl& scope, Func func, Args... args)
 		{
-			if (!_is_started)
+			if (_is_started)
+				return;
+
+			auto duration = std::chrono::duration_cast<std::chrono::steady_clock::duration>(interval);
+			if (duration.count() <= 0)
 			{
-				LOG_D("looper %s runs every %lld us", _name.str(), interval.count());
-				_is_started = true;
-				_interval = std::chrono::duration_cast<std::chrono::steady_clock::duration>(interval);
-				_scope = &scope;
-				_task = std::bind(std::forward<Func>(func), std::forward<Args>(args)...);
-				_onAdd(*this);
+				LOG_E("looper %s needs a positive interval", _name.str());
+				return;
 			}
+
+			auto state = MAKE_SHARED(ScopedTaskLooperState, _name, option, duration);
+			if (!state)
+			{
+				LOG_E("looper %s cannot be started", _name.str());
+				return;
+			}
+			state->task = std::bind(std::forward<Func>(func), std::forward<Args>(args)...);
+
+			LOG_D("looper %s runs every %lld us", _name.str(), static_cast<long long>(std::chrono::duration_cast<std::chrono::microseconds>(interval).count()));
+			_is_started = true;
+			_scope = &scope;
+			_state = std::move(state);
+			_onAdd(*this);
 		}
 
+		template<class Func, class... Args>
+		void start(std::chrono::microseconds interval, ScopedTaskScopeImpl& scope, Func func, Args... args)
+		{
+			start(ScopedTaskLooperOption(), interval, scope, std::forward<Func>(func), std::forward<Args>(args)...);
+		}
 
 		template<class Func, class... Args>
 		void start(std::chrono::milliseconds interval, ScopedTaskScopeImpl& scope, Func func, Args... args)
 		{
-			if (!_is_started)
-			{
-				LOG_D("looper %s runs every %lld ms", _name.str(), interval.count());
-				_is_started = true;
-				_interval = std::chrono::duration_cast<std::chrono::steady_clock::duration>(interval);
-				_scope = &scope;
-				_task = std::bind(std::forward<Func>(func), std::forward<Args>(args)...);
-
-				_onAdd(*this);
-			}
+			start(ScopedTaskLooperOption(), interval, scope, std::forward<Func>(func), std::forward<Args>(args)...);
 		}
 
-
 		template<class Func, class... Args>
 		void start(std::chrono::seconds interval, ScopedTaskScopeImpl& scope, Func func, Args... args)
 		{
-			if (!_is_started)
-			{
-				LOG_D("looper %s runs every %lld s", _name.str(), interval.count());
-
-				_is_started = true;
-
-				_interval = std::chrono::duration_cast<std::chrono::steady_clock::duration>(interval);
-				_scope = &scope;
-				_task = std::bind(std::forward<Func>(func), std::forward<Args>(args)...);
-
-				_onAdd(*this);
-			}
+			start(ScopedTaskLooperOption(), interval, scope, std::forward<Func>(func), std::forward<Args>(args)...);
 		}
 
 		void stop()
@@ -136,37 +206,174 @@ namespace Bn3Monkey
 			if (_is_started)
 			{
 				_is_started = false;
-				
-				_scope = nullptr;
-				_task = nullptr;
 
+				// Ticks already queued on the scope are not run anymore.
+				_state->is_active.store(false, std::memory_order_release);
+				// Removed first, so that the scheduler never dispatches with the cleared scope.
 				_onRemove(*this);
+
+				_scope = nullptr;
 			}
 		}
 
+		// Statistics of the current run, or of the last one after stop.
+		ScopedTaskLooperStatistics statistics() const
+		{
+			return _state ? _state->statistics() : ScopedTaskLooperStatistics();
+		}
+
 	private:
 		Bn3Tag _name;
 		std::function<void(ScopedTaskLooperImpl&)> _onAdd;
 		std::function<void(ScopedTaskLooperImpl&)> _onRemove;
 
-		std::chrono::steady_clock::duration _interval;
-		std::chrono::steady_clock::time_point _next_launch_time;
-
 		ScopedTaskScopeImpl* _scope {nullptr};
-		std::function<void()> _task;		
+		// Shared with the tasks dispatched to the scope, so that dispatching doesn't copy the callable.
+		std::shared_ptr<ScopedTaskLooperState> _state;
 		bool _is_started {false};
 
 		friend class ScopedTaskLooperScheduler;
 	};
 
+	// A task run once on a scope at a given time. Allocated from the memory pool and shared by its handles, the heap and the dispatched task.
+	class ScopedTaskTimerImpl : private ScopedTaskTimerEntry
+	{
+	public:
+		enum class State : uint32_t
+		{
+			SCHEDULED,
+			FIRED,
+			CANCELLED,
+		};
+
+		ScopedTaskTimerImpl(const Bn3Tag& name, ScopedTaskScopeImpl* scope, ScopedTaskCallable<void()>&& task) : ScopedTaskTimerEntry(true), _name(name), _scope(scope), _task(std::move(task))
+		{}
+
+		inline void retain()
+		{
+			_references.fetch_add(1, std::memory_order_relaxed);
+		}
+		// Returns true if the last reference is released.
+		inline bool release()
+		{
+			return _references.fetch_sub(1, std::memory_order_acq_rel) == 1;
+		}
+
+		// Returns true if the task is cancelled before it starts.
+		inline bool cancel()
+		{
+			uint32_t expected = static_cast<uint32_t>(State::SCHEDULED);
+			return _state.compare_exchange_strong(expected, static_cast<uint32_t>(State::CANCELLED), std::memory_order_acq_rel);
+		}
+		inline State state() const
+		{
+			return static_cast<State>(_state.load(std::memory_order_acquire));
+		}
+
+		// Runs on the scope
+		inline void fire()
+		{
+			uint32_t expected = static_cast<uint32_t>(State::SCHEDULED);
+			if (_state.compare_exchange_strong(expected, static_cast<uint32_t>(State::FIRED), std::memory_order_acq_rel))
+				_task();
+		}
+
+	private:
+		Bn3Tag _name;
+		ScopedTaskScopeImpl* _scope;
+		ScopedTaskCallable<void()> _task;
+		std::atomic<uint32_t> _state {static_cast<uint32_t>(State::SCHEDULED)};
+		std::atomic<uint32_t> _references {1};
+
+		friend class ScopedTaskLooperScheduler;
+	};
+
+	class ScopedTaskTimerHandle
+	{
+	public:
+		ScopedTaskTimerHandle() {}
+		ScopedTaskTimerHandle(const ScopedTaskTimerHandle& other) : _ptr(other._ptr)
+		{
+			if (_ptr)
+				_ptr->retain();
+		}
+		ScopedTaskTimerHandle(ScopedTaskTimerHandle&& other) noexcept : _ptr(other._ptr)
+		{
+			other._ptr = nullptr;
+		}
+		ScopedTaskTimerHandle& operator=(const ScopedTaskTimerHandle& other)
+		{
+			if (this != &other)
+			{
+				reset();
+				_ptr = other._ptr;
+				if (_ptr)
+					_ptr->retain();
+			}
+			return *this;
+		}
+		ScopedTaskTimerHandle& operator=(ScopedTaskTimerHandle&& other) noexcept
+		{
+			if (this != &other)
+			{
+				reset();
+				_ptr = other._ptr;
+				other._ptr = nullptr;
+			}
+			return *this;
+		}
+		~ScopedTaskTimerHandle()
+		{
+			reset();
+		}
+
+		static ScopedTaskTimerHandle make(const Bn3Tag& task_name, ScopedTaskScopeImpl& scope, ScopedTaskCallable<void()>&& task)
+		{
+			return adopt(Bn3MemoryPool::construct<ScopedTaskTimerImpl>(task_name, task_name, &scope, std::move(task)));
+		}
+		// Takes over a reference which is already counted.
+		static ScopedTaskTimerHandle adopt(ScopedTaskTimerImpl* ptr)
+		{
+			ScopedTaskTimerHandle ret;
+			ret._ptr = ptr;
+			return ret;
+		}
+		// Gives up the reference without releasing it.
+		ScopedTaskTimerImpl* detach()
+		{
+			auto* ret = _ptr;
+			_ptr = nullptr;
+			return ret;
+		}
+
+		void reset()
+		{
+			if (_ptr && _ptr->release())
+				Bn3MemoryPool::destroy(_ptr);
+			_ptr = nullptr;
+		}
+
+		explicit operator bool() const { return _ptr != nullptr; }
+		inline ScopedTaskTimerImpl* operator->() const { return _ptr; }
+		inline ScopedTaskTimerImpl* get() const { return _ptr; }
+
+	private:
+		ScopedTaskTimerImpl* _ptr {nullptr};
+	};
+
 	class ScopedTaskLooperScheduler
 	{
 	public:
 		ScopedTaskLooperScheduler();
+		~ScopedTaskLooperScheduler();
 
 		void start();
 		void stop();
 
+		// The heap keeps a reference of timer until it is dispatched or removed.
+		void addTimer(ScopedTaskTimerHandle timer, std::chrono::steady_clock::time_point launch_time);
+		void removeTimer(ScopedTaskTimerImpl& timer);
+
 		inline std::function<void(ScopedTaskLooperImpl&)>& onAdd() {
 			return _onAdd;
 		}
@@ -178,10 +385,38 @@ namespace Bn3Monkey
 		ScopedTaskLooperImpl& getLooper(const Bn3Tag& looper_name);
 
 	private:
+		// Copied from a looper under the lock, so that the task is dispatched outside the lock.
+		struct Dispatch
+		{
+			ScopedTaskScopeImpl* scope;
+			Bn3Tag name;
+			ScopedTaskLooperImpl* looper;
+			std::shared_ptr<ScopedTaskLooperState> state;
+			std::chrono::steady_clock::time_point deadline;
+		};
+
 		void routine();
+		// Runs on the scope
+		void tick(ScopedTaskLooperImpl& looper, const std::shared_ptr<ScopedTaskLooperState>& state, std::chrono::steady_clock::time_point deadline);
+		// Runs instead of tick when the tick is cancelled
+		void dropTick(ScopedTaskLooperImpl& looper, const std::shared_ptr<ScopedTaskLooperState>& state);
 
 		void add(ScopedTaskLooperImpl& looper);
 		void remove(ScopedTaskLooperImpl& looper);
+		// Schedules a fixed-delay looper again after its tick, unless it has been stopped since.
+		void rearm(ScopedTaskLooperImpl& looper, const std::shared_ptr<ScopedTaskLooperState>& state, std::chrono::steady_clock::time_point launch_time);
+
+		// Called with the lock. erase returns false if entry is not in the heap.
+		void schedule(ScopedTaskTimerEntry& entry, std::chrono::steady_clock::time_point launch_time);
+		bool erase(ScopedTaskTimerEntry& entry);
+
+		// Min-heap of loopers and timers by the next launch time
+		inline bool isEarlier(size_t lhs, size_t rhs) {
+			return _heap[lhs]->_next_launch_time < _heap[rhs]->_next_launch_time;
+		}
+		void place(size_t idx, ScopedTaskTimerEntry* entry);
+		void siftUp(size_t idx);
+		void siftDown(size_t idx);
 
 		std::function<void()> _onStart;
 		std::function<void()> _onStop;
@@ -189,9 +424,12 @@ namespace Bn3Monkey
 		std::function<void(ScopedTaskLooperImpl&)> _onRemove;
 
 		Bn3Deque(ScopedTaskLooperImpl) _loopers;
-		Bn3List(ScopedTaskLooperImpl*) _activated_loopers;
+		Bn3Vector(ScopedTaskTimerEntry*) _heap;
+		// Only used by routine
+		Bn3Vector(Dispatch) _dispatches;
+		Bn3Vector(ScopedTaskTimerHandle) _timers;
 
-		bool _is_running;
+		bool _is_running{ false };
 		std::mutex _mtx;
 		std::condition_variable _cv;
 
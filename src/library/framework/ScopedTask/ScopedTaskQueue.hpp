@@ -0,0 +1,150 @@
+#ifndef __BN3MONKEY_SCOPED_TASK_QUEUE__
+#define __BN3MONKEY_SCOPED_TASK_QUEUE__
+
+#include <atomic>
+#include <cstdint>
+
+#include "ScopedTaskImpl.hpp"
+
+namespace Bn3Monkey
+{
+    struct ScopedTaskLink
+    {
+        std::atomic<ScopedTaskLink*> next{ nullptr };
+    };
+
+    struct ScopedTaskNode : public ScopedTaskLink
+    {
+        ScopedTask task;
+        // Priority lane of the scope it is pushed to
+        uint32_t lane{ 0 };
+        // Registered for COALESCE_BY_TAG. Read by the consumer after popping.
+        bool is_coalescable{ false };
+    };
+
+    // Intrusive multi-producer / single-consumer queue of tasks (Vyukov).
+    // push() is wait-free and can be called from any thread. pop() and empty() must be called by the consumer only.
+    // Nodes are allocated from the memory pool.
+    class ScopedTaskQueue
+    {
+    public:
+        explicit ScopedTaskQueue(const Bn3Tag& tag) : _tag(tag)
+        {
+        }
+        ScopedTaskQueue(const ScopedTaskQueue& other) = delete;
+        // Must not be used while other is accessed by another thread.
+        ScopedTaskQueue(ScopedTaskQueue&& other) : _tag(other._tag)
+        {
+            while (auto* node = other.popNode())
+                pushNode(node);
+        }
+
+        ~ScopedTaskQueue()
+        {
+            while (auto* node = popNode())
+            {
+                node->task.cancel();
+                Bn3MemoryPool::destroy(node);
+            }
+        }
+
+        // Returns false if no node can be allocated. Then task is not moved.
+        bool push(ScopedTask&& task)
+        {
+            auto* node = makeNode(std::move(task));
+            if (!node)
+                return false;
+            pushNode(node);
+            return true;
+        }
+
+        // Allocates a node separately from linking it, for the producer which must not fail after counting or deferring the task.
+        ScopedTaskNode* makeNode(ScopedTask&& task)
+        {
+            auto* node = Bn3MemoryPool::construct<ScopedTaskNode>(_tag);
+            if (node)
+                node->task = std::move(task);
+            return node;
+        }
+        void push(ScopedTaskNode* node)
+        {
+            pushNode(node);
+        }
+        // Frees a node which is not pushed.
+        void destroyNode(ScopedTaskNode* node)
+        {
+            Bn3MemoryPool::destroy(node);
+        }
+
+        bool pop(ScopedTask& task)
+        {
+            auto* node = popNode();
+            if (!node)
+                return false;
+            task = std::move(node->task);
+            Bn3MemoryPool::destroy(node);
+            return true;
+        }
+        // Same as pop, but the caller takes the node and frees it with destroyNode.
+        ScopedTaskNode* take()
+        {
+            return popNode();
+        }
+
+        // A push which is not linked yet is not visible.
+        // The producer checks the state of the consumer after linking, so it cannot be missed by both.
+        bool empty()
+        {
+            if (_head != &_stub)
+                return false;
+            return _stub.next.load(std::memory_order_seq_cst) == nullptr;
+        }
+
+    private:
+        void pushNode(ScopedTaskLink* node)
+        {
+            node->next.store(nullptr, std::memory_order_relaxed);
+            auto* prev = _tail.exchange(node, std::memory_order_acq_rel);
+            prev->next.store(node, std::memory_order_seq_cst);
+        }
+
+        ScopedTaskNode* popNode()
+        {
+            auto* head = _head;
+            auto* next = head->next.load(std::memory_order_acquire);
+            if (head == &_stub)
+            {
+                if (next == nullptr)
+                    return nullptr;
+                _head = next;
+                head = next;
+                next = next->next.load(std::memory_order_acquire);
+            }
+            if (next)
+            {
+                _head = next;
+                return static_cast<ScopedTaskNode*>(head);
+            }
+
+            // head is the last node. Put the stub behind it so that head can be detached.
+            if (head != _tail.load(std::memory_order_acquire))
+                return nullptr;
+            pushNode(&_stub);
+
+            next = head->next.load(std::memory_order_acquire);
+            if (next)
+            {
+                _head = next;
+                return static_cast<ScopedTaskNode*>(head);
+            }
+            return nullptr;
+        }
+
+        Bn3Tag _tag;
+        ScopedTaskLink _stub;
+        ScopedTaskLink* _head{ &_stub };
+        std::atomic<ScopedTaskLink*> _tail{ &_stub };
+    };
+}
+
+#endif // __BN3MONKEY_SCOPED_TASK_QUEUE__
@@ -4,28 +4,45 @@
 
 using namespace Bn3Monkey;
 
+// The number of tasks a strand runs before yielding its worker to other strands
+constexpr int64_t STRAND_BATCH_SIZE = 64;
+// A lane with tasks is served after being passed over this many times by higher lanes
+constexpr uint32_t LANE_AGING_LIMIT = 8;
+
+static thread_local ScopedTaskScopeImpl* current_scope{ nullptr };
+
 ScopedTaskScopeImpl::ScopedTaskScopeImpl(const Bn3Tag& scope_name,
     std::function<ScopedTaskScopeImpl*()> getCurrentScope,
-    std::function<bool()> is_pool_initialized) :
+    const std::atomic<bool>* is_pool_initialized,
+    ScopedTaskWorkerPool* worker_pool) :
     _name(scope_name),
     _getCurrentScope(getCurrentScope),
-    _is_pool_initialized(is_pool_initialized)
+    _tasks{ ScopedTaskQueue(Bn3Tag("tasks_", scope_name)), ScopedTaskQueue(Bn3Tag("tasks_", scope_name)), ScopedTaskQueue(Bn3Tag("tasks_", scope_name)) },
+    _is_pool_initialized(is_pool_initialized),
+    _worker_pool(worker_pool)
 {
-    _tasks = Bn3Queue(ScopedTask) { Bn3QueueAllocator(ScopedTask, Bn3Tag("tasks_", _name)) };
-
 }
 
 ScopedTaskScopeImpl::ScopedTaskScopeImpl(ScopedTaskScopeImpl&& other)
     : 
       _name(other._name),
       _getCurrentScope(std::move(other._getCurrentScope)),
-      _is_pool_initialized(std::move(other._is_pool_initialized)),
-      _thread(std::move(other._thread)),
       _id(std::move(other._id)),
-      _state(std::move(other._state)),
+      _state(other._state.load()),
       _current_task(std::move(other._current_task)),
-      _tasks(std::move(other._tasks))
+      _tasks{ std::move(other._tasks[0]), std::move(other._tasks[1]), std::move(other._tasks[2]) },
+      _is_pool_initialized(other._is_pool_initialized),
+      _worker_pool(other._worker_pool),
+      _pending(other._pending.load())
 {
+    for (size_t lane = 0; lane < SCOPED_TASK_PRIORITY_COUNT; lane++)
+    {
+        _lane_depths[lane].store(other._lane_depths[lane].load());
+        _lane_capacities[lane].store(other._lane_capacities[lane].load());
+    }
+    _capacity.store(other._capacity.load());
+    _policy.store(other._policy.load());
+    _depth.store(other._depth.load());
 
 }
 
@@ -35,65 +52,356 @@ ScopedTaskScopeImpl::~ScopedTaskScopeImpl()
 
 bool ScopedTaskScopeImpl::start()
 {
-    if (ScopeState::IDLE == _state)
+    if (ScopeState::IDLE != _state.load(std::memory_order_acquire))
+        return true;
+
+    if (!isPoolInitialized())
+    {
+        LOG_D("Scope (%s) cannot be started", _name.str());
+        return false;
+    }
+
+    // The worker which is exiting may take the scope back in the meantime.
+    auto expected = ScopeState::IDLE;
+    if (_state.compare_exchange_strong(expected, ScopeState::RUNNING))
     {
         LOG_D("Scope (%s) starts", _name.str());
+        std::thread{ &ScopedTaskScopeImpl::worker, this }.detach();
+    }
+    return true;
+}
+
+ScopedTaskRunStatus ScopedTaskScopeImpl::push(ScopedTask&& task, ScopedTaskPriority priority, bool is_blocking)
+{
+    // A task whose callable could not be allocated has nothing to run or to cancel.
+    if (!task)
+    {
+        LOG_E("Task (%s) has no callable", task.name());
+        return ScopedTaskRunStatus::OUT_OF_MEMORY;
+    }
+
+    auto lane = static_cast<size_t>(priority);
+    auto* node = _tasks[lane].makeNode(std::move(task));
+    if (!node)
+    {
+        LOG_E("Task (%s) cannot be queued to scope (%s)", task.name(), _name.str());
+        task.cancel();
+        return ScopedTaskRunStatus::OUT_OF_MEMORY;
+    }
+    node->lane = static_cast<uint32_t>(lane);
+    return push(node, is_blocking);
+}
+
+ScopedTaskRunStatus ScopedTaskScopeImpl::push(ScopedTaskNode* node, bool is_blocking)
+{
+    if (_worker_pool ? !isAccepting() : !start())
+    {
+        cancel(node);
+        return ScopedTaskRunStatus::STOPPED;
+    }
+
+    auto status = admit(node, is_blocking);
+    if (ScopedTaskRunStatus::COALESCED == status)
+    {
+        // The task has been moved into the queued node.
+        _tasks[node->lane].destroyNode(node);
+        return status;
+    }
+    if (!isAccepted(status))
+    {
+        cancel(node);
+        return status;
+    }
+
+    if (_worker_pool)
+    {
+        // Counted before linked, so that the strand never runs a task which is not counted.
+        bool is_scheduled = _pending.fetch_add(1, std::memory_order_acq_rel) == 0;
+        _tasks[node->lane].push(node);
+        if (is_scheduled)
+            _worker_pool->submit(this);
+        return status;
+    }
+
+    _tasks[node->lane].push(node);
+    wake();
+    return status;
+}
+
+void ScopedTaskScopeImpl::cancel(ScopedTaskNode* node)
+{
+    node->task.cancel();
+    _tasks[node->lane].destroyNode(node);
+}
+
+ScopedTaskRunStatus ScopedTaskScopeImpl::admit(ScopedTaskNode* node, bool is_blocking)
+{
+    if (!reserveLane(node))
+        return ScopedTaskRunStatus::REJECTED;
+
+    for (;;)
+    {
+        auto capacity = _capacity.load(std::memory_order_relaxed);
+        auto policy = _policy.load(std::memory_order_relaxed);
+        auto depth = _depth.fetch_add(1, std::memory_order_seq_cst);
+        if (capacity == 0 || depth < capacity)
+        {
+            if (ScopedTaskCapacityPolicy::COALESCE_BY_TAG == policy)
+                registerCoalescable(node);
+            return ScopedTaskRunStatus::QUEUED;
+        }
+
+        switch (policy)
+        {
+        case ScopedTaskCapacityPolicy::DROP_OLDEST:
+            // The consumer cancels one queued task for this, so the depth settles back to the capacity.
+            _drops.fetch_add(1, std::memory_order_relaxed);
+            return ScopedTaskRunStatus::DROPPED_OLDEST;
+        case ScopedTaskCapacityPolicy::BLOCK:
+            if (currentScope() == this)
+                return ScopedTaskRunStatus::QUEUED;
+            _depth.fetch_sub(1, std::memory_order_seq_cst);
+            if (!is_blocking)
+            {
+                releaseLane(node);
+                LOG_E("Task (%s) is rejected because scope (%s) is full", node->task.name(), _name.str());
+                return ScopedTaskRunStatus::REJECTED;
+            }
+            if (!waitForSpace())
+            {
+                releaseLane(node);
+                return ScopedTaskRunStatus::STOPPED;
+            }
+            continue;
+        case ScopedTaskCapacityPolicy::COALESCE_BY_TAG:
+            _depth.fetch_sub(1, std::memory_order_seq_cst);
+            releaseLane(node);
+            if (coalesce(node))
+                return ScopedTaskRunStatus::COALESCED;
+            LOG_E("Task (%s) is rejected because scope (%s) is full", node->task.name(), _name.str());
+            return ScopedTaskRunStatus::REJECTED;
+        default:
+            _depth.fetch_sub(1, std::memory_order_seq_cst);
+            releaseLane(node);
+            LOG_E("Task (%s) is rejected because scope (%s) is full", node->task.name(), _name.str());
+            return ScopedTaskRunStatus::REJECTED;
+        }
+    }
+}
+
+bool ScopedTaskScopeImpl::reserveLane(ScopedTaskNode* node)
+{
+    auto lane = node->lane;
+    auto capacity = _lane_capacities[lane].load(std::memory_order_relaxed);
+    auto depth = _lane_depths[lane].fetch_add(1, std::memory_order_relaxed);
+    if (capacity == 0 || depth < capacity)
+        return true;
+
+    _lane_depths[lane].fetch_sub(1, std::memory_order_relaxed);
+    LOG_E("Task (%s) is dropped because lane %u of scope (%s) is full", node->task.name(), lane, _name.str());
+    return false;
+}
+
+void ScopedTaskScopeImpl::releaseLane(ScopedTaskNode* node)
+{
+    _lane_depths[node->lane].fetch_sub(1, std::memory_order_relaxed);
+}
+
+bool ScopedTaskScopeImpl::waitForSpace()
+{
+    // The consumer may need a worker of the shared pool.
+    ScopedTaskWorkerBlocking blocking;
+    bool ret = true;
 
-        if (!_is_pool_initialized())
+    // Paired with the consumer decreasing _depth before it checks _blocked_producers
+    _blocked_producers.fetch_add(1, std::memory_order_seq_cst);
+    for (;;)
+    {
+        auto epoch = _space_epoch.load(std::memory_order_acquire);
+        auto capacity = _capacity.load(std::memory_order_relaxed);
+        if (capacity == 0 || _depth.load(std::memory_order_seq_cst) < capacity)
+            break;
+        if (!isAccepting())
         {
-            LOG_D("Scope (%s) cannot be started", _name.str());
+            ret = false;
+            break;
+        }
+
+        waitOnAddressFor(_space_epoch, epoch, std::chrono::milliseconds(1));
+    }
+    _blocked_producers.fetch_sub(1, std::memory_order_relaxed);
+    return ret;
+}
+
+void ScopedTaskScopeImpl::registerCoalescable(ScopedTaskNode* node)
+{
+    std::lock_guard<std::mutex> lock(_coalesce_mtx);
+    _coalesce_slots[node->task.tag().id() % COALESCE_SLOT_COUNT] = node;
+    node->is_coalescable = true;
+}
+
+bool ScopedTaskScopeImpl::coalesce(ScopedTaskNode* node)
+{
+    ScopedTask stale;
+    {
+        std::lock_guard<std::mutex> lock(_coalesce_mtx);
+        auto* queued = _coalesce_slots[node->task.tag().id() % COALESCE_SLOT_COUNT];
+        if (!queued || !(queued->task.tag() == node->task.tag()))
             return false;
+        stale = std::move(queued->task);
+        queued->task = std::move(node->task);
+    }
+    // Cancelled outside the lock, because it may run continuations which push to this scope.
+    stale.cancel();
+    return true;
+}
+
+bool ScopedTaskScopeImpl::pop(ScopedTask& task, bool& is_dropped)
+{
+    is_dropped = false;
+
+    // The oldest task of the lowest lane is dropped for each task queued over the capacity.
+    auto drops = _drops.load(std::memory_order_relaxed);
+    while (drops > 0)
+    {
+        if (!_drops.compare_exchange_weak(drops, drops - 1, std::memory_order_relaxed))
+            continue;
+        for (size_t lane = SCOPED_TASK_PRIORITY_COUNT; lane-- > 0;)
+        {
+            if (popLane(lane, task))
+            {
+                is_dropped = true;
+                return true;
+            }
         }
+        break;
+    }
 
-        _thread = std::thread{ &ScopedTaskScopeImpl::worker, this };
-        _thread.detach();
+    // Starved lanes go first, so that a storm of higher priority tasks only delays lower ones.
+    for (size_t lane = 1; lane < SCOPED_TASK_PRIORITY_COUNT; lane++)
+    {
+        if (_lane_ages[lane] >= LANE_AGING_LIMIT && popLane(lane, task))
+            return true;
+    }
 
+    for (size_t lane = 0; lane < SCOPED_TASK_PRIORITY_COUNT; lane++)
+    {
+        if (popLane(lane, task))
         {
-            std::mutex local_mtx;
-            std::unique_lock<std::mutex> lock(local_mtx);
-            _cv.wait(lock, [&]() {
-                return ScopeState::EMPTY == _state;
-                });
+            for (size_t lower = lane + 1; lower < SCOPED_TASK_PRIORITY_COUNT; lower++)
+                _lane_ages[lower] = _tasks[lower].empty() ? 0 : _lane_ages[lower] + 1;
+            return true;
         }
     }
+    return false;
+}
+
+bool ScopedTaskScopeImpl::popLane(size_t lane, ScopedTask& task)
+{
+    auto* node = _tasks[lane].take();
+    if (!node)
+        return false;
+
+    if (node->is_coalescable)
+    {
+        std::lock_guard<std::mutex> lock(_coalesce_mtx);
+        auto& slot = _coalesce_slots[node->task.tag().id() % COALESCE_SLOT_COUNT];
+        if (slot == node)
+            slot = nullptr;
+        task = std::move(node->task);
+    }
+    else
+    {
+        task = std::move(node->task);
+    }
+    _tasks[lane].destroyNode(node);
+
+    _lane_depths[lane].fetch_sub(1, std::memory_order_relaxed);
+    _lane_ages[lane] = 0;
+
+    _depth.fetch_sub(1, std::memory_order_seq_cst);
+    if (_blocked_producers.load(std::memory_order_seq_cst) > 0)
+    {
+        _space_epoch.fetch_add(1, std::memory_order_release);
+        wakeByAddress(_space_epoch);
+    }
     return true;
 }
 
-void ScopedTaskScopeImpl::push(ScopedTask&& task)
+bool ScopedTaskScopeImpl::empty()
 {
-    _tasks.push(std::move(task));
-    if (ScopeState::EMPTY == _state)
+    for (auto& tasks : _tasks)
     {
-        _state = ScopeState::RUNNING;
+        if (!tasks.empty())
+            return false;
     }
+    return true;
 }
 
-void ScopedTaskScopeImpl::stop()
+void ScopedTaskScopeImpl::wake()
 {
-    LOG_D("Scope (%s) stops", _name.str());
-    
-    bool is_stopped{ false };
+    auto state = _state.load(std::memory_order_seq_cst);
+    for (;;)
     {
-        std::unique_lock<std::mutex> lock(_mtx);
-        if (ScopeState::IDLE != _state)
+        if (ScopeState::EMPTY == state)
         {
-            _state = ScopeState::STOPPING;
-            is_stopped = true;
+            if (_state.compare_exchange_weak(state, ScopeState::RUNNING))
+            {
+                {
+                    std::lock_guard<std::mutex> lock(_mtx);
+                }
+                _cv.notify_all();
+                return;
+            }
+        }
+        else if (ScopeState::IDLE == state)
+        {
+            start();
+            return;
+        }
+        else
+        {
+            return;
         }
-
     }
+}
 
+void ScopedTaskScopeImpl::stop()
+{
+    LOG_D("Scope (%s) stops", _name.str());
 
-    if (is_stopped)
+    if (_worker_pool)
     {
-        _cv.notify_all();
+        // The strand cancels the rest of the tasks. Waits until it has none.
+        _state.store(ScopeState::STOPPING);
         {
-            std::mutex local_mtx;
-            std::unique_lock<std::mutex> lock(local_mtx);
+            std::unique_lock<std::mutex> lock(_mtx);
             _cv.wait(lock, [&]() {
-                return ScopeState::IDLE == _state;
+                return _pending.load() == 0;
                 });
         }
+        _state.store(ScopeState::IDLE);
+        return;
+    }
+    
+    auto state = _state.load();
+    for (;;)
+    {
+        if (ScopeState::IDLE == state)
+            return;
+        if (ScopeState::STOPPING == state || _state.compare_exchange_weak(state, ScopeState::STOPPING))
+            break;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(_mtx);
+    }
+    _cv.notify_all();
+    {
+        std::unique_lock<std::mutex> lock(_mtx);
+        _cv.wait(lock, [&]() {
+            return ScopeState::IDLE == _state.load();
+            });
     }
 }
 
@@ -105,80 +413,152 @@ void ScopedTaskScopeImpl::worker()
     setThreadName(thread_name.c_str());
 
     _id = std::this_thread::get_id();
+    current_scope = this;
 
-    _state = ScopeState::EMPTY;
-    _cv.notify_all();
-
+    bool is_dropped{ false };
     for (;;)
     {
-        {
-            std::unique_lock<std::mutex> lock(_mtx);
-            using namespace std::chrono_literals;
-            _current_task.clear();
-
-            bool timeout = _cv.wait_for(lock, 10s, [&]() {
-                return _state != ScopeState::EMPTY;
-                });
+        if (ScopeState::STOPPING == _state.load(std::memory_order_acquire))
+            break;
 
-            if (!timeout)
+        if (pop(_current_task, is_dropped))
+        {
+            if (is_dropped)
             {
-                if (_state == ScopeState::EMPTY)
-                {
-                    _state = ScopeState::STOPPING;
-                }
+                LOG_D("Scope(%s) - Tasks(%s) dropped", _name.str(), _current_task.name());
+                _current_task.cancel();
             }
-
-            if (ScopeState::STOPPING == _state)
+            else
             {
-                LOG_D("Scope (%s) : Cancel all non-executed tasks ", _name.str());
-                while (!_tasks.empty())
-                {
-                    _current_task = std::move(_tasks.front());
-                    _tasks.pop();
-                    _current_task.cancel();
-                }
-                LOG_D("Worker (%s) Ends", _name.str());
-                _state = ScopeState::IDLE;
-                break;
+                LOG_D("Scope(%s) - Tasks(%s) start", _name.str(), _current_task.name());
+                _current_task.invoke();
+                LOG_D("Scope(%s) - Tasks(%s) ends", _name.str(), _current_task.name());
             }
+            _current_task.clear();
+            continue;
+        }
 
-            
-            _current_task = std::move(_tasks.front());
-            _tasks.pop();
+        // Park. A producer sees EMPTY after linking its task, or this sees the task after publishing EMPTY.
+        auto expected = ScopeState::RUNNING;
+        if (!_state.compare_exchange_strong(expected, ScopeState::EMPTY))
+            continue;
+        if (!empty())
+        {
+            expected = ScopeState::EMPTY;
+            _state.compare_exchange_strong(expected, ScopeState::RUNNING);
+            continue;
+        }
+        LOG_D("Scope(%s) - Tasks empty", _name.str());
 
-            if (_tasks.empty())
-            {
-                _state = ScopeState::EMPTY;
-                LOG_D("Scope(%s) - Tasks empty", _name.str());
-            }
-            else
-            {
-                _state = ScopeState::RUNNING;
-                LOG_D("Scope(%s) - Tasks remained", _name.str());
-            }
+        bool is_woken{ false };
+        {
+            std::unique_lock<std::mutex> lock(_mtx);
+            using namespace std::chrono_literals;
+            is_woken = _cv.wait_for(lock, 10s, [&]() {
+                return ScopeState::EMPTY != _state.load();
+                });
         }
+        if (is_woken)
+            continue;
 
-        LOG_D("Scope(%s) - Tasks(%s) start", _name.str(), _current_task.name());
-        _current_task.invoke();
-        LOG_D("Scope(%s) - Tasks(%s) ends", _name.str(), _current_task.name());
+        expected = ScopeState::EMPTY;
+        if (!_state.compare_exchange_strong(expected, ScopeState::IDLE))
+            continue;
+        // A producer which has seen IDLE starts a new worker unless this takes the scope back first.
+        if (!empty())
+        {
+            expected = ScopeState::IDLE;
+            if (_state.compare_exchange_strong(expected, ScopeState::RUNNING))
+                continue;
+        }
+        LOG_D("Worker (%s) Ends by timeout", _name.str());
+        current_scope = nullptr;
+        return;
     }
 
+    LOG_D("Scope (%s) : Cancel all non-executed tasks ", _name.str());
+    while (pop(_current_task, is_dropped))
+    {
+        _current_task.cancel();
+        _current_task.clear();
+    }
+    LOG_D("Worker (%s) Ends", _name.str());
+    current_scope = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(_mtx);
+        _state.store(ScopeState::IDLE);
+    }
     _cv.notify_all();
 }
 
+void ScopedTaskScopeImpl::runStrand()
+{
+    auto* prev_scope = current_scope;
+    current_scope = this;
+
+    int64_t executed = 0;
+    bool is_dropped{ false };
+    while (executed < STRAND_BATCH_SIZE && pop(_current_task, is_dropped))
+    {
+        if (is_dropped || ScopeState::STOPPING == _state.load(std::memory_order_acquire))
+        {
+            _current_task.cancel();
+        }
+        else
+        {
+            LOG_D("Scope(%s) - Tasks(%s) start", _name.str(), _current_task.name());
+            _current_task.invoke();
+            LOG_D("Scope(%s) - Tasks(%s) ends", _name.str(), _current_task.name());
+        }
+        _current_task.clear();
+        executed++;
+    }
+
+    current_scope = prev_scope;
+
+    // Tasks which are counted but not linked yet are picked up when the strand runs again.
+    if (_pending.fetch_sub(executed) != executed)
+    {
+        _worker_pool->submit(this);
+        return;
+    }
+
+    if (ScopeState::STOPPING == _state.load())
+    {
+        {
+            std::lock_guard<std::mutex> lock(_mtx);
+        }
+        _cv.notify_all();
+    }
+}
+
+ScopedTaskScopeImpl* ScopedTaskScopeImpl::currentScope()
+{
+    return current_scope;
+}
+
 /***********************************************/
-ScopedTaskScopeImplPool::ScopedTaskScopeImplPool()
+ScopedTaskScopeImplPool::ScopedTaskScopeImplPool(ScopedTaskExecution execution, size_t worker_count)
 {
     _scopes = Bn3Deque(ScopedTaskScopeImpl) { Bn3DequeAllocator(ScopedTaskScopeImpl, Bn3Tag("scopes")) };
-    _is_pool_initialized = std::bind(&ScopedTaskScopeImplPool::isPoolInitialized_, this);
+    if (ScopedTaskExecution::SHARED_POOL == execution)
     {
-        std::unique_lock<std::mutex> lock(_mtx);
-        _is_initialized = true;
+        _worker_pool = MAKE_SHARED(ScopedTaskWorkerPool, Bn3Tag("worker_pool"), worker_count);
+        if (_worker_pool)
+            _worker_pool->start();
     }
+    _is_initialized.store(true, std::memory_order_release);
 }
 
 ScopedTaskScopeImpl& ScopedTaskScopeImplPool::getScope(const Bn3Tag& scope_name)
 {
+    if (auto* scope = findScope(scope_name))
+        return *scope;
+
+    std::lock_guard<std::mutex> lock(_registry_mtx);
+    if (auto* scope = findScope(scope_name))
+        return *scope;
+    // Scopes which didn't fit in the index
     for (auto& scope : _scopes)
     {
         if (scope._name == scope_name)
@@ -189,28 +569,70 @@ ScopedTaskScopeImpl& ScopedTaskScopeImplPool::getScope(const Bn3Tag& scope_name)
         return getCurrentScope();
     };
 
-    _scopes.emplace_back(scope_name, temp_getCurrentScope, isPoolInitialized());
-    return _scopes.back();
+    // Elements of a deque don't move on emplace_back, so indexed pointers stay valid.
+    _scopes.emplace_back(scope_name, temp_getCurrentScope, &_is_initialized, _worker_pool.get());
+    auto& ret = _scopes.back();
+    if (!indexScope(&ret))
+    {
+        LOG_E("Scope index is full. Scope (%s) is found by a linear scan", scope_name.str());
+    }
+    return ret;
 }
 ScopedTaskScopeImpl* ScopedTaskScopeImplPool::getCurrentScope() {
-    auto id = std::this_thread::get_id();
-    for (auto& scope : _scopes)
+    return ScopedTaskScopeImpl::currentScope();
+}
+
+static inline size_t hashScopeName(const Bn3Tag& scope_name)
+{
+    // Multiplicative hash of the tag id. The high bits are folded in because the index takes the low bits.
+    uint32_t hash = scope_name.id() * 2654435769u;
+    return static_cast<size_t>(hash ^ (hash >> 16));
+}
+
+ScopedTaskScopeImpl* ScopedTaskScopeImplPool::findScope(const Bn3Tag& scope_name)
+{
+    size_t hash = hashScopeName(scope_name);
+    for (size_t probe = 0; probe < SCOPE_INDEX_SIZE; probe++)
     {
-        if (id == scope._id)
-            return &scope;
+        auto* scope = _scope_index[(hash + probe) & (SCOPE_INDEX_SIZE - 1)].load(std::memory_order_acquire);
+        if (!scope)
+            return nullptr;
+        if (scope->_name == scope_name)
+            return scope;
     }
     return nullptr;
 }
-void ScopedTaskScopeImplPool::release()
+
+bool ScopedTaskScopeImplPool::indexScope(ScopedTaskScopeImpl* scope)
 {
+    size_t hash = hashScopeName(scope->_name);
+    for (size_t probe = 0; probe < SCOPE_INDEX_SIZE; probe++)
     {
-        std::unique_lock<std::mutex> lock(_mtx);
-        _is_initialized = false;
+        auto& slot = _scope_index[(hash + probe) & (SCOPE_INDEX_SIZE - 1)];
+        if (!slot.load(std::memory_order_relaxed))
+        {
+            slot.store(scope, std::memory_order_release);
+            return true;
+        }
     }
+    return false;
+}
+void ScopedTaskScopeImplPool::release()
+{
+    _is_initialized.store(false, std::memory_order_release);
 
     for (auto& scope : _scopes)
     {
         scope.stop();
     }
+    if (_worker_pool)
+    {
+        _worker_pool->stop();
+        _worker_pool.reset();
+    }
+
+    std::lock_guard<std::mutex> lock(_registry_mtx);
+    for (auto& slot : _scope_index)
+        slot.store(nullptr, std::memory_order_relaxed);
     _scopes.clear();
 }
\ No newline at end of file
@@ -2,6 +2,8 @@
 #define __BN3MONKEY_TASK_SCOPE_IMPL__
 
 #include "ScopedTaskImpl.hpp"
+#include "ScopedTaskQueue.hpp"
+#include "ScopedTaskWorkerPoolImpl.hpp"
 
 #include <functional>
 #include <mutex>
@@ -82,6 +84,46 @@ namespace Bn3Monkey
         STOPPING = 3, // 시간 초과거나 외부로부터 정지 명령이 들어왔을 경우
     };
 
+    enum class ScopedTaskExecution
+    {
+        DEDICATED_THREAD, // Each scope starts its own thread and stops it after being idle
+        SHARED_POOL, // Scopes run as serial strands on a fixed work-stealing worker pool
+    };
+
+    // Each priority has its own lane in a scope. Lower lanes are still served when higher ones stay busy.
+    enum class ScopedTaskPriority : uint32_t
+    {
+        HIGH = 0, // Interactive requests, such as reading a property
+        NORMAL = 1,
+        LOW = 2, // Bulk or background work
+    };
+    constexpr size_t SCOPED_TASK_PRIORITY_COUNT = 3;
+
+    // What a scope holding its capacity does with a new task
+    enum class ScopedTaskCapacityPolicy
+    {
+        BLOCK, // The producer waits for space. A producer running on the scope itself is never blocked, to avoid a deadlock. Looper ticks and timer fires are rejected instead.
+        FAIL, // The new task is cancelled.
+        DROP_OLDEST, // The new task is queued, and the oldest task of the lowest non-empty lane is cancelled.
+        COALESCE_BY_TAG, // The new task replaces the last queued task of the same name, which is cancelled. Fails if there is none.
+    };
+
+    enum class ScopedTaskRunStatus
+    {
+        QUEUED,
+        DROPPED_OLDEST, // Queued, and an older task is cancelled for it
+        COALESCED, // Replaced a queued task of the same name
+        REJECTED, // The scope or the lane is full
+        STOPPED, // The scope is stopping or the runner is released
+        OUT_OF_MEMORY, // No node can be allocated from the memory pool
+    };
+
+    // True if the task will run
+    inline bool isAccepted(ScopedTaskRunStatus status)
+    {
+        return ScopedTaskRunStatus::QUEUED == status || ScopedTaskRunStatus::DROPPED_OLDEST == status || ScopedTaskRunStatus::COALESCED == status;
+    }
+
     class ScopedTaskScopeImplPool;
 
     class ScopedTaskScopeImpl
@@ -89,9 +131,11 @@ namespace Bn3Monkey
     public:
         friend class ScopedTaskScopeImplPool;
 
+        // If worker_pool is nullptr, the scope runs on its own thread.
         ScopedTaskScopeImpl(const Bn3Tag& scope_name,
             std::function<ScopedTaskScopeImpl*()> getCurrentScope,
-            std::function<bool()> is_pool_initialized);
+            const std::atomic<bool>* is_pool_initialized,
+            ScopedTaskWorkerPool* worker_pool = nullptr);
 
         ScopedTaskScopeImpl(ScopedTaskScopeImpl&& other);
 
@@ -101,7 +145,13 @@ namespace Bn3Monkey
         void stop();
 
         template<class Func, class... Args>
-        void run(const Bn3Tag& task_name, Func&& func, Args&&... args)
+        ScopedTaskRunStatus run(const Bn3Tag& task_name, Func&& func, Args&&... args)
+        {
+            return run(ScopedTaskPriority::NORMAL, task_name, std::forward<Func>(func), std::forward<Args>(args)...);
+        }
+
+        template<class Func, class... Args>
+        ScopedTaskRunStatus run(ScopedTaskPriority priority, const Bn3Tag& task_name, Func&& func, Args&&... args)
         {
             // Scope가 꺼져있으면 스코프 키기
             // 자기 자신 Scope에서 불렀으면 무조건 ScopeState는 Running
@@ -109,26 +159,37 @@ namespace Bn3Monkey
 
             // ScopeTask 수행 요청하기
             ScopedTask task{ task_name };
-            task.make(std::forward<Func>(func), std::forward<Args>(args)...);
+            task.makeDetached(std::forward<Func>(func), std::forward<Args>(args)...);
+            if (!task)
+            {
+                LOG_E("Cannot allocate task (%s)", task_name.str());
+                return ScopedTaskRunStatus::OUT_OF_MEMORY;
+            }
 
             LOG_D("Make task (%s)", task_name.str());
 
+            auto status = push(std::move(task), priority);
+            if (isAccepted(status))
             {
-                std::unique_lock<std::mutex> lock(_mtx);
-                if (start())
-                    push(std::move(task));
+                LOG_D("Run Task (%s)", task_name.str());
             }
+            return status;
+        }
 
-            LOG_D("Run Task (%s)", task_name.str());
-            _cv.notify_all();
+        template<class Func, class... Args>
+        auto call(const Bn3Tag& task_name, Func&& func, Args&&... args) -> ScopedTaskResultHandle<std::result_of_t<Func(Args...)>>
+        {
+            return call(ScopedTaskPriority::NORMAL, task_name, std::forward<Func>(func), std::forward<Args>(args)...);
         }
 
         template<class Func, class... Args>
-        auto call(const Bn3Tag& task_name, Func&& func, Args&&... args) -> std::shared_ptr<ScopedTaskResultImpl<std::result_of_t<Func(Args...)>>>
+        auto call(ScopedTaskPriority priority, const Bn3Tag& task_name, Func&& func, Args&&... args) -> ScopedTaskResultHandle<std::result_of_t<Func(Args...)>>
         {
             // ScopeTask 수행 요청하기
             ScopedTask task{ task_name };
             auto ret = task.make(std::forward<Func>(func), std::forward<Args>(args)...);
+            if (!ret)
+                return ret;
 
             LOG_D("Make task (%s)", task_name.str());
 
@@ -160,29 +221,125 @@ namespace Bn3Monkey
                 task.addStack(current_task, current_scope_name);
             }
             
+            if (isAccepted(push(std::move(task), priority)))
             {
-                std::unique_lock<std::mutex> lock(_mtx);
-                if (start())
-                    push(std::move(task));
+                LOG_D("Call Task (%s)", task_name.str());
             }
+            return ret;
+        }
+
+        // Calls func on this scope once antecedent finishes, with its value unless it is void.
+        // If antecedent is cancelled, the continuation is cancelled without being called. No thread waits in the meantime.
+        template<class Type, class Func>
+        auto callAfter(ScopedTaskResultHandle<Type> antecedent, const Bn3Tag& task_name, Func&& func)
+        {
+            auto* antecedent_impl = antecedent.get();
 
-            LOG_D("Call Task (%s)", task_name.str());
-            _cv.notify_all();
+            ScopedTask task{ task_name };
+            auto ret = task.make([antecedent = std::move(antecedent), func = std::forward<Func>(func)]() mutable {
+                if constexpr (std::is_void_v<Type>)
+                    return func();
+                else
+                    return func(*antecedent->value());
+                });
+            if (!ret)
+                return ret;
+            if (!antecedent_impl)
+            {
+                task.cancel();
+                return ret;
+            }
+
+            // The node is allocated now, so that completing the antecedent cannot fail to queue the continuation.
+            auto* node = _tasks[static_cast<size_t>(ScopedTaskPriority::NORMAL)].makeNode(std::move(task));
+            if (!node)
+            {
+                LOG_E("Task (%s) cannot be queued to scope (%s)", task.name(), _name.str());
+                task.cancel();
+                return ret;
+            }
+            node->lane = static_cast<uint32_t>(ScopedTaskPriority::NORMAL);
+
+            LOG_D("Call Task (%s) after task (%s)", task_name.str(), antecedent_impl->name());
+            antecedent_impl->setContinuation([this, node](ScopedTaskState state) {
+                if (ScopedTaskState::FINISHED == state)
+                    push(node);
+                else
+                    cancel(node);
+                });
             return ret;
         }
 
+        // Queues a task made by the caller. The task is cancelled if it cannot be queued.
+        inline bool dispatch(ScopedTask&& task)
+        {
+            return isAccepted(push(std::move(task)));
+        }
+        // As dispatch, but the task is cancelled instead of waiting for space under the BLOCK policy.
+        // For threads which must never block, such as the looper scheduler.
+        inline bool tryDispatch(ScopedTask&& task)
+        {
+            return isAccepted(push(std::move(task), ScopedTaskPriority::NORMAL, false));
+        }
+
+        // Tasks pushed to a lane holding capacity tasks are cancelled. 0 means no limit.
+        inline void setLaneCapacity(ScopedTaskPriority priority, size_t capacity)
+        {
+            _lane_capacities[static_cast<size_t>(priority)].store(capacity, std::memory_order_relaxed);
+        }
+
+        // Bounds the number of queued tasks of all lanes. 0 means no limit.
+        inline void setCapacity(size_t capacity, ScopedTaskCapacityPolicy policy)
+        {
+            _policy.store(policy, std::memory_order_relaxed);
+            _capacity.store(capacity, std::memory_order_relaxed);
+        }
+
         inline const char* name() { return _name.str(); }
-        inline ScopeState state() { return _state; }
+        inline ScopeState state() { return _state.load(std::memory_order_acquire); }
         inline std::thread::id id() { return _id; }
 
+        // Runs pending tasks on the current worker of the pool, and reschedules itself if tasks remain.
+        void runStrand();
+        // The scope whose worker or strand is running on the current thread
+        static ScopedTaskScopeImpl* currentScope();
+
     private:
         bool start();
-        void push(ScopedTask&& task);
+        // The task is cancelled unless it is accepted.
+        // Under the BLOCK policy, a full scope rejects the task unless is_blocking is set.
+        ScopedTaskRunStatus push(ScopedTask&& task, ScopedTaskPriority priority = ScopedTaskPriority::NORMAL, bool is_blocking = true);
+        ScopedTaskRunStatus push(ScopedTaskNode* node, bool is_blocking = true);
+        void cancel(ScopedTaskNode* node);
+        inline bool isPoolInitialized()
+        {
+            return _is_pool_initialized->load(std::memory_order_acquire);
+        }
+        inline bool isAccepting()
+        {
+            return isPoolInitialized() && ScopeState::STOPPING != _state.load(std::memory_order_acquire);
+        }
+
+        // Counts node against the capacities of its lane and of the scope, applying the policy. node is linked only if QUEUED or DROPPED_OLDEST is returned.
+        ScopedTaskRunStatus admit(ScopedTaskNode* node, bool is_blocking);
+        // Counts node in its lane. Returns false if the lane is full.
+        bool reserveLane(ScopedTaskNode* node);
+        void releaseLane(ScopedTaskNode* node);
+        // Returns false if the scope stops in the meantime.
+        bool waitForSpace();
+        void registerCoalescable(ScopedTaskNode* node);
+        bool coalesce(ScopedTaskNode* node);
+
+        // Called by the consumer only. A dropped task is cancelled instead of being run.
+        bool pop(ScopedTask& task, bool& is_dropped);
+        bool popLane(size_t lane, ScopedTask& task);
+        bool empty();
+        // Wakes the worker up only if it is parked, or starts a new one if it has exited.
+        void wake();
         
         inline bool compare(ScopedTaskScopeImpl* other) {
-            if (other == nullptr)
-                return false;
-            return _id == other->_id;
+            // Strands of different scopes share threads, so thread ids cannot tell scopes apart.
+            return other == this;
         }
 
         void worker();
@@ -192,48 +349,69 @@ namespace Bn3Monkey
 
         std::function<ScopedTaskScopeImpl*()> _getCurrentScope;
         
-        std::thread _thread;
         std::thread::id _id;
 
-        ScopeState _state{ ScopeState::IDLE };
+        // EMPTY means that the worker is parked on _cv.
+        std::atomic<ScopeState> _state{ ScopeState::IDLE };
         ScopedTask _current_task;
 
-        Bn3Queue(ScopedTask) _tasks; // allocated by bn3 allocator
+        // One queue per priority. _tasks[0] is the highest.
+        ScopedTaskQueue _tasks[SCOPED_TASK_PRIORITY_COUNT];
+        std::atomic<size_t> _lane_depths[SCOPED_TASK_PRIORITY_COUNT]{};
+        std::atomic<size_t> _lane_capacities[SCOPED_TASK_PRIORITY_COUNT]{};
+        // The number of pops a non-empty lane has been passed over. Only used by the consumer.
+        uint32_t _lane_ages[SCOPED_TASK_PRIORITY_COUNT]{};
+
+        std::atomic<size_t> _capacity{ 0 };
+        std::atomic<ScopedTaskCapacityPolicy> _policy{ ScopedTaskCapacityPolicy::FAIL };
+        // Tasks queued in all lanes, including the ones to be dropped
+        std::atomic<size_t> _depth{ 0 };
+        // The number of tasks the consumer cancels instead of running for DROP_OLDEST
+        std::atomic<size_t> _drops{ 0 };
+        // Blocked producers park on _space_epoch, which the consumer bumps after popping.
+        std::atomic<uint32_t> _blocked_producers{ 0 };
+        std::atomic<uint32_t> _space_epoch{ 0 };
+
+        // The last queued node of each name for COALESCE_BY_TAG, indexed by the id of the name. Names sharing a slot just coalesce less.
+        static constexpr size_t COALESCE_SLOT_COUNT = 64;
+        std::mutex _coalesce_mtx;
+        ScopedTaskNode* _coalesce_slots[COALESCE_SLOT_COUNT]{};
+        // Only used to park the worker and to wait for it to stop.
         std::mutex _mtx;
         std::condition_variable _cv;
 
-        std::function<bool()> _is_pool_initialized;
+        // Owned by the scope pool, which outlives its scopes. Read on every push, so it is not guarded by a lock.
+        const std::atomic<bool>* _is_pool_initialized{ nullptr };
 
+        ScopedTaskWorkerPool* _worker_pool{ nullptr };
+        // The number of tasks pushed but not executed yet in the strand mode. The producer making it non-zero schedules the strand.
+        std::atomic<int64_t> _pending{ 0 };
     };
 
     class ScopedTaskScopeImplPool
     {
     public:
-        ScopedTaskScopeImplPool();
+        ScopedTaskScopeImplPool(ScopedTaskExecution execution = ScopedTaskExecution::DEDICATED_THREAD, size_t worker_count = 0);
         ScopedTaskScopeImpl& getScope(const Bn3Tag& scope_name);
         ScopedTaskScopeImpl* getCurrentScope();
 
-        std::function<bool()>& isPoolInitialized() {
-            return _is_pool_initialized;
-        }
-
         void initialize();
         void release();
 
     private:
-        std::function<bool()> _is_pool_initialized;
-        inline bool isPoolInitialized_() {
-            {
-                std::unique_lock<std::mutex> lock(_mtx);
-                return _is_initialized;
-            }
-        }
+        static constexpr size_t SCOPE_INDEX_SIZE = 256;
 
-        bool _is_initialized;
-        std::mutex _mtx;
+        // Lock-free lookup by the id of the interned name. Slots are written only under _registry_mtx and never removed until release.
+        ScopedTaskScopeImpl* findScope(const Bn3Tag& scope_name);
+        bool indexScope(ScopedTaskScopeImpl* scope);
+
+        std::atomic<bool> _is_initialized{ false };
 
-        Bn3Deque(ScopedTaskScopeImpl) _scopes;
+        std::mutex _registry_mtx;
+        Bn3Deque(ScopedTaskScopeImpl) _scopes; // guarded by _registry_mtx
+        std::atomic<ScopedTaskScopeImpl*> _scope_index[SCOPE_INDEX_SIZE]{};
 
+        std::shared_ptr<ScopedTaskWorkerPool> _worker_pool;
     };
 }
 
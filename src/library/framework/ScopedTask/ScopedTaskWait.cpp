@@ -0,0 +1,107 @@
+#include "ScopedTaskWait.hpp"
+
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <ctime>
+#include <climits>
+#elif _WIN32
+#include <windows.h>
+#else
+#include <mutex>
+#include <condition_variable>
+#endif
+
+using namespace Bn3Monkey;
+
+static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t), "An atomic word must be waitable as a plain word");
+
+#ifdef __linux__
+
+static inline void futex(std::atomic<uint32_t>& address, int operation, uint32_t value, const timespec* timeout)
+{
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(&address), operation, value, timeout, nullptr, 0);
+}
+
+void Bn3Monkey::waitOnAddress(std::atomic<uint32_t>& address, uint32_t expected)
+{
+    futex(address, FUTEX_WAIT_PRIVATE, expected, nullptr);
+}
+
+void Bn3Monkey::waitOnAddressFor(std::atomic<uint32_t>& address, uint32_t expected, std::chrono::microseconds timeout)
+{
+    timespec value;
+    value.tv_sec = static_cast<time_t>(timeout.count() / 1000000);
+    value.tv_nsec = static_cast<long>((timeout.count() % 1000000) * 1000);
+    futex(address, FUTEX_WAIT_PRIVATE, expected, &value);
+}
+
+void Bn3Monkey::wakeByAddress(std::atomic<uint32_t>& address)
+{
+    futex(address, FUTEX_WAKE_PRIVATE, INT_MAX, nullptr);
+}
+
+#elif _WIN32
+
+// Links Synchronization.lib
+void Bn3Monkey::waitOnAddress(std::atomic<uint32_t>& address, uint32_t expected)
+{
+    WaitOnAddress(reinterpret_cast<volatile VOID*>(&address), &expected, sizeof(uint32_t), INFINITE);
+}
+
+void Bn3Monkey::waitOnAddressFor(std::atomic<uint32_t>& address, uint32_t expected, std::chrono::microseconds timeout)
+{
+    auto milliseconds = std::chrono::duration_cast<std::chrono::milliseconds>(timeout).count();
+    WaitOnAddress(reinterpret_cast<volatile VOID*>(&address), &expected, sizeof(uint32_t), static_cast<DWORD>(milliseconds > 0 ? milliseconds : 1));
+}
+
+void Bn3Monkey::wakeByAddress(std::atomic<uint32_t>& address)
+{
+    WakeByAddressAll(reinterpret_cast<PVOID>(&address));
+}
+
+#else
+
+// Addresses are hashed into a fixed table of buckets. Threads parked on different words may share a bucket, so wake-ups can be spurious.
+struct ScopedTaskWaitBucket
+{
+    std::mutex mtx;
+    std::condition_variable cv;
+};
+
+constexpr size_t WAIT_BUCKET_COUNT = 64;
+static ScopedTaskWaitBucket wait_buckets[WAIT_BUCKET_COUNT];
+
+static inline ScopedTaskWaitBucket& findBucket(std::atomic<uint32_t>& address)
+{
+    auto key = reinterpret_cast<uintptr_t>(&address);
+    return wait_buckets[(key >> 4) % WAIT_BUCKET_COUNT];
+}
+
+void Bn3Monkey::waitOnAddress(std::atomic<uint32_t>& address, uint32_t expected)
+{
+    auto& bucket = findBucket(address);
+    std::unique_lock<std::mutex> lock(bucket.mtx);
+    if (address.load(std::memory_order_acquire) == expected)
+        bucket.cv.wait(lock);
+}
+
+void Bn3Monkey::waitOnAddressFor(std::atomic<uint32_t>& address, uint32_t expected, std::chrono::microseconds timeout)
+{
+    auto& bucket = findBucket(address);
+    std::unique_lock<std::mutex> lock(bucket.mtx);
+    if (address.load(std::memory_order_acquire) == expected)
+        bucket.cv.wait_for(lock, timeout);
+}
+
+void Bn3Monkey::wakeByAddress(std::atomic<uint32_t>& address)
+{
+    auto& bucket = findBucket(address);
+    {
+        std::lock_guard<std::mutex> lock(bucket.mtx);
+    }
+    bucket.cv.notify_all();
+}
+
+#endif
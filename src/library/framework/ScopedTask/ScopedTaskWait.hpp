@@ -0,0 +1,33 @@
+#ifndef __BN3MONKEY_SCOPED_TASK_WAIT__
+#define __BN3MONKEY_SCOPED_TASK_WAIT__
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+namespace Bn3Monkey
+{
+    // Parks the current thread while the value of address equals expected.
+    // It may return spuriously, so the caller checks the value again.
+    // futex on Linux, WaitOnAddress on Windows and a striped condition variable table elsewhere.
+    void waitOnAddress(std::atomic<uint32_t>& address, uint32_t expected);
+    // Same as above, but returns after timeout at the latest.
+    void waitOnAddressFor(std::atomic<uint32_t>& address, uint32_t expected, std::chrono::microseconds timeout);
+    // Wakes all the threads parked on address.
+    void wakeByAddress(std::atomic<uint32_t>& address);
+
+    inline void relaxCpu()
+    {
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+        _mm_pause();
+#elif defined(__aarch64__) || defined(__arm__)
+        __asm__ __volatile__("yield");
+#endif
+    }
+}
+
+#endif // __BN3MONKEY_SCOPED_TASK_WAIT__
@@ -0,0 +1,332 @@
+#include "ScopedTaskWorkerPoolImpl.hpp"
+#include "ScopedTaskScopeImpl.hpp"
+#include "ScopedTaskHelper.hpp"
+
+#include <string>
+
+using namespace Bn3Monkey;
+
+static thread_local ScopedTaskWorkerPool* current_pool{ nullptr };
+static thread_local size_t current_worker_idx{ 0 };
+// Spares have no deque of their own.
+static constexpr size_t SPARE_WORKER_IDX = SIZE_MAX;
+
+bool ScopedTaskStealingDeque::push(ScopedTaskScopeImpl* scope)
+{
+    int64_t bottom = _bottom.load(std::memory_order_relaxed);
+    int64_t top = _top.load(std::memory_order_acquire);
+    if (bottom - top >= CAPACITY)
+        return false;
+    _buffer[bottom & (CAPACITY - 1)].store(scope, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    _bottom.store(bottom + 1, std::memory_order_relaxed);
+    return true;
+}
+
+ScopedTaskScopeImpl* ScopedTaskStealingDeque::pop()
+{
+    int64_t bottom = _bottom.load(std::memory_order_relaxed) - 1;
+    _bottom.store(bottom, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t top = _top.load(std::memory_order_relaxed);
+
+    if (top > bottom)
+    {
+        _bottom.store(bottom + 1, std::memory_order_relaxed);
+        return nullptr;
+    }
+
+    auto* scope = _buffer[bottom & (CAPACITY - 1)].load(std::memory_order_relaxed);
+    if (top == bottom)
+    {
+        // The last one. Race against thieves.
+        if (!_top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+            scope = nullptr;
+        _bottom.store(bottom + 1, std::memory_order_relaxed);
+    }
+    return scope;
+}
+
+ScopedTaskScopeImpl* ScopedTaskStealingDeque::steal()
+{
+    int64_t top = _top.load(std::memory_order_acquire);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t bottom = _bottom.load(std::memory_order_acquire);
+    if (top >= bottom)
+        return nullptr;
+
+    auto* scope = _buffer[top & (CAPACITY - 1)].load(std::memory_order_relaxed);
+    if (!_top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+        return nullptr;
+    return scope;
+}
+
+bool ScopedTaskStealingDeque::empty() const
+{
+    int64_t top = _top.load(std::memory_order_seq_cst);
+    int64_t bottom = _bottom.load(std::memory_order_seq_cst);
+    return top >= bottom;
+}
+
+/***********************************************/
+ScopedTaskWorkerPool::ScopedTaskWorkerPool(size_t worker_count)
+{
+    if (worker_count == 0)
+        worker_count = std::thread::hardware_concurrency();
+    if (worker_count < 2)
+        worker_count = 2;
+    if (worker_count > MAX_WORKER_COUNT)
+        worker_count = MAX_WORKER_COUNT;
+    _worker_count = worker_count;
+
+    _injected = Bn3Deque(ScopedTaskScopeImpl*) { Bn3DequeAllocator(ScopedTaskScopeImpl*, Bn3Tag("injected_scopes")) };
+}
+
+ScopedTaskWorkerPool::~ScopedTaskWorkerPool()
+{
+    stop();
+}
+
+void ScopedTaskWorkerPool::start()
+{
+    {
+        std::lock_guard<std::mutex> lock(_mtx);
+        if (_is_running)
+            return;
+        _is_running = true;
+    }
+
+    LOG_D("Worker pool starts with %zu workers", _worker_count);
+    for (size_t idx = 0; idx < _worker_count; idx++)
+        _workers[idx].thread = std::thread(&ScopedTaskWorkerPool::routine, this, idx);
+}
+
+void ScopedTaskWorkerPool::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(_mtx);
+        if (!_is_running)
+            return;
+        _is_running = false;
+    }
+    _cv.notify_all();
+    _spare_cv.notify_all();
+
+    for (size_t idx = 0; idx < _worker_count; idx++)
+    {
+        if (_workers[idx].thread.joinable())
+            _workers[idx].thread.join();
+    }
+    // No spare starts once the pool stops.
+    for (size_t idx = 0; idx < MAX_SPARE_COUNT; idx++)
+    {
+        if (_spares[idx].joinable())
+            _spares[idx].join();
+    }
+    _spare_count = 0;
+    LOG_D("Worker pool stops");
+}
+
+void ScopedTaskWorkerPool::submit(ScopedTaskScopeImpl* scope)
+{
+    if (current_pool == this && current_worker_idx < _worker_count && _workers[current_worker_idx].deque.push(scope))
+    {
+        // Pairs with the fence in park(). Either the parked worker sees the scope, or this sees the parked worker.
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (_parked_count.load(std::memory_order_relaxed) > 0)
+        {
+            {
+                std::lock_guard<std::mutex> lock(_mtx);
+                _signals++;
+            }
+            _cv.notify_one();
+        }
+        return;
+    }
+
+    bool is_parked{ false };
+    {
+        std::lock_guard<std::mutex> lock(_mtx);
+        _injected.push_back(scope);
+        _injected_count.fetch_add(1, std::memory_order_relaxed);
+        if (_parked_count.load(std::memory_order_relaxed) > 0)
+        {
+            _signals++;
+            is_parked = true;
+        }
+    }
+    if (is_parked)
+        _cv.notify_one();
+}
+
+void ScopedTaskWorkerPool::block()
+{
+    {
+        std::lock_guard<std::mutex> lock(_mtx);
+        _blocked_count++;
+        if (!_is_running)
+            return;
+
+        // Spares are kept, so one is started only when more workers are blocked than ever before.
+        if (_spare_count < _blocked_count && _spare_count < MAX_SPARE_COUNT)
+        {
+            LOG_D("Worker pool starts spare worker %zu", _spare_count);
+            _spares[_spare_count] = std::thread(&ScopedTaskWorkerPool::spareRoutine, this);
+            _spare_count++;
+            return;
+        }
+    }
+    _spare_cv.notify_one();
+}
+
+void ScopedTaskWorkerPool::unblock()
+{
+    // A running spare goes back to sleep after its current strand.
+    std::lock_guard<std::mutex> lock(_mtx);
+    _blocked_count--;
+}
+
+void ScopedTaskWorkerPool::routine(size_t idx)
+{
+    std::string thread_name = "strand worker ";
+    thread_name += std::to_string(idx);
+    setThreadName(thread_name.c_str());
+
+    current_pool = this;
+    current_worker_idx = idx;
+
+    for (;;)
+    {
+        if (auto* scope = take(idx))
+        {
+            scope->runStrand();
+            continue;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(_mtx);
+            if (!_is_running)
+                break;
+        }
+        park();
+    }
+
+    current_pool = nullptr;
+}
+
+void ScopedTaskWorkerPool::spareRoutine()
+{
+    setThreadName("strand spare worker");
+
+    current_pool = this;
+    current_worker_idx = SPARE_WORKER_IDX;
+
+    std::unique_lock<std::mutex> lock(_mtx);
+    for (;;)
+    {
+        // A spare runs only while a worker is blocked.
+        _spare_cv.wait(lock, [&]() {
+            return !_is_running || _running_spare_count < _blocked_count;
+            });
+        if (!_is_running)
+            break;
+
+        _running_spare_count++;
+        while (_is_running && _running_spare_count <= _blocked_count)
+        {
+            lock.unlock();
+            if (auto* scope = take(SPARE_WORKER_IDX))
+                scope->runStrand();
+            else
+                park();
+            lock.lock();
+        }
+        _running_spare_count--;
+
+        // The signal taken by park() may have been meant for a parked worker.
+        if (_is_running && _parked_count.load(std::memory_order_relaxed) > 0 && hasWork())
+        {
+            _signals++;
+            _cv.notify_one();
+        }
+    }
+
+    current_pool = nullptr;
+}
+
+ScopedTaskScopeImpl* ScopedTaskWorkerPool::take(size_t idx)
+{
+    if (idx < _worker_count)
+    {
+        if (auto* scope = _workers[idx].deque.pop())
+            return scope;
+    }
+
+    if (_injected_count.load(std::memory_order_relaxed) > 0)
+    {
+        std::lock_guard<std::mutex> lock(_mtx);
+        if (!_injected.empty())
+        {
+            auto* scope = _injected.front();
+            _injected.pop_front();
+            _injected_count.fetch_sub(1, std::memory_order_relaxed);
+            return scope;
+        }
+    }
+
+    for (size_t i = 1; i <= _worker_count; i++)
+    {
+        auto victim_idx = (idx + i) % _worker_count;
+        if (victim_idx == idx)
+            continue;
+        if (auto* scope = _workers[victim_idx].deque.steal())
+            return scope;
+    }
+    return nullptr;
+}
+
+bool ScopedTaskWorkerPool::hasWork()
+{
+    if (!_injected.empty())
+        return true;
+    for (size_t idx = 0; idx < _worker_count; idx++)
+    {
+        if (!_workers[idx].deque.empty())
+            return true;
+    }
+    return false;
+}
+
+void ScopedTaskWorkerPool::park()
+{
+    std::unique_lock<std::mutex> lock(_mtx);
+    _parked_count.fetch_add(1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+
+    if (_is_running && !hasWork())
+    {
+        _cv.wait(lock, [&]() {
+            return !_is_running || _signals > 0;
+            });
+        if (_signals > 0)
+            _signals--;
+    }
+    _parked_count.fetch_sub(1, std::memory_order_relaxed);
+}
+
+void Bn3Monkey::blockScopedTaskWorker()
+{
+    if (current_pool)
+        current_pool->block();
+}
+
+void Bn3Monkey::unblockScopedTaskWorker()
+{
+    if (current_pool)
+        current_pool->unblock();
+}
+
+bool Bn3Monkey::isScopedTaskWorker()
+{
+    return current_pool != nullptr;
+}
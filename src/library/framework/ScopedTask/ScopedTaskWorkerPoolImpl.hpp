@@ -0,0 +1,94 @@
+#ifndef __BN3MONKEY_SCOPED_TASK_WORKER_POOL_IMPL__
+#define __BN3MONKEY_SCOPED_TASK_WORKER_POOL_IMPL__
+
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <cstdint>
+
+#include "ScopedTaskImpl.hpp"
+
+namespace Bn3Monkey
+{
+    class ScopedTaskScopeImpl;
+
+    // Chase-Lev deque of scopes ready to run.
+    // Only the owner worker pushes and pops at the bottom. Other workers steal from the top.
+    class ScopedTaskStealingDeque
+    {
+    public:
+        static constexpr int64_t CAPACITY = 256;
+
+        // Returns false if full.
+        bool push(ScopedTaskScopeImpl* scope);
+        ScopedTaskScopeImpl* pop();
+        ScopedTaskScopeImpl* steal();
+        bool empty() const;
+
+    private:
+        std::atomic<int64_t> _top{ 0 };
+        std::atomic<int64_t> _bottom{ 0 };
+        std::atomic<ScopedTaskScopeImpl*> _buffer[CAPACITY]{};
+    };
+
+    // Fixed number of workers which run scopes as serial strands.
+    // A scope is in at most one deque at a time, so tasks of a scope never run concurrently.
+    class ScopedTaskWorkerPool
+    {
+    public:
+        static constexpr size_t MAX_WORKER_COUNT = 32;
+        static constexpr size_t MAX_SPARE_COUNT = 32;
+
+        // 0 means the number of hardware threads.
+        explicit ScopedTaskWorkerPool(size_t worker_count);
+        ~ScopedTaskWorkerPool();
+
+        ScopedTaskWorkerPool(const ScopedTaskWorkerPool& other) = delete;
+
+        void start();
+        void stop();
+
+        // Schedules a scope which has pending tasks.
+        void submit(ScopedTaskScopeImpl* scope);
+
+        // Called by a worker around a blocking wait. While a worker is blocked, a spare worker runs strands in its place,
+        // so that the waited task never needs a strand which no worker is free to run.
+        void block();
+        void unblock();
+
+        inline size_t size() const { return _worker_count; }
+
+    private:
+        struct Worker
+        {
+            ScopedTaskStealingDeque deque;
+            std::thread thread;
+        };
+
+        void routine(size_t idx);
+        void spareRoutine();
+        ScopedTaskScopeImpl* take(size_t idx);
+        bool hasWork();
+        void park();
+
+        size_t _worker_count{ 0 };
+        Worker _workers[MAX_WORKER_COUNT];
+        // Started on demand and kept until the pool stops. Spares have no deque of their own.
+        std::thread _spares[MAX_SPARE_COUNT];
+
+        std::mutex _mtx;
+        std::condition_variable _cv;
+        std::condition_variable _spare_cv;
+        size_t _spare_count{ 0 }; // guarded by _mtx
+        size_t _running_spare_count{ 0 }; // guarded by _mtx
+        size_t _blocked_count{ 0 }; // guarded by _mtx
+        Bn3Deque(ScopedTaskScopeImpl*) _injected; // guarded by _mtx
+        std::atomic<size_t> _injected_count{ 0 };
+        std::atomic<size_t> _parked_count{ 0 };
+        size_t _signals{ 0 }; // guarded by _mtx
+        bool _is_running{ false }; // guarded by _mtx
+    };
+}
+
+#endif // __BN3MONKEY_SCOPED_TASK_WORKER_POOL_IMPL__
@@ -0,0 +1,159 @@
+#include "Tag.hpp"
+#include "../Log/Log.hpp"
+
+#include <atomic>
+#include <thread>
+#include <cstdlib>
+
+using namespace Bn3Monkey;
+
+// The table is open addressing with linear probing. Slots are claimed by CAS and never freed.
+// A slot being written by another thread is waited for, which only happens on the first intern of a name.
+constexpr uint32_t TAG_REGISTRY_SIZE = 4096;
+constexpr uint32_t TAG_CONCATENATION_CACHE_SIZE = 4096;
+constexpr uint32_t TAG_CONCATENATION_MAX_PROBE = 16;
+
+enum : uint32_t
+{
+	TAG_SLOT_EMPTY = 0,
+	TAG_SLOT_WRITING,
+	TAG_SLOT_READY,
+};
+
+struct Bn3TagSlot
+{
+	std::atomic<uint32_t> state{ TAG_SLOT_EMPTY };
+	uint32_t hash{ 0 };
+	char name[TAG_SIZE]{ 0 };
+};
+
+struct Bn3TagConcatenationSlot
+{
+	// (prefix id << 32 | postfix id)
+	std::atomic<uint64_t> key{ 0 };
+	std::atomic<uint32_t> id{ 0 };
+};
+
+static Bn3TagSlot tag_slots[TAG_REGISTRY_SIZE];
+static Bn3TagConcatenationSlot concatenation_slots[TAG_CONCATENATION_CACHE_SIZE];
+
+static inline uint32_t hashName(const char* value, size_t length)
+{
+	// FNV-1a
+	uint32_t hash = 2166136261u;
+	for (size_t i = 0; i < length; i++)
+	{
+		hash ^= static_cast<unsigned char>(value[i]);
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+static inline uint32_t hashKey(uint64_t key)
+{
+	key ^= key >> 33;
+	key *= 0xff51afd7ed558ccdull;
+	key ^= key >> 33;
+	return static_cast<uint32_t>(key);
+}
+
+uint32_t Bn3TagRegistry::intern(const char* value)
+{
+	if (value == nullptr)
+		return 0;
+	return intern(value, strlen(value));
+}
+
+uint32_t Bn3TagRegistry::intern(const char* value, size_t length)
+{
+	if (length >= TAG_SIZE - 1)
+		length = TAG_SIZE - 1;
+	if (length == 0)
+		return 0;
+
+	uint32_t hash = hashName(value, length);
+	for (uint32_t probe = 0; probe < TAG_REGISTRY_SIZE; probe++)
+	{
+		uint32_t idx = (hash + probe) & (TAG_REGISTRY_SIZE - 1);
+		auto& slot = tag_slots[idx];
+
+		uint32_t state = slot.state.load(std::memory_order_acquire);
+		if (state == TAG_SLOT_EMPTY)
+		{
+			if (slot.state.compare_exchange_strong(state, TAG_SLOT_WRITING, std::memory_order_acq_rel, std::memory_order_acquire))
+			{
+				slot.hash = hash;
+				std::copy(value, value + length, slot.name);
+				slot.name[length] = 0;
+				slot.state.store(TAG_SLOT_READY, std::memory_order_release);
+				return idx + 1;
+			}
+		}
+		while (state == TAG_SLOT_WRITING)
+		{
+			std::this_thread::yield();
+			state = slot.state.load(std::memory_order_acquire);
+		}
+
+		if (slot.hash == hash && !strncmp(slot.name, value, length) && slot.name[length] == 0)
+			return idx + 1;
+	}
+
+	// Every id is taken. Returning 0 would make the name equal to the empty name and to every other name which doesn't fit.
+	Log::E(__FUNCTION__, "Tag registry is full (%u names). Tag (%.*s) cannot be interned", TAG_REGISTRY_SIZE, static_cast<int>(length), value);
+	std::abort();
+}
+
+uint32_t Bn3TagRegistry::concatenate(uint32_t prefix, uint32_t postfix)
+{
+	if (prefix == 0)
+		return postfix;
+	if (postfix == 0)
+		return prefix;
+
+	uint64_t key = (static_cast<uint64_t>(prefix) << 32) | postfix;
+	uint32_t hash = hashKey(key);
+
+	Bn3TagConcatenationSlot* cached_slot{ nullptr };
+	for (uint32_t probe = 0; probe < TAG_CONCATENATION_MAX_PROBE; probe++)
+	{
+		auto& slot = concatenation_slots[(hash + probe) & (TAG_CONCATENATION_CACHE_SIZE - 1)];
+		uint64_t slot_key = slot.key.load(std::memory_order_acquire);
+		if (slot_key == 0 && slot.key.compare_exchange_strong(slot_key, key, std::memory_order_acq_rel, std::memory_order_acquire))
+		{
+			cached_slot = &slot;
+			break;
+		}
+		if (slot_key == key)
+		{
+			// The id may not be stored yet. Then it is computed again, which results in the same id.
+			uint32_t id = slot.id.load(std::memory_order_acquire);
+			if (id != 0)
+				return id;
+			break;
+		}
+	}
+
+	char name[TAG_SIZE]{ 0 };
+	const char* prefix_name = str(prefix);
+	const char* postfix_name = str(postfix);
+	size_t prefix_length = strlen(prefix_name);
+	size_t postfix_length = strlen(postfix_name);
+	if (prefix_length + postfix_length >= TAG_SIZE - 1)
+		postfix_length = TAG_SIZE - 1 - prefix_length;
+
+	std::copy(prefix_name, prefix_name + prefix_length, name);
+	std::copy(postfix_name, postfix_name + postfix_length, name + prefix_length);
+
+	uint32_t id = intern(name, prefix_length + postfix_length);
+	if (cached_slot)
+		cached_slot->id.store(id, std::memory_order_release);
+	return id;
+}
+
+const char* Bn3TagRegistry::str(uint32_t id)
+{
+	if (id == 0 || id > TAG_REGISTRY_SIZE)
+		return "";
+	return tag_slots[id - 1].name;
+}
@@ -2,82 +2,66 @@
 #define __BN3MONKEY_TAG__
 
 #include <cstring>
+#include <cstdint>
 #include <algorithm>
 #include <cassert>
 
 namespace Bn3Monkey
 {
 	constexpr size_t TAG_SIZE = 32;
-	
+
+	// Global intern table of tag names.
+	// A name is stored once and never removed, so the pointer returned by str() is stable.
+	class Bn3TagRegistry
+	{
+	public:
+		// Returns the id of the name. 0 means an empty name.
+		static uint32_t intern(const char* value);
+		static uint32_t intern(const char* value, size_t length);
+		// Returns the id of (prefix + postfix). The result is cached by the pair of ids.
+		static uint32_t concatenate(uint32_t prefix, uint32_t postfix);
+		static const char* str(uint32_t id);
+	};
+
+	// Handle of an interned name. Copy and comparison are O(1).
 	struct Bn3Tag
 	{
 		Bn3Tag() {
-			// name is 0
+			// id is 0
 		}
-		explicit Bn3Tag(const char* value)
+		explicit Bn3Tag(const char* value) : _id(Bn3TagRegistry::intern(value))
 		{
-			size_t length = strlen(value);
-			if (length >= TAG_SIZE - 1)
-				length = TAG_SIZE - 1;
-			std::copy(value, value + length, name);
 		}
-		explicit Bn3Tag(const Bn3Tag& prefix, const char* value)
+		explicit Bn3Tag(const Bn3Tag& prefix, const char* value) : _id(Bn3TagRegistry::concatenate(prefix._id, Bn3TagRegistry::intern(value)))
 		{
-			size_t prefix_len = strlen(prefix.name);
-			size_t length = strlen(value);
-			if (prefix_len + length >= TAG_SIZE - 1)
-			{
-				length = TAG_SIZE - 1 - prefix_len;
-			}
-
-			std::copy(prefix.name, prefix.name + prefix_len, name);
-			std::copy(value, value+ length, name + prefix_len);
 		}
-		explicit Bn3Tag(const char* value, const Bn3Tag& postfix)
+		explicit Bn3Tag(const char* value, const Bn3Tag& postfix) : _id(Bn3TagRegistry::concatenate(Bn3TagRegistry::intern(value), postfix._id))
 		{
-			size_t postfix_len = strlen(postfix.name);
-			size_t length = strlen(value);
-			if (postfix_len + length < TAG_SIZE - 1)
-			{
-				length = TAG_SIZE - 1 - postfix_len;
-			}
-
-			std::copy(value, value + length, name);
-			std::copy(postfix.name, postfix.name + postfix_len, name + length);
 		}
-		Bn3Tag(const Bn3Tag& other)
+		explicit Bn3Tag(const Bn3Tag& prefix, const Bn3Tag& postfix) : _id(Bn3TagRegistry::concatenate(prefix._id, postfix._id))
 		{
-			const char* value = other.name;
-			size_t length = strlen(value);
-			std::copy(value, value + length, name);
 		}
-		Bn3Tag(Bn3Tag&& other) noexcept
-		{
-			const char* value = other.name;
-			size_t length = strlen(value);
-			std::copy(value, value + length, name);
-		}
-		Bn3Tag& operator=(const Bn3Tag& other)
-		{
-			clear();
-			const char* value = other.name;
-			size_t length = strlen(value);
-			std::copy(value, value + length, name);
+		Bn3Tag(const Bn3Tag& other) = default;
+		Bn3Tag(Bn3Tag&& other) noexcept = default;
+		Bn3Tag& operator=(const Bn3Tag& other) = default;
+		Bn3Tag& operator=(Bn3Tag&& other) noexcept = default;
 
-			return *this;
+		inline bool operator==(const Bn3Tag& other) const
+		{
+			return _id == other._id;
 		}
-
-		inline bool operator==(const Bn3Tag& other)
+		inline bool operator!=(const Bn3Tag& other) const
 		{
-			return !strcmp(name, other.name);
+			return _id != other._id;
 		}
 
-		inline void clear() { memset(name, 0, sizeof(name)); }
-		inline const char* str() const { return name; }
+		inline void clear() { _id = 0; }
+		inline const char* str() const { return Bn3TagRegistry::str(_id); }
+		inline uint32_t id() const { return _id; }
 
 	private:
-		char name[TAG_SIZE]{ 0 };
+		uint32_t _id{ 0 };
 	};
 }
 
-#endif
\ No newline at end of file
+#endif
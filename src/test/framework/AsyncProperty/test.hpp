@@ -6,6 +6,7 @@
 #include "../test_helper.hpp"
 
 #include <fstream>
+#include <future>
 
 void test_asyncpropertycontainer(bool value)
 {
@@ -733,17 +734,666 @@ void test_asyncpropertyarray(bool value)
 		
 }
 
+void test_asyncproperty_coalescing(bool value)
+{
+	if (!value)
+		return;
+
+	say("COALESCING TEST");
+
+	using namespace Bn3Monkey;
+
+	ScopedTaskScope main_scope{ Bn3Tag("main") };
+	ScopedTaskScope device_scope{ Bn3Tag("device") };
+
+	AsyncProperty<int> gain{ Bn3Tag("gain"), main_scope, 0 };
+	std::atomic<int> notified{ 0 };
+	std::atomic<int> last{ -1 };
+	// A slow listener, which cannot keep up with the producer
+	gain.registerOnPropertyNotified(device_scope, [&](const int& value) {
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		notified++;
+		last = value;
+		return true;
+		});
+
+	auto settle = [&](int expected) {
+		for (int i = 0; i < 2000 && last.load() != expected; i++)
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		return last.load() == expected;
+	};
+
+	AsyncPropertyCoalesceOption option;
+	option.policy = AsyncPropertyCoalescePolicy::LATEST_WINS;
+	gain.setCoalescing(option);
+	for (int i = 0; i < 1000; i++)
+		gain.setAsync(i);
+	bool is_latest = settle(999) && notified.load() < 1000 && gain.get() == 999;
+
+	notified = 0;
+	option.policy = AsyncPropertyCoalescePolicy::RATE_LIMITED;
+	option.interval = std::chrono::milliseconds(50);
+	gain.setCoalescing(option);
+	for (int i = 0; i < 100; i++)
+		gain.setAsync(i);
+	bool is_rate_limited = settle(99) && notified.load() <= 2;
+
+	notified = 0;
+	option.policy = AsyncPropertyCoalescePolicy::EVERY_NTH;
+	option.nth = 10;
+	gain.setCoalescing(option);
+	for (int i = 1; i <= 95; i++)
+		gain.setAsync(i);
+	bool is_sampled = settle(90) && notified.load() <= 9 && gain.get() == 90;
+
+	// A rate-limited update whose timer the scope refuses is queued again by the next call.
+	option.policy = AsyncPropertyCoalescePolicy::RATE_LIMITED;
+	gain.setCoalescing(option);
+	gain.setAsync(100);
+	bool is_recovered = settle(100);
+	std::atomic<bool> is_blocked{ true };
+	std::atomic<bool> is_gated{ false };
+	main_scope.run(Bn3Tag("gate"), [&]() {
+		is_gated = true;
+		while (is_blocked)
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		});
+	while (!is_gated)
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	main_scope.setCapacity(1, ScopedTaskCapacityPolicy::FAIL);
+	main_scope.run(Bn3Tag("filler"), []() {});
+	gain.setAsync(101);
+	std::this_thread::sleep_for(std::chrono::milliseconds(80));
+	main_scope.setCapacity(0, ScopedTaskCapacityPolicy::BLOCK);
+	is_blocked = false;
+	gain.setAsync(102);
+	is_recovered &= settle(102);
+
+	if (is_latest && is_rate_limited && is_sampled && is_recovered)
+	{
+		say("Good! (Coalescing check)");
+	}
+}
+
+void test_asyncproperty_snapshot(bool value)
+{
+	if (!value)
+		return;
+
+	say("SNAPSHOT TEST");
+
+	using namespace Bn3Monkey;
+
+	ScopedTaskScope main_scope{ Bn3Tag("main") };
+
+	AsyncProperty<int> gain{ Bn3Tag("gain"), main_scope, 3 };
+	gain.setReadMode(AsyncPropertyReadMode::SNAPSHOT);
+	gain.set(4);
+
+	// Reads don't go through the scope, so they return while it is busy.
+	std::atomic<bool> is_blocked{ true };
+	main_scope.run(Bn3Tag("gate"), [&]() {
+		while (is_blocked)
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		});
+	bool is_unblocked = gain.get() == 4;
+	is_blocked = false;
+
+	// A string is copied in words, and readers must never see a half-written one.
+	char a_value[201]{};
+	char b_value[201]{};
+	memset(a_value, 'a', 200);
+	memset(b_value, 'b', 200);
+	const char* a = a_value;
+	const char* b = b_value;
+	AsyncProperty<Bn3StaticString> label{ Bn3Tag("label"), main_scope, Bn3StaticString(a) };
+	label.setReadMode(AsyncPropertyReadMode::SNAPSHOT);
+
+	std::atomic<bool> is_running{ true };
+	std::atomic<int> torn{ 0 };
+	std::thread readers[2];
+	for (auto& reader : readers)
+	{
+		reader = std::thread([&]() {
+			while (is_running)
+			{
+				auto value = label.get();
+				const char* data = value.data();
+				if (strlen(data) != 200 || std::count(data, data + 200, data[0]) != 200)
+					torn++;
+			}
+			});
+	}
+	for (int i = 0; i < 1000; i++)
+		label.set(Bn3StaticString(i % 2 ? a : b));
+	is_running = false;
+	for (auto& reader : readers)
+		reader.join();
+
+	if (is_unblocked && torn.load() == 0 && label.get() == a)
+	{
+		say("Good! (Snapshot check)");
+	}
+}
+
+void test_asyncproperty_transaction(bool value)
+{
+	if (!value)
+		return;
+
+	say("TRANSACTION TEST");
+
+	using namespace Bn3Monkey;
+
+	ScopedTaskScope device_scope{ Bn3Tag("device") };
+	AsyncPropertyContainer container{ Bn3Tag("transaction"), ScopedTaskScope(Bn3Tag("main")) };
+
+	char* content = new char[1024 * 1024];
+	memset(content, 0, 1024 * 1024);
+	std::ifstream ifs;
+	ifs.open("test.json");
+	if (ifs.is_open())
+	{
+		ifs.read(content, 1024 * 1024);
+	}
+	container.create(content);
+	delete[] content;
+
+	auto* version = container.find<int16_t>("parameter_format.version");
+	auto* no_channel = container.find<int32_t>("device.global.no_channel");
+	auto* frequency = container.find<double>("device.global.sampling_frequency");
+
+	std::atomic<int> notified{ 0 };
+	std::atomic<int> updated{ 0 };
+	version->registerOnPropertyNotified(device_scope, [&](const int16_t& value) {
+		notified++;
+		return true;
+		});
+	// A negative number of channels is rejected, so the whole transaction is rolled back.
+	no_channel->registerOnPropertyNotified(device_scope, [&](const int32_t& value) {
+		notified++;
+		return value >= 0;
+		});
+	frequency->registerOnPropertyUpdated(device_scope, [&](const double& value, bool success) {
+		updated++;
+		});
+
+	auto transaction = container.beginTransaction();
+	bool is_staged = transaction.set<int16_t>("parameter_format.version", 7) &&
+		transaction.set<int32_t>("device.global.no_channel", 128) &&
+		transaction.set<double>("device.global.sampling_frequency", 40.0) &&
+		// Staging a path again replaces the value.
+		transaction.set<int16_t>("parameter_format.version", 8) &&
+		!transaction.set<int16_t>("parameter_format.missing", 1) &&
+		// The type must be the one of the property.
+		!transaction.set<int32_t>("device.global.sampling_frequency", 40) &&
+		!transaction.set<uint16_t>("device.tx.open_aperture.aperture", 1) &&
+		transaction.size() == 3;
+	bool is_committed = transaction.commit() && transaction.size() == 0 &&
+		version->get() == 8 && no_channel->get() == 128 && frequency->get() == 40.0 &&
+		notified.load() == 2;
+
+	transaction.set<int16_t>("parameter_format.version", 9);
+	transaction.set<int32_t>("device.global.no_channel", -1);
+	transaction.set<double>("device.global.sampling_frequency", 80.0);
+	bool is_rolled_back = !transaction.commit() &&
+		version->get() == 8 && no_channel->get() == 128 && frequency->get() == 40.0;
+
+	// Updated listeners run on their own scope after the commit returns.
+	for (int i = 0; i < 1000 && updated.load() < 2; i++)
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+	if (is_staged && is_committed && is_rolled_back && updated.load() == 2)
+	{
+		say("Good! (Transaction check)");
+	}
+}
+
+void test_asyncproperty_fanout(bool value)
+{
+	if (!value)
+		return;
+
+	say("FANOUT TEST");
+
+	using namespace Bn3Monkey;
+
+	ScopedTaskScope main_scope{ Bn3Tag("main") };
+	ScopedTaskScope device_scope{ Bn3Tag("device") };
+	ScopedTaskScope ip_scope{ Bn3Tag("ip") };
+
+	AsyncProperty<int, 8> gain{ Bn3Tag("gain"), main_scope, 0 };
+
+	// Listeners on the device scope run in one task, in the order they are registered.
+	std::mutex mtx;
+	std::vector<int> order;
+	bool is_registered = true;
+	for (int i = 0; i < 6; i++)
+	{
+		is_registered &= gain.registerOnPropertyNotified(device_scope, [&, i](const int& value) {
+			std::lock_guard<std::mutex> lock(mtx);
+			order.push_back(i);
+			// The third listener rejects a negative gain.
+			return i != 2 || value >= 0;
+			});
+	}
+	std::atomic<int> ip_notified{ 0 };
+	for (int i = 0; i < 2; i++)
+	{
+		is_registered &= gain.registerOnPropertyNotified(ip_scope, [&](const int& value) {
+			ip_notified++;
+			return true;
+			});
+	}
+	bool is_full = !gain.registerOnPropertyNotified(ip_scope, [&](const int& value) { return true; });
+
+	gain.set(3);
+	bool is_accepted = gain.notify() && gain.get() == 3 && ip_notified.load() == 2 &&
+		order == std::vector<int>({ 0, 1, 2, 3, 4, 5 });
+
+	// Listeners after the rejecting one are skipped, and the value is rolled back.
+	order.clear();
+	gain.set(-1);
+	bool is_rejected = !gain.notify() && gain.get() == 3;
+	{
+		std::lock_guard<std::mutex> lock(mtx);
+		is_rejected &= order == std::vector<int>({ 0, 1, 2 });
+	}
+	// The task of the ip scope may still be queued.
+	ip_scope.call(Bn3Tag("flush"), []() {}).wait();
+
+	if (is_registered && is_full && is_accepted && is_rejected)
+	{
+		say("Good! (Fanout check)");
+	}
+}
+
+void test_asyncpropertyarray_rollback(bool value)
+{
+	if (!value)
+		return;
+
+	say("ARRAY ROLLBACK TEST");
+
+	using namespace Bn3Monkey;
+
+	ScopedTaskScope main_scope{ Bn3Tag("main") };
+	ScopedTaskScope device_scope{ Bn3Tag("device") };
+
+	int initial[256];
+	for (int i = 0; i < 256; i++)
+		initial[i] = i;
+	AsyncPropertyArray<int, 256> gains{ Bn3Tag("gains"), main_scope, initial, 256 };
+
+	// Negative gains are rejected.
+	gains.registerOnPropertyNotified(device_scope, [&](const int* values, size_t start, size_t end) {
+		return std::all_of(values, values + end - start, [](int value) { return value >= 0; });
+		});
+
+	auto matches = [&](const int* expected) {
+		int values[256];
+		gains.get(values, 0, 256);
+		return std::equal(values, values + 256, expected);
+	};
+
+	int expected[256];
+	std::copy(initial, initial + 256, expected);
+
+	int accepted[4] = { 1000, 1001, 1002, 1003 };
+	bool is_confirmed = gains.set(accepted, 10, 14) && gains.notify(10, 14);
+	std::copy(accepted, accepted + 4, expected + 10);
+	is_confirmed &= matches(expected);
+
+	// Only the rejected slice is restored, and the confirmed one stays.
+	int rejected[8] = { 1, 2, 3, -1, 5, 6, 7, 8 };
+	bool is_rolled_back = gains.set(rejected, 100, 108) && !gains.notify(100, 108) && matches(expected);
+
+	// get goes ahead of the queued update, so the update is waited for before comparing.
+	std::atomic<int> async_result{ -1 };
+	gains.registerOnPropertyUpdated(device_scope, [&](const int* values, size_t start, size_t end, bool success) {
+		async_result = success ? 1 : 0;
+		});
+	gains.setAsync(rejected, 200, 208);
+	main_scope.call(Bn3Tag("flush"), []() {}).wait();
+	device_scope.call(Bn3Tag("flush"), []() {}).wait();
+	is_rolled_back &= async_result.load() == 0 && matches(expected);
+
+	if (is_confirmed && is_rolled_back)
+	{
+		say("Good! (Array rollback check)");
+	}
+}
+
+void test_asyncpropertyarray_view(bool value)
+{
+	if (!value)
+		return;
+
+	say("ARRAY VIEW TEST");
+
+	using namespace Bn3Monkey;
+
+	ScopedTaskScope main_scope{ Bn3Tag("main") };
+
+	int initial[256];
+	for (int i = 0; i < 256; i++)
+		initial[i] = i;
+	AsyncPropertyArray<int, 256> gains{ Bn3Tag("gains"), main_scope, initial, 256 };
+
+	auto first = gains.view(0, 256);
+	bool is_shared = first && first.size() == 256 && std::equal(first.begin(), first.end(), initial) &&
+		gains.view(0, 256).data() == first.data() && !gains.view(10, 10) && !gains.view(0, 257);
+
+	// A held view keeps its values while commits go on.
+	int changed[4] = { -1, -2, -3, -4 };
+	gains.set(changed, 16, 20);
+	auto second = gains.view(16, 20);
+	bool is_isolated = std::equal(first.begin(), first.end(), initial) &&
+		second && std::equal(second.begin(), second.end(), changed);
+
+	// Once no view is held, the snapshot is updated in place.
+	first = AsyncPropertyArrayView<int>();
+	second = AsyncPropertyArrayView<int>();
+	auto* data = gains.view(0, 256).data();
+	gains.set(initial + 16, 16, 20);
+	auto third = gains.view(0, 256);
+	bool is_reused = third.data() == data && std::equal(third.begin(), third.end(), initial);
+
+	// While a view is held, commits alternate between two snapshots instead of copying a new one each time.
+	gains.set(changed, 16, 20);
+	auto fourth = gains.view(0, 256);
+	third = AsyncPropertyArrayView<int>();
+	gains.set(changed, 40, 44);
+	auto fifth = gains.view(0, 256);
+	int expected[256];
+	std::copy(initial, initial + 256, expected);
+	std::copy(changed, changed + 4, expected + 16);
+	std::copy(changed, changed + 4, expected + 40);
+	is_reused &= fifth.data() == data && fourth.data() != data && std::equal(fifth.begin(), fifth.end(), expected);
+	fourth = AsyncPropertyArrayView<int>();
+	fifth = AsyncPropertyArrayView<int>();
+
+	// Readers on other threads never see a torn range.
+	int filled[256];
+	std::fill(filled, filled + 256, -1);
+	gains.set(filled, 0, 256);
+	std::atomic<bool> is_running{ true };
+	std::atomic<int> torn{ 0 };
+	std::thread reader([&]() {
+		while (is_running)
+		{
+			auto view = gains.view(0, 256);
+			if (std::count(view.begin(), view.end(), view[0]) != 256)
+				torn++;
+		}
+		});
+	for (int i = 0; i < 200; i++)
+	{
+		std::fill(filled, filled + 256, i);
+		gains.set(filled, 0, 256);
+	}
+	is_running = false;
+	reader.join();
+
+	if (is_shared && is_isolated && is_reused && torn.load() == 0)
+	{
+		say("Good! (Array view check)");
+	}
+}
+
+void test_asyncpropertyvector(bool value)
+{
+	if (!value)
+		return;
+
+	say("VECTOR TEST");
+
+	using namespace Bn3Monkey;
+
+	ScopedTaskScope main_scope{ Bn3Tag("main") };
+	ScopedTaskScope device_scope{ Bn3Tag("device") };
+
+	// Longer than a chunk, and not a multiple of one
+	constexpr size_t length = 1000003;
+	std::vector<int> initial(length);
+	for (size_t i = 0; i < length; i++)
+		initial[i] = static_cast<int>(i);
+	AsyncPropertyVector<int> samples{ Bn3Tag("samples"), main_scope, initial.data(), length };
+
+	std::atomic<size_t> notified_start{ 0 };
+	std::atomic<size_t> notified_end{ 0 };
+	// Negative samples are rejected.
+	samples.registerOnPropertyNotified(device_scope, [&](const int* values, size_t start, size_t end) {
+		notified_start = start;
+		notified_end = end;
+		return std::all_of(values, values + end - start, [](int value) { return value >= 0; });
+		});
+
+	// A range across the boundary of chunks
+	size_t start = AsyncPropertyVector<int>::CHUNK_LENGTH - 2;
+	int changed[4] = { 100, 101, 102, 103 };
+	int values[4]{};
+	bool is_confirmed = samples.length() == length &&
+		samples.set(changed, start, start + 4) && samples.notify(start, start + 4) &&
+		notified_start.load() == start && notified_end.load() == start + 4 &&
+		samples.get(values, start, start + 4) && std::equal(values, values + 4, changed);
+
+	int rejected[4] = { 1, -1, 1, 1 };
+	bool is_rolled_back = samples.set(rejected, start, start + 4) && !samples.notify(start, start + 4) &&
+		samples.get(values, start, start + 4) && std::equal(values, values + 4, changed);
+
+	int last = 0;
+	bool is_bounded = samples.get(&last, length - 1, length) && last == static_cast<int>(length - 1) &&
+		!samples.get(&last, length, length + 1);
+
+	// The container creates arrays longer than the fixed ones as vectors.
+	nlohmann::json property = { { "name", "waveform" }, { "type", "float" }, { "length", 1000 }, { "values", std::vector<float>(1000, 0.5f) } };
+	nlohmann::json root = { { "name", "root" }, { "type", "parent" }, { "childs", nlohmann::json::array({ property }) } };
+	AsyncPropertyContainer container{ Bn3Tag("vector"), main_scope };
+	container.create(root.dump().c_str());
+	auto* waveform = container.findVector<float>("waveform");
+	float waveform_values[1000]{};
+	bool is_created = waveform->length() == 1000 && waveform->get(waveform_values, 0, 1000) &&
+		std::count(waveform_values, waveform_values + 1000, 0.5f) == 1000;
+
+	if (is_confirmed && is_rolled_back && is_bounded && is_created)
+	{
+		say("Good! (Vector check)");
+	}
+}
+
+void test_asyncpropertyarray_bulk(bool value)
+{
+	if (!value)
+		return;
+
+	say("ARRAY BULK TEST");
+
+	using namespace Bn3Monkey;
+
+	ScopedTaskScope main_scope{ Bn3Tag("main") };
+	ScopedTaskScope device_scope{ Bn3Tag("device") };
+
+	// Not a multiple of any register width, so the scalar tails run too.
+	float initial[253];
+	for (int i = 0; i < 253; i++)
+		initial[i] = static_cast<float>(i);
+	AsyncPropertyArray<float, 256> levels{ Bn3Tag("levels"), main_scope, initial, 253 };
+
+	std::atomic<size_t> notified_count{ 0 };
+	// Levels above 1000 are rejected.
+	levels.registerOnPropertyNotified(device_scope, [&](const float* values, size_t start, size_t end) {
+		notified_count++;
+		return std::all_of(values, values + end - start, [](float value) { return value <= 1000.0f; });
+		});
+
+	float expected[253];
+	for (int i = 0; i < 253; i++)
+		expected[i] = i < 3 ? initial[i] : initial[i] * 2.0f + 1.0f;
+	float values[253];
+	bool is_transformed = levels.transform(3, 253, AsyncPropertyScaleOffset<float>{ 2.0f, 1.0f }) &&
+		levels.get(values, 0, 253) && std::equal(values, values + 253, expected) && notified_count.load() == 1;
+
+	for (int i = 0; i < 253; i++)
+		expected[i] = std::min(std::max(expected[i], 10.0f), 100.0f);
+	is_transformed &= levels.transform(0, 253, AsyncPropertyClamp<float>{ 10.0f, 100.0f }) &&
+		levels.get(values, 0, 253) && std::equal(values, values + 253, expected);
+
+	// Rolled back as a whole
+	bool is_rolled_back = !levels.transform(0, 253, [](float value) { return value * 100.0f; }) &&
+		levels.get(values, 0, 253) && std::equal(values, values + 253, expected);
+
+	AsyncPropertyReduction<float> reduction;
+	double sum = 0.0;
+	for (int i = 0; i < 253; i++)
+		sum += expected[i];
+	bool is_reduced = levels.reduce(0, 253, reduction) &&
+		reduction.min == 10.0f && reduction.max == 100.0f && reduction.sum == sum;
+
+	std::fill(expected + 20, expected + 40, 0.0f);
+	bool is_filled = levels.fill(20, 40, 0.0f) && levels.get(values, 0, 253) && std::equal(values, values + 253, expected);
+
+	float changed[2] = { 5.0f, 6.0f };
+	bool is_compared = !levels.compareAndSet(changed, changed, 0, 2) &&
+		levels.compareAndSet(expected, changed, 0, 2) && levels.get(values, 0, 2) && std::equal(values, values + 2, changed);
+
+	// Long enough for the int16_t SIMD loop of an array
+	int16_t meters_initial[250];
+	int64_t meters_sum = 0;
+	for (int i = 0; i < 250; i++)
+	{
+		meters_initial[i] = static_cast<int16_t>((i * 7919) % 65536 - 32768);
+		meters_sum += meters_initial[i];
+	}
+	AsyncPropertyArray<int16_t, 256> meters{ Bn3Tag("meters"), main_scope, meters_initial, 250 };
+	AsyncPropertyReduction<int16_t> meters_reduction;
+	is_reduced &= meters.reduce(0, 250, meters_reduction) &&
+		meters_reduction.min == *std::min_element(meters_initial, meters_initial + 250) &&
+		meters_reduction.max == *std::max_element(meters_initial, meters_initial + 250) &&
+		meters_reduction.sum == meters_sum;
+
+	int16_t samples_initial[1003];
+	for (int i = 0; i < 1003; i++)
+		samples_initial[i] = static_cast<int16_t>(i * 37 - 18000);
+	AsyncPropertyVector<int16_t> samples{ Bn3Tag("samples"), main_scope, samples_initial, 1003 };
+	AsyncPropertyReduction<int16_t> sample_reduction;
+	int64_t sample_sum = 0;
+	for (int i = 0; i < 1003; i++)
+		sample_sum += samples_initial[i];
+	is_reduced &= samples.reduce(0, 1003, sample_reduction) &&
+		sample_reduction.min == samples_initial[0] && sample_reduction.max == samples_initial[1002] && sample_reduction.sum == sample_sum;
+
+	if (is_transformed && is_rolled_back && is_reduced && is_filled && is_compared)
+	{
+		say("Good! (Array bulk check)");
+	}
+}
+
+void test_asyncpropertyarray_ranges(bool value)
+{
+	if (!value)
+		return;
+
+	say("ARRAY RANGES TEST");
+
+	using namespace Bn3Monkey;
+
+	ScopedTaskScope main_scope{ Bn3Tag("main") };
+	ScopedTaskScope device_scope{ Bn3Tag("device") };
+
+	float initial[64]{};
+	AsyncPropertyArray<float, 64> meters{ Bn3Tag("meters"), main_scope, initial, 64 };
+
+	std::atomic<int> notified{ 0 };
+	std::vector<AsyncPropertyRange> notified_ranges;
+	meters.registerOnPropertyRangesNotified(device_scope, [&](const float* values, const AsyncPropertyRange* ranges, size_t range_count) {
+		notified_ranges.assign(ranges, ranges + range_count);
+		notified++;
+		return true;
+		});
+
+	// Holds the scope, so that every write below is merged into one update.
+	std::promise<void> gate;
+	auto opened = gate.get_future().share();
+	main_scope.run(Bn3Tag("gate"), [opened]() { opened.wait(); });
+
+	float level = 1.0f;
+	for (size_t channel : { 40, 10, 11, 12, 30, 31, 12 })
+		meters.setAsync(&level, channel, channel + 1);
+	gate.set_value();
+
+	for (int i = 0; i < 2000 && notified.load() == 0; i++)
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+	float values[64];
+	bool is_merged = notified.load() == 1 && notified_ranges.size() == 3 &&
+		notified_ranges[0].start == 10 && notified_ranges[0].end == 13 &&
+		notified_ranges[1].start == 30 && notified_ranges[1].end == 32 &&
+		notified_ranges[2].start == 40 && notified_ranges[2].end == 41 &&
+		meters.get(values, 0, 64) && std::count(values, values + 64, 1.0f) == 6;
+
+	// More scattered writes than the set holds. The gaps between them keep the values committed by set.
+	float committed = 7.0f;
+	bool is_exact = meters.set(&committed, 1, 2) && meters.notify(1, 2);
+	std::promise<void> overflow_gate;
+	auto overflow_opened = overflow_gate.get_future().share();
+	main_scope.run(Bn3Tag("gate"), [overflow_opened]() { overflow_opened.wait(); });
+	float written = 2.0f;
+	for (size_t channel = 0; channel < 60; channel += 3)
+		meters.setAsync(&written, channel, channel + 1);
+	overflow_gate.set_value();
+	for (int i = 0; i < 2000 && notified.load() < 3; i++)
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+	is_exact &= notified.load() == 3 && notified_ranges.size() <= AsyncPropertyRangeSet::MAX_RANGES &&
+		meters.get(values, 0, 64) && values[1] == 7.0f;
+	for (size_t channel = 0; channel < 64; channel++)
+	{
+		if (channel % 3 == 0 && channel < 60)
+			is_exact &= values[channel] == 2.0f;
+		else if (channel != 1)
+			is_exact &= values[channel] == (channel == 40 || channel == 10 || channel == 11 || channel == 12 || channel == 30 || channel == 31 ? 1.0f : 0.0f);
+	}
+
+	// Beyond the capacity of the set, the closest ranges are merged and nothing is lost.
+	AsyncPropertyRangeSet ranges;
+	for (size_t i = 0; i < 40; i++)
+		ranges.add(i * 3, i * 3 + 1);
+	bool is_covered = ranges.size() == AsyncPropertyRangeSet::MAX_RANGES;
+	for (size_t i = 0; i < 40; i++)
+	{
+		is_covered &= std::any_of(ranges.begin(), ranges.end(), [i](const AsyncPropertyRange& range) {
+			return range.start <= i * 3 && i * 3 + 1 <= range.end;
+			});
+	}
+
+	if (is_merged && is_exact && is_covered)
+	{
+		say("Good! (Array ranges check)");
+	}
+}
+
 void testAsyncProperty(bool value)
 {
 	if (!value)
 		return;
 
-	Bn3Monkey::Bn3MemoryPool::initialize({ 64, 32, 128, 256, 32, 32, 32, 32, 4});
+	// The largest blocks grow, so that they can hold the chunks of long vectors.
+	Bn3Monkey::Bn3MemoryPool::initialize({ 64, 32, 128, 256, 32, 32, 32, 32, 4}, { 64, 32, 128, 256, 32, 32, 32, 32, 512 }, Bn3Monkey::Bn3MemoryPoolGrowth());
 	Bn3Monkey::ScopedTaskRunner().initialize();
 
 	test_asyncpropertycontainer(true);
 	test_asyncproperty(true);
 	test_asyncpropertyarray(true);
+	test_asyncproperty_coalescing(true);
+	test_asyncproperty_snapshot(true);
+	test_asyncproperty_transaction(true);
+	test_asyncproperty_fanout(true);
+	test_asyncpropertyarray_rollback(true);
+	test_asyncpropertyarray_view(true);
+	test_asyncpropertyvector(true);
+	test_asyncpropertyarray_bulk(true);
+	test_asyncpropertyarray_ranges(true);
 
 	Bn3Monkey::ScopedTaskRunner().release();
 	Bn3Monkey::Bn3MemoryPool::release();
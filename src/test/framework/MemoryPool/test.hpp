@@ -3,6 +3,8 @@
 #include "test_helper.hpp"
 #include "../test_helper.hpp"
 
+#include <thread>
+
 
 constexpr size_t block_sizes[] = { 64, 128, 256, 512, 1024, 2048, 4098, 8192, 16384 };
 constexpr size_t block_sizes_length = sizeof(block_sizes) / sizeof(size_t);
@@ -285,6 +287,173 @@ void test_allocator(bool value)
 	Bn3MemoryPool::release();
 }
 
+void test_thread_cache(bool value)
+{
+	if (!value)
+		return;
+
+	using namespace Bn3Monkey;
+
+	Bn3MemoryPool::initialize({ 4096, 4, 4, 4, 4, 4, 4, 4, 4 });
+
+	struct CacheBlock
+	{
+		char buffer[16];
+	};
+
+	{
+		std::vector<std::thread> threads;
+		for (size_t t = 0; t < 4; t++)
+		{
+			threads.emplace_back([]() {
+				CacheBlock* ptrs[100]{ nullptr };
+				for (size_t round = 0; round < 1000; round++)
+				{
+					for (auto& ptr : ptrs)
+						ptr = Bn3MemoryPool::construct<CacheBlock>(Bn3Tag("cache"));
+					for (auto& ptr : ptrs)
+						Bn3MemoryPool::destroy(ptr);
+				}
+				});
+		}
+		for (auto& thread : threads)
+			thread.join();
+	}
+
+	{
+		CacheBlock* ptrs[3]{ nullptr };
+		for (auto& ptr : ptrs)
+			ptr = Bn3MemoryPool::construct<CacheBlock>(Bn3Tag("remain"));
+
+		auto result = analyzer.analyzePool(0);
+		if (result.find("Current allocated : 3\n") != std::string::npos)
+		{
+			say("Good! (Thread cache counter check)");
+		}
+
+		for (auto& ptr : ptrs)
+			Bn3MemoryPool::destroy(ptr);
+	}
+
+#ifdef BN3MONKEY_DEBUG
+	{
+		// Only one of concurrent frees of a block returns it to the pool.
+		bool is_freed_once = true;
+		for (size_t round = 0; round < 256; round++)
+		{
+			auto* ptr = Bn3MemoryPool::construct<CacheBlock>(Bn3Tag("double_free"));
+			std::atomic<size_t> ready_count{ 0 };
+			std::atomic<size_t> freed_count{ 0 };
+
+			std::vector<std::thread> threads;
+			for (size_t t = 0; t < 4; t++)
+			{
+				threads.emplace_back([&]() {
+					ready_count++;
+					while (ready_count.load() < 4)
+						std::this_thread::yield();
+					if (Bn3MemoryPool::deallocate(ptr, 1))
+						freed_count++;
+					});
+			}
+			for (auto& thread : threads)
+				thread.join();
+
+			if (freed_count.load() != 1)
+				is_freed_once = false;
+		}
+		if (is_freed_once)
+		{
+			say("Good! (Concurrent double free check)");
+		}
+	}
+#endif
+
+	Bn3MemoryPool::release();
+}
+
+void test_growth(bool value)
+{
+	if (!value)
+		return;
+
+	using namespace Bn3Monkey;
+
+	Bn3MemoryPoolGrowth growth;
+	growth.growth_factor = 2.0;
+	Bn3MemoryPool::initialize({ 4, 4, 4, 4, 4, 4, 4, 4, 4 }, { 16, 4, 4, 4, 4, 4, 4, 4, 4 }, growth);
+
+	struct GrowthBlock
+	{
+		char buffer[16];
+	};
+
+	GrowthBlock* ptrs[17]{ nullptr };
+	for (auto& ptr : ptrs)
+		ptr = Bn3MemoryPool::construct<GrowthBlock>(Bn3Tag("grow"));
+
+	if (ptrs[15] != nullptr && ptrs[16] == nullptr)
+	{
+		say("Good! (Growth ceiling check)");
+	}
+
+	for (auto& ptr : ptrs)
+	{
+		if (ptr)
+			Bn3MemoryPool::destroy(ptr);
+	}
+
+	Bn3MemoryPool::trim();
+	// Trimmed slabs are deleted at the next trim.
+	Bn3MemoryPool::trim();
+	if (analyzer.analyzePool(0).find("Capacity : 4 / 16\n") != std::string::npos)
+	{
+		say("Good! (Trim check)");
+	}
+
+	Bn3MemoryPool::release();
+
+	// Slabs are trimmed while other threads keep popping and pushing blocks of them.
+	Bn3MemoryPool::initialize({ 4, 4, 4, 4, 4, 4, 4, 4, 4 }, { 64, 4, 4, 4, 4, 4, 4, 4, 4 }, growth);
+	{
+		std::atomic<size_t> running_count{ 4 };
+		std::atomic<bool> is_allocated{ true };
+		std::vector<std::thread> threads;
+		for (size_t t = 0; t < 4; t++)
+		{
+			threads.emplace_back([&]() {
+				GrowthBlock* ptrs[12]{ nullptr };
+				for (size_t round = 0; round < 500; round++)
+				{
+					for (auto& ptr : ptrs)
+						ptr = Bn3MemoryPool::construct<GrowthBlock>(Bn3Tag("trim"));
+					for (auto& ptr : ptrs)
+					{
+						if (ptr)
+							Bn3MemoryPool::destroy(ptr);
+						else
+							is_allocated = false;
+					}
+					// Lets the grown slabs become free, so that they are trimmed between rounds.
+					std::this_thread::sleep_for(std::chrono::microseconds(100));
+				}
+				running_count--;
+				});
+		}
+		while (running_count.load() > 0)
+			Bn3MemoryPool::trim();
+		for (auto& thread : threads)
+			thread.join();
+
+		if (is_allocated && analyzer.analyzePool(0).find("Current allocated : 0\n") != std::string::npos)
+		{
+			say("Good! (Concurrent trim check)");
+		}
+	}
+
+	Bn3MemoryPool::release();
+}
+
 void testMemoryPool(bool value)
 {
 	if (!value)
@@ -295,4 +464,6 @@ void testMemoryPool(bool value)
 	test_dealloc_nullptr(true);
 	test_alloc_and_initialize(true);
 	test_alloc_array(true);
+	test_thread_cache(true);
+	test_growth(true);
 }
\ No newline at end of file
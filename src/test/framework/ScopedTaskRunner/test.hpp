@@ -1,4 +1,9 @@
 #include <ScopedTask/ScopedTask.hpp>
+#include <thread>
+#include <vector>
+#include <algorithm>
+#include <atomic>
+#include <string>
 #include "../test_helper.hpp"
 
 using namespace std::chrono_literals;
@@ -378,6 +383,860 @@ void test_looper(bool value)
 	ScopedTaskRunner().release();
 }
 
+void test_many_loopers(bool value)
+{
+	if (!value)
+		return;
+
+	say("MANY LOOPERS TEST");
+
+	using namespace Bn3Monkey;
+
+	ScopedTaskRunner().initialize();
+
+	constexpr size_t looper_count = 16;
+
+	auto main = ScopedTaskScope(Bn3Tag("main"));
+	auto device = ScopedTaskScope(Bn3Tag("device"));
+
+	std::atomic<size_t> counts[looper_count]{};
+	std::vector<ScopedTaskLooper> loopers;
+	loopers.reserve(looper_count);
+	for (size_t i = 0; i < looper_count; i++)
+	{
+		std::string name = "looper";
+		name += std::to_string(i);
+		loopers.emplace_back(Bn3Tag(name.c_str()));
+		loopers.back().start(std::chrono::milliseconds(2 + i), i % 2 == 0 ? main : device, [&counts, i]() {
+			counts[i]++;
+			});
+	}
+
+	std::this_thread::sleep_for(std::chrono::milliseconds(300));
+
+	// Stopping half of them in the middle of the heap
+	for (size_t i = 0; i < looper_count; i += 2)
+		loopers[i].stop();
+	std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+	size_t stopped_counts[looper_count];
+	for (size_t i = 0; i < looper_count; i++)
+		stopped_counts[i] = counts[i].load();
+	std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+	bool is_fired = true;
+	bool is_stopped = true;
+	for (size_t i = 0; i < looper_count; i++)
+	{
+		if (counts[i].load() < 5)
+			is_fired = false;
+		bool is_running = counts[i].load() != stopped_counts[i];
+		if (is_running == (i % 2 == 0))
+			is_stopped = false;
+	}
+
+	for (size_t i = 1; i < looper_count; i += 2)
+		loopers[i].stop();
+
+	if (is_fired && is_stopped)
+	{
+		say("Good! (Many loopers check)");
+	}
+
+	ScopedTaskRunner().release();
+}
+
+void test_looper_modes(bool value)
+{
+	if (!value)
+		return;
+
+	say("LOOPER MODES TEST");
+
+	using namespace Bn3Monkey;
+
+	ScopedTaskRunner().initialize();
+
+	auto main = ScopedTaskScope(Bn3Tag("main"));
+	auto device = ScopedTaskScope(Bn3Tag("device"));
+	auto slow = ScopedTaskScope(Bn3Tag("slow"));
+
+	auto rate = ScopedTaskLooper(Bn3Tag("fixed_rate"));
+	auto delay = ScopedTaskLooper(Bn3Tag("fixed_delay"));
+	auto coalesced = ScopedTaskLooper(Bn3Tag("coalesced"));
+
+	std::atomic<int> running{ 0 };
+	std::atomic<bool> is_overlapped{ false };
+
+	ScopedTaskLooperOption rate_option;
+	rate.start(rate_option, std::chrono::milliseconds(5), main, []() {});
+
+	ScopedTaskLooperOption delay_option;
+	delay_option.mode = ScopedTaskLooperMode::FIXED_DELAY;
+	delay.start(delay_option, std::chrono::milliseconds(5), device, []() {
+		std::this_thread::sleep_for(std::chrono::milliseconds(5));
+		});
+
+	// Each tick takes 10 ticks long, so the ticks in between are skipped instead of piling up.
+	ScopedTaskLooperOption coalesced_option;
+	coalesced_option.is_coalesced = true;
+	coalesced.start(coalesced_option, std::chrono::milliseconds(1), slow, [&]() {
+		if (running++ != 0)
+			is_overlapped = true;
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+		running--;
+		});
+
+	std::this_thread::sleep_for(std::chrono::milliseconds(300));
+	rate.stop();
+	delay.stop();
+	coalesced.stop();
+
+	auto rate_statistics = rate.statistics();
+	auto delay_statistics = delay.statistics();
+	auto coalesced_statistics = coalesced.statistics();
+
+	uint64_t jitter_count = 0;
+	for (auto count : rate_statistics.jitter)
+		jitter_count += count;
+
+	// Anchored to the start time, every deadline is either fired or counted as missed.
+	auto deadlines = rate_statistics.fired + rate_statistics.missed;
+	bool is_fixed_rate = deadlines >= 55 && deadlines <= 62 && jitter_count == rate_statistics.fired;
+	// Each period is the interval plus the tick itself.
+	bool is_fixed_delay = delay_statistics.fired >= 10 && delay_statistics.fired <= 31;
+	bool is_coalesced = coalesced_statistics.coalesced > 0 && coalesced_statistics.fired <= 31 && !is_overlapped;
+
+	if (is_fixed_rate && is_fixed_delay && is_coalesced)
+	{
+		say("Good! (Looper modes check)");
+	}
+
+	ScopedTaskRunner().release();
+}
+
+void test_timer(bool value)
+{
+	if (!value)
+		return;
+
+	say("TIMER TEST");
+
+	using namespace Bn3Monkey;
+
+	ScopedTaskRunner().initialize();
+
+	auto main = ScopedTaskScope(Bn3Tag("main"));
+	auto device = ScopedTaskScope(Bn3Tag("device"));
+
+	auto begin = std::chrono::steady_clock::now();
+	std::atomic<int64_t> elapsed_ms{ -1 };
+	std::atomic<int> order{ 0 };
+	std::atomic<int> first{ 0 };
+	std::atomic<bool> is_cancelled_fired{ false };
+
+	auto later = main.runAfter(std::chrono::milliseconds(20), Bn3Tag("later"), [&]() {
+		elapsed_ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - begin).count();
+		order++;
+		});
+	auto earlier = device.runAt(begin + std::chrono::milliseconds(10), Bn3Tag("earlier"), [&]() {
+		if (order++ == 0)
+			first = 1;
+		});
+	auto cancelled = main.runAfter(std::chrono::milliseconds(15), Bn3Tag("cancelled"), [&]() {
+		is_cancelled_fired = true;
+		});
+	bool is_cancelled = cancelled.cancel() && !cancelled.isPending() && !cancelled.cancel();
+
+	// Debouncing restarts a timer on every input, and only the last one fires.
+	std::atomic<int> debounced{ 0 };
+	ScopedTaskTimer debounce;
+	for (int i = 0; i < 50; i++)
+	{
+		debounce.cancel();
+		debounce = main.runAfter(std::chrono::milliseconds(5), Bn3Tag("debounce"), [&debounced, i]() {
+			debounced = i + 1;
+			});
+		std::this_thread::sleep_for(std::chrono::microseconds(200));
+	}
+
+	std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+	bool is_fired = elapsed_ms.load() >= 20 && first.load() == 1 && order.load() == 2 && !later.isPending();
+	bool is_debounced = debounced.load() == 50;
+
+	if (is_fired && is_cancelled && !is_cancelled_fired && is_debounced)
+	{
+		say("Good! (Timer check)");
+	}
+
+	ScopedTaskRunner().release();
+}
+
+void test_priority(bool value)
+{
+	if (!value)
+		return;
+
+	say("PRIORITY TEST");
+
+	using namespace Bn3Monkey;
+
+	ScopedTaskRunner().initialize();
+
+	auto device = ScopedTaskScope(Bn3Tag("device"));
+
+	// Every queued task holds a pooled node until it runs, so the count stays within the test pool.
+	constexpr int task_count = 16;
+	std::atomic<bool> is_blocked{ true };
+	// Only the worker of device appends.
+	std::vector<char> order;
+	order.reserve(task_count * 3 + 8);
+
+	// Blocks device until every task is queued
+	device.run(Bn3Tag("gate"), [&]() {
+		while (is_blocked)
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		});
+	for (int i = 0; i < task_count; i++)
+	{
+		device.run(ScopedTaskPriority::LOW, Bn3Tag("low"), [&]() { order.push_back('L'); });
+		device.run(Bn3Tag("normal"), [&]() { order.push_back('N'); });
+	}
+	auto high = device.call(ScopedTaskPriority::HIGH, Bn3Tag("high"), [&]() {
+		order.push_back('H');
+		return true;
+		});
+
+	// A full lane drops new tasks.
+	device.setLaneCapacity(ScopedTaskPriority::LOW, task_count + 4);
+	std::atomic<int> accepted{ 0 };
+	for (int i = 0; i < 8; i++)
+		device.run(ScopedTaskPriority::LOW, Bn3Tag("bulk"), [&]() { accepted++; });
+
+	is_blocked = false;
+	high.wait();
+	device.setLaneCapacity(ScopedTaskPriority::LOW, 0);
+	device.call(ScopedTaskPriority::LOW, Bn3Tag("flush"), []() {}).wait();
+
+	// The high task goes first, and low tasks are not starved by normal ones.
+	size_t first_low = std::find(order.begin(), order.end(), 'L') - order.begin();
+	bool is_prioritized = !order.empty() && order.front() == 'H';
+	bool is_aged = first_low <= 10;
+	bool is_limited = accepted.load() == 4 && order.size() == task_count * 2 + 1;
+
+	if (is_prioritized && is_aged && is_limited)
+	{
+		say("Good! (Priority check)");
+	}
+
+	ScopedTaskRunner().release();
+}
+
+void test_capacity(bool value)
+{
+	if (!value)
+		return;
+
+	say("CAPACITY TEST");
+
+	using namespace Bn3Monkey;
+
+	ScopedTaskRunner().initialize();
+
+	auto device = ScopedTaskScope(Bn3Tag("device"));
+
+	std::atomic<bool> is_blocked{ false };
+	std::atomic<bool> is_gated{ false };
+	// Occupies the worker of device, so that the next tasks stay queued
+	auto gate = [&]() {
+		is_blocked = true;
+		is_gated = false;
+		device.run(Bn3Tag("gate"), [&]() {
+			is_gated = true;
+			while (is_blocked)
+				std::this_thread::sleep_for(std::chrono::milliseconds(1));
+			});
+		while (!is_gated)
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	};
+	// Lifts the capacity first, so that flush itself is not rejected.
+	auto flush = [&]() {
+		device.setCapacity(0, ScopedTaskCapacityPolicy::BLOCK);
+		is_blocked = false;
+		device.call(Bn3Tag("flush"), []() {}).wait();
+	};
+
+	// Only the worker of device appends.
+	std::vector<int> executed;
+	executed.reserve(32);
+	auto record = [&executed](int idx) { executed.push_back(idx); };
+
+	gate();
+	device.setCapacity(4, ScopedTaskCapacityPolicy::FAIL);
+	int queued = 0;
+	int rejected = 0;
+	for (int i = 0; i < 6; i++)
+	{
+		auto status = device.run(Bn3Tag("fail"), record, i);
+		queued += status == ScopedTaskRunStatus::QUEUED;
+		rejected += status == ScopedTaskRunStatus::REJECTED;
+	}
+	flush();
+	bool is_failed = queued == 4 && rejected == 2 && executed == std::vector<int>{ 0, 1, 2, 3 };
+
+	executed.clear();
+	gate();
+	device.setCapacity(4, ScopedTaskCapacityPolicy::DROP_OLDEST);
+	int dropped = 0;
+	for (int i = 0; i < 6; i++)
+		dropped += device.run(Bn3Tag("drop"), record, i) == ScopedTaskRunStatus::DROPPED_OLDEST;
+	flush();
+	bool is_dropped = dropped == 2 && executed == std::vector<int>{ 2, 3, 4, 5 };
+
+	executed.clear();
+	gate();
+	device.setCapacity(2, ScopedTaskCapacityPolicy::COALESCE_BY_TAG);
+	device.run(Bn3Tag("position"), record, 0);
+	device.run(Bn3Tag("color"), record, 1);
+	// The latest position replaces the queued one, and keeps its place in the queue.
+	auto coalesced = device.run(Bn3Tag("position"), record, 2);
+	auto overflowed = device.run(Bn3Tag("size"), record, 3);
+	flush();
+	bool is_coalesced = coalesced == ScopedTaskRunStatus::COALESCED && overflowed == ScopedTaskRunStatus::REJECTED && executed == std::vector<int>{ 2, 1 };
+
+	executed.clear();
+	gate();
+	device.setCapacity(2, ScopedTaskCapacityPolicy::BLOCK);
+	std::atomic<int> produced{ 0 };
+	std::thread producer([&]() {
+		for (int i = 0; i < 8; i++)
+		{
+			device.run(Bn3Tag("block"), record, i);
+			produced++;
+		}
+		});
+	std::this_thread::sleep_for(std::chrono::milliseconds(20));
+	bool is_waiting = produced.load() == 2;
+	is_blocked = false;
+	producer.join();
+	flush();
+	bool is_blocking = is_waiting && executed == std::vector<int>{ 0, 1, 2, 3, 4, 5, 6, 7 };
+
+	if (is_failed && is_dropped && is_coalesced && is_blocking)
+	{
+		say("Good! (Capacity check)");
+	}
+
+	ScopedTaskRunner().release();
+}
+
+void test_rejected_dispatch(bool value)
+{
+	if (!value)
+		return;
+
+	say("REJECTED DISPATCH TEST");
+
+	using namespace Bn3Monkey;
+
+	ScopedTaskRunner().initialize();
+
+	auto device = ScopedTaskScope(Bn3Tag("device"));
+
+	std::atomic<bool> is_blocked{ true };
+	std::atomic<bool> is_gated{ false };
+	device.run(Bn3Tag("gate"), [&]() {
+		is_gated = true;
+		while (is_blocked)
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		});
+	while (!is_gated)
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	// The filler takes the only slot, so every tick is rejected while the gate holds.
+	device.setCapacity(1, ScopedTaskCapacityPolicy::FAIL);
+	device.run(Bn3Tag("filler"), []() {});
+
+	std::atomic<int> delay_ticks{ 0 };
+	std::atomic<int> coalesced_ticks{ 0 };
+	auto delay = ScopedTaskLooper(Bn3Tag("rejected_delay"));
+	auto coalesced = ScopedTaskLooper(Bn3Tag("rejected_coalesced"));
+	ScopedTaskLooperOption delay_option;
+	delay_option.mode = ScopedTaskLooperMode::FIXED_DELAY;
+	delay.start(delay_option, std::chrono::milliseconds(2), device, [&]() { delay_ticks++; });
+	ScopedTaskLooperOption coalesced_option;
+	coalesced_option.is_coalesced = true;
+	coalesced.start(coalesced_option, std::chrono::milliseconds(2), device, [&]() { coalesced_ticks++; });
+	std::atomic<bool> is_refused_fired{ false };
+	auto refused = device.runAfter(std::chrono::milliseconds(5), Bn3Tag("refused"), [&]() { is_refused_fired = true; });
+
+	std::this_thread::sleep_for(std::chrono::milliseconds(30));
+	// The timer whose fire is refused is cancelled, instead of staying pending.
+	bool is_refused = refused.isCancelled() && !refused.isPending() && !refused.cancel();
+	device.setCapacity(0, ScopedTaskCapacityPolicy::BLOCK);
+	is_blocked = false;
+
+	// Both loopers go on once the scope accepts their ticks again.
+	for (int i = 0; i < 1000 && (delay_ticks.load() < 3 || coalesced_ticks.load() < 3); i++)
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	bool is_resumed = delay_ticks.load() >= 3 && coalesced_ticks.load() >= 3;
+	is_refused &= !is_refused_fired.load();
+
+	delay.stop();
+	coalesced.stop();
+
+	// A scope which blocks its producers rejects ticks instead, so that the scheduler goes on serving other loopers.
+	auto ui = ScopedTaskScope(Bn3Tag("ui"));
+	is_blocked = true;
+	is_gated = false;
+	device.run(Bn3Tag("gate"), [&]() {
+		is_gated = true;
+		while (is_blocked)
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		});
+	while (!is_gated)
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	device.setCapacity(1, ScopedTaskCapacityPolicy::BLOCK);
+	device.run(Bn3Tag("filler"), []() {});
+
+	std::atomic<int> blocked_ticks{ 0 };
+	std::atomic<int> ui_ticks{ 0 };
+	auto blocked = ScopedTaskLooper(Bn3Tag("blocked_delay"));
+	auto other = ScopedTaskLooper(Bn3Tag("other_scope"));
+	blocked.start(delay_option, std::chrono::milliseconds(2), device, [&]() { blocked_ticks++; });
+	other.start(ScopedTaskLooperOption(), std::chrono::milliseconds(2), ui, [&]() { ui_ticks++; });
+
+	for (int i = 0; i < 1000 && ui_ticks.load() < 3; i++)
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	bool is_not_blocked = ui_ticks.load() >= 3 && blocked_ticks.load() == 0;
+	device.setCapacity(0, ScopedTaskCapacityPolicy::BLOCK);
+	is_blocked = false;
+
+	for (int i = 0; i < 1000 && blocked_ticks.load() < 3; i++)
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	is_not_blocked &= blocked_ticks.load() >= 3;
+
+	blocked.stop();
+	other.stop();
+
+	if (is_resumed && is_refused && is_not_blocked)
+	{
+		say("Good! (Rejected dispatch check)");
+	}
+
+	ScopedTaskRunner().release();
+}
+
+void test_allocation_free_dispatch(bool value)
+{
+	if (!value)
+		return;
+
+	say("ALLOCATION FREE DISPATCH TEST");
+
+	using namespace Bn3Monkey;
+
+	ScopedTaskRunner().initialize();
+
+	auto main = ScopedTaskScope(Bn3Tag("main"));
+	std::atomic<size_t> counter{ 0 };
+	char big_capture[128]{ 1 };
+
+	// Starting the worker thread of the scope allocates.
+	main.call(Bn3Tag("warm_up"), [&]() {
+		return counter.load();
+		}).wait();
+
+	size_t allocation_count = global_allocation_count.load();
+
+	for (size_t i = 0; i < 16; i++)
+	{
+		main.run(Bn3Tag("small"), [&counter]() {
+			counter += 1;
+			});
+		main.run(Bn3Tag("big"), [&counter, big_capture]() {
+			counter += big_capture[0];
+			});
+	}
+	auto result = main.call(Bn3Tag("result"), [&](size_t offset) {
+		return counter.load() + offset;
+		}, 1);
+	auto* ret = result.wait();
+
+	allocation_count = global_allocation_count.load() - allocation_count;
+	if (ret && *ret == 33 && allocation_count == 0)
+	{
+		say("Good! (Allocation free dispatch check)");
+	}
+	else
+	{
+		say("Bad! (Allocation free dispatch check : %zu allocations)", allocation_count);
+	}
+
+	// A callable which the memory pool cannot hold is reported instead of being queued empty.
+	std::atomic<bool> is_blocked{ true };
+	main.run(Bn3Tag("gate"), [&]() {
+		while (is_blocked)
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		});
+	char huge_capture[9000]{ 1 };
+	size_t out_of_memory_count = 0;
+	for (size_t i = 0; i < 8; i++)
+	{
+		auto status = main.run(Bn3Tag("huge"), [&counter, huge_capture]() {
+			counter += huge_capture[0];
+			});
+		if (ScopedTaskRunStatus::OUT_OF_MEMORY == status)
+			out_of_memory_count++;
+	}
+	auto huge_result = main.call(Bn3Tag("huge_result"), [huge_capture]() {
+		return huge_capture[0];
+		});
+	bool is_huge_result_empty = huge_result.wait() == nullptr;
+	is_blocked = false;
+	main.call(Bn3Tag("flush"), []() { return true; }).wait();
+
+	if (out_of_memory_count > 0 && is_huge_result_empty)
+	{
+		say("Good! (Callable out of memory check)");
+	}
+
+	ScopedTaskRunner().release();
+}
+
+void test_multi_producer(bool value)
+{
+	if (!value)
+		return;
+
+	say("MULTI PRODUCER TEST");
+
+	using namespace Bn3Monkey;
+
+	ScopedTaskRunner().initialize();
+
+	auto main = ScopedTaskScope(Bn3Tag("main"));
+
+	constexpr size_t producer_count = 4;
+	constexpr size_t task_count = 1000;
+
+	// Written by the worker of main only
+	size_t last_values[producer_count]{ 0 };
+	bool is_ordered = true;
+	std::atomic<size_t> counter{ 0 };
+
+	std::vector<std::thread> producers;
+	for (size_t producer = 0; producer < producer_count; producer++)
+	{
+		producers.emplace_back([&, producer]() {
+			auto scope = ScopedTaskScope(Bn3Tag("main"));
+			for (size_t i = 1; i <= task_count; i++)
+			{
+				scope.run(Bn3Tag("produce"), [&, producer, i]() {
+					if (last_values[producer] + 1 != i)
+						is_ordered = false;
+					last_values[producer] = i;
+					counter++;
+					});
+				// Keep the tasks in flight under the capacity of the memory pool.
+				if (i % 16 == 0)
+					scope.call(Bn3Tag("flush"), []() { return true; }).wait();
+			}
+			});
+	}
+	for (auto& producer : producers)
+		producer.join();
+
+	auto result = main.call(Bn3Tag("consume"), [&]() {
+		return counter.load();
+		});
+	auto* ret = result.wait();
+
+	if (ret && *ret == producer_count * task_count && is_ordered)
+	{
+		say("Good! (Multi producer check)");
+	}
+
+	ScopedTaskRunner().release();
+}
+
+void test_call_result(bool value)
+{
+	if (!value)
+		return;
+
+	say("CALL RESULT TEST");
+
+	using namespace Bn3Monkey;
+
+	ScopedTaskRunner().initialize();
+
+	auto device = ScopedTaskScope(Bn3Tag("device"));
+
+	// A result which is not trivially copyable is moved into the result slot.
+	auto text = device.call(Bn3Tag("text"), []() {
+		return std::string("a result longer than the small string buffer");
+		});
+	auto* text_ret = text.wait();
+
+	bool is_called{ false };
+	auto none = device.call(Bn3Tag("none"), [&]() {
+		is_called = true;
+		});
+	bool none_ret = none.wait();
+
+	if (text_ret && *text_ret == "a result longer than the small string buffer" && none_ret && is_called)
+	{
+		say("Good! (Call result check)");
+	}
+
+	ScopedTaskRunner().release();
+}
+
+void test_continuation(bool value)
+{
+	if (!value)
+		return;
+
+	say("CONTINUATION TEST");
+
+	using namespace Bn3Monkey;
+
+	ScopedTaskRunner().initialize();
+
+	auto device = ScopedTaskScope(Bn3Tag("device"));
+	auto ip = ScopedTaskScope(Bn3Tag("ip"));
+	auto ui = ScopedTaskScope(Bn3Tag("ui"));
+
+	// The continuation is registered before the device task finishes, and runs on ui.
+	auto doubled = device.call(Bn3Tag("measure"), []() {
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+		return 21;
+		}).then(ui, Bn3Tag("double"), [](int& measured) {
+			return measured * 2;
+			});
+	auto* doubled_ret = doubled.wait();
+
+	if (doubled_ret && *doubled_ret == 42)
+	{
+		say("Good! (Then check)");
+	}
+
+	ScopedTaskResult<int> results[4];
+	for (int i = 0; i < 4; i++)
+	{
+		auto& scope = i % 2 == 0 ? device : ip;
+		results[i] = scope.call(Bn3Tag("part"), [i]() {
+			std::this_thread::sleep_for(std::chrono::milliseconds(i));
+			return i;
+			});
+	}
+	auto sum = whenAll(results, 4).then(ui, Bn3Tag("sum"), [&](size_t& finished) {
+		int ret = 0;
+		for (auto& result : results)
+			ret += *result.wait();
+		return finished == 4 ? ret : -1;
+		});
+	auto* sum_ret = sum.wait();
+
+	if (sum_ret && *sum_ret == 0 + 1 + 2 + 3)
+	{
+		say("Good! (When all check)");
+	}
+
+	auto slow = device.call(Bn3Tag("slow"), []() {
+		std::this_thread::sleep_for(std::chrono::milliseconds(50));
+		return true;
+		});
+	auto fast = ip.call(Bn3Tag("fast"), []() {
+		return 1.0;
+		});
+	auto first = whenAny(slow, fast);
+	auto* first_ret = first.wait();
+	slow.wait();
+
+	if (first_ret && *first_ret == 1)
+	{
+		say("Good! (When any check)");
+	}
+
+	ScopedTaskRunner().release();
+}
+
+#ifdef BN3MONKEY_SCOPED_TASK_COROUTINE
+inline Bn3Monkey::ScopedCoroutineTask<int> measureOnDevice(Bn3Monkey::ScopedTaskScope device, int value)
+{
+	using namespace Bn3Monkey;
+	auto ret = co_await device.call(Bn3Tag("measure"), [value]() {
+		return value * 10;
+		});
+	co_return ret ? *ret : -1;
+}
+
+// Finishes on device, so the awaiting coroutine must be sent back to its own scope.
+inline Bn3Monkey::ScopedCoroutineTask<int> measureAfterMovingToDevice(Bn3Monkey::ScopedTaskScope device, int value)
+{
+	bool is_scheduled = co_await device.schedule();
+	if (!is_scheduled)
+		co_return -1;
+	co_return value * 10;
+}
+
+inline Bn3Monkey::ScopedCoroutineTask<> runFlow(Bn3Monkey::ScopedTaskScope ui, Bn3Monkey::ScopedTaskScope device, std::atomic<int>& sum, std::atomic<bool>& is_on_ui)
+{
+	using namespace Bn3Monkey;
+	if (!co_await ui.schedule())
+		co_return;
+
+	for (int i = 1; i <= 4; i++)
+	{
+		// Neither ui nor device is blocked while the flow waits.
+		std::optional<int> value;
+		if (i % 2)
+			value = co_await measureOnDevice(device, i);
+		else
+			value = co_await measureAfterMovingToDevice(device, i);
+		if (value)
+			sum += *value;
+		if (ScopedTaskScopeImpl::currentScope() == nullptr || strcmp(ScopedTaskScopeImpl::currentScope()->name(), "ui"))
+			is_on_ui = false;
+	}
+}
+
+void test_coroutine(bool value)
+{
+	if (!value)
+		return;
+
+	say("COROUTINE TEST");
+
+	using namespace Bn3Monkey;
+
+	ScopedTaskRunner().initialize();
+
+	auto ui = ScopedTaskScope(Bn3Tag("ui"));
+	auto device = ScopedTaskScope(Bn3Tag("device"));
+
+	constexpr int flow_count = 16;
+	std::atomic<int> sum{ 0 };
+	std::atomic<bool> is_on_ui{ true };
+	{
+		std::vector<ScopedCoroutineTask<>> flows;
+		for (int i = 0; i < flow_count; i++)
+			flows.push_back(runFlow(ui, device, sum, is_on_ui));
+
+		// Flows keep running after their tasks are destroyed.
+		flows.resize(flow_count / 2);
+		while (sum.load() < flow_count * 100)
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+
+	if (sum.load() == flow_count * 100 && is_on_ui)
+	{
+		say("Good! (Coroutine check)");
+	}
+
+	ScopedTaskRunner().release();
+}
+#endif
+
+void test_shared_pool(bool value)
+{
+	if (!value)
+		return;
+
+	say("SHARED POOL TEST");
+
+	using namespace Bn3Monkey;
+
+	ScopedTaskRunner().initialize(ScopedTaskExecution::SHARED_POOL, 2);
+
+	constexpr size_t scope_count = 8;
+	constexpr size_t task_count = 256;
+
+	// Each scope is a strand, so its tasks run in order even though they share two workers.
+	size_t last_values[scope_count]{ 0 };
+	std::atomic<bool> is_ordered{ true };
+
+	std::vector<std::thread> producers;
+	for (size_t idx = 0; idx < scope_count; idx++)
+	{
+		producers.emplace_back([&, idx]() {
+			// Scopes are registered concurrently.
+			std::string name = "strand";
+			name += std::to_string(idx);
+			auto scope = ScopedTaskScope(Bn3Tag(name.c_str()));
+			for (size_t i = 1; i <= task_count; i++)
+			{
+				scope.run(Bn3Tag("produce"), [&, idx, i]() {
+					if (last_values[idx] + 1 != i)
+						is_ordered = false;
+					last_values[idx] = i;
+					});
+				// Keep the tasks of all scopes in flight under the capacity of the memory pool.
+				if (i % 4 == 0)
+					scope.call(Bn3Tag("flush"), []() { return true; }).wait();
+			}
+			});
+	}
+	for (auto& producer : producers)
+		producer.join();
+
+	if (is_ordered)
+	{
+		say("Good! (Strand order check)");
+	}
+
+	// A chain of waits deeper than the number of workers. Waiting workers run the next strand meanwhile.
+	auto first = ScopedTaskScope(Bn3Tag("first"));
+	auto result = first.call(Bn3Tag("chain"), []() {
+		auto second = ScopedTaskScope(Bn3Tag("second"));
+		auto* ret = second.call(Bn3Tag("chain"), []() {
+			auto third = ScopedTaskScope(Bn3Tag("third"));
+			auto* ret = third.call(Bn3Tag("chain"), []() {
+				// Called on the current strand, so it runs inline.
+				auto* ret = ScopedTaskScope(Bn3Tag("third")).call(Bn3Tag("inline"), []() { return 1; }).wait();
+				return ret ? *ret + 1 : 0;
+				}).wait();
+			return ret ? *ret + 1 : 0;
+			}).wait();
+		return ret ? *ret + 1 : 0;
+		});
+	auto* ret = result.wait();
+
+	if (ret && *ret == 4)
+	{
+		say("Good! (Nested call on shared pool check)");
+	}
+
+	// A waiting worker must not run the strand which waits for the next task of its own strand.
+	auto outer = ScopedTaskScope(Bn3Tag("outer"));
+	auto inner = ScopedTaskScope(Bn3Tag("inner"));
+	auto other = ScopedTaskScope(Bn3Tag("other"));
+	std::atomic<size_t> wait_count{ 0 };
+	for (size_t round = 0; round < 32; round++)
+	{
+		auto waited = outer.call(Bn3Tag("wait_inner"), [&]() {
+			auto slow = inner.call(Bn3Tag("slow"), []() {
+				std::this_thread::sleep_for(std::chrono::milliseconds(1));
+				return true;
+				});
+			other.run(Bn3Tag("wait_outer"), [&]() {
+				if (outer.call(Bn3Tag("next"), []() { return true; }).wait())
+					wait_count++;
+				});
+			return slow.wait() != nullptr;
+			});
+		waited.wait();
+	}
+	while (wait_count.load() < 32)
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+	say("Good! (Blocked worker check)");
+
+	ScopedTaskRunner().release();
+}
+
 void testScopedTaskRunner(bool value)
 {
 	if (!value)
@@ -386,6 +1245,20 @@ void testScopedTaskRunner(bool value)
 	Bn3Monkey::Bn3MemoryPool::initialize({ 32, 32, 128, 32, 32, 32, 32, 32, 4 });
 
 	test_looper(true);
+	test_many_loopers(true);
+	test_looper_modes(true);
+	test_timer(true);
+	test_priority(true);
+	test_capacity(true);
+	test_rejected_dispatch(true);
+	test_allocation_free_dispatch(true);
+	test_multi_producer(true);
+	test_shared_pool(true);
+	test_call_result(true);
+	test_continuation(true);
+#ifdef BN3MONKEY_SCOPED_TASK_COROUTINE
+	test_coroutine(true);
+#endif
 
 	for (size_t i = 0; i < 100; i++)
 	{
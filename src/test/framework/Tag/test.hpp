@@ -0,0 +1,103 @@
+#include <Tag/Tag.hpp>
+#include <thread>
+#include <vector>
+#include "../test_helper.hpp"
+
+inline void test_tag_intern()
+{
+	using namespace Bn3Monkey;
+
+	Bn3Tag a("sans");
+	Bn3Tag b("sans");
+	Bn3Tag c("papyrus");
+	if (a == b && a != c && a.str() == b.str() && !strcmp(a.str(), "sans"))
+	{
+		say("Good! (Tag intern check)");
+	}
+
+	Bn3Tag empty;
+	Bn3Tag cleared("undyne");
+	cleared.clear();
+	if (empty == cleared && !strcmp(empty.str(), "") && empty == Bn3Tag(""))
+	{
+		say("Good! (Empty tag check)");
+	}
+
+	Bn3Tag long_tag("abcdefghijklmnopqrstuvwxyz0123456789");
+	if (strlen(long_tag.str()) == TAG_SIZE - 1 && long_tag == Bn3Tag("abcdefghijklmnopqrstuvwxyz01234"))
+	{
+		say("Good! (Long tag check)");
+	}
+}
+
+inline void test_tag_concatenate()
+{
+	using namespace Bn3Monkey;
+
+	Bn3Tag name("gain");
+	Bn3Tag prefix("Notified_");
+	Bn3Tag first(prefix, name);
+	Bn3Tag second("Notified_", name);
+	Bn3Tag third(Bn3Tag("Notif"), "ied_gain");
+	if (first == second && second == third && !strcmp(first.str(), "Notified_gain"))
+	{
+		say("Good! (Tag concatenation check)");
+	}
+
+	Bn3Tag postfix("abcdefghijklmnopqrstuvwxyz");
+	Bn3Tag truncated("tasks_", postfix);
+	if (!strcmp(truncated.str(), "tasks_abcdefghijklmnopqrstuvwxy"))
+	{
+		say("Good! (Tag concatenation truncation check)");
+	}
+}
+
+inline void test_tag_concurrency()
+{
+	using namespace Bn3Monkey;
+
+	constexpr size_t thread_count = 8;
+	constexpr size_t tag_count = 256;
+
+	uint32_t ids[thread_count][tag_count]{ 0 };
+	std::vector<std::thread> threads;
+	for (size_t t = 0; t < thread_count; t++)
+	{
+		threads.emplace_back([&, t]() {
+			char buffer[TAG_SIZE]{ 0 };
+			for (size_t i = 0; i < tag_count; i++)
+			{
+				snprintf(buffer, sizeof(buffer), "concurrent_%zu", i);
+				ids[t][i] = Bn3Tag(Bn3Tag("parallel_"), buffer).id();
+			}
+			});
+	}
+	for (auto& thread : threads)
+		thread.join();
+
+	bool is_same = true;
+	char buffer[TAG_SIZE]{ 0 };
+	for (size_t i = 0; i < tag_count; i++)
+	{
+		snprintf(buffer, sizeof(buffer), "parallel_concurrent_%zu", i);
+		for (size_t t = 0; t < thread_count; t++)
+		{
+			if (ids[t][i] != ids[0][i] || strcmp(Bn3TagRegistry::str(ids[t][i]), buffer))
+				is_same = false;
+		}
+	}
+	if (is_same)
+	{
+		say("Good! (Tag concurrency check)");
+	}
+}
+
+void testTag(bool value)
+{
+	if (!value)
+		return;
+
+	test_tag_intern();
+	test_tag_concatenate();
+	test_tag_concurrency();
+}
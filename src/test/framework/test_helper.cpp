@@ -1,3 +1,26 @@
 #include "test_helper.hpp"
 
-Bn3Monkey::Bn3MemoryPool::Analyzer analyzer;
\ No newline at end of file
+#include <cstdlib>
+#include <new>
+
+Bn3Monkey::Bn3MemoryPool::Analyzer analyzer;
+
+std::atomic<size_t> global_allocation_count{ 0 };
+
+void* operator new(size_t size)
+{
+	global_allocation_count.fetch_add(1, std::memory_order_relaxed);
+	if (size == 0)
+		size = 1;
+	if (void* ptr = std::malloc(size))
+		return ptr;
+	throw std::bad_alloc();
+}
+void operator delete(void* ptr) noexcept
+{
+	std::free(ptr);
+}
+void operator delete(void* ptr, size_t size) noexcept
+{
+	std::free(ptr);
+}
@@ -4,6 +4,7 @@
 #include <cstdio>
 #include <cstdarg>
 #include <cstring>
+#include <atomic>
 #include <MemoryPool/MemoryPool.hpp>
 
 inline void say(const char* format, ...)
@@ -22,4 +23,7 @@ inline void say(const char* format, ...)
 
 extern Bn3Monkey::Bn3MemoryPool::Analyzer analyzer;
 
+// The number of global operator new calls from all threads
+extern std::atomic<size_t> global_allocation_count;
+
 #endif
\ No newline at end of file
@@ -1,6 +1,7 @@
 #include "framework/MemoryPool/test.hpp"
 #include "framework/StaticVector/test.hpp"
 #include "framework/StaticString/test.hpp"
+#include "framework/Tag/test.hpp"
 #include "framework/ScopedTaskRunner/test.hpp"
 #include "framework/AsyncProperty/test.hpp"
 
@@ -8,6 +9,7 @@ int main()
 {
     testStaticString(true);
     testStaticVector(true);
+    testTag(true);
     testMemoryPool(true);
     testScopedTaskRunner(true);
     testAsyncProperty(true);